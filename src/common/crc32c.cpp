@@ -0,0 +1,160 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "crc32c.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#endif
+
+// Reflected polynomial of CRC32C
+#define CRC32C_POLY 0x82f63b78
+
+// Blocks crc32c_blocks interleaves. The CRC instructions take three
+// cycles, but a new one can start every cycle.
+#define CRC32C_LANES 4
+
+static uint32_t crc32c_table[256];
+
+static bool crc32c_init() {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int j = 0; j < 8; j++) {
+      crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+    }
+    crc32c_table[i] = crc;
+  }
+  return true;
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len) {
+  // Filled on first use, so that static constructors can checksum too.
+  static const bool ready = crc32c_init();
+  (void)ready;
+
+  const uint8_t *bytes = (const uint8_t *)data;
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc = crc32c_table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void crc32c_blocks_sw(const void *data, size_t block_size,
+                             size_t count, uint32_t *crcs) {
+  for (size_t i = 0; i < count; i++) {
+    crcs[i] = crc32c_sw(0, (const char *)data + i * block_size, block_size);
+  }
+}
+
+#if defined(__x86_64__)
+#define CRC32C_HW_TARGET __attribute__((target("sse4.2")))
+#define CRC32C_U64(crc, word) _mm_crc32_u64(crc, word)
+#define CRC32C_U8(crc, byte) _mm_crc32_u8(crc, byte)
+#elif defined(__aarch64__)
+#define CRC32C_HW_TARGET __attribute__((target("+crc")))
+#define CRC32C_U64(crc, word) __crc32cd(crc, word)
+#define CRC32C_U8(crc, byte) __crc32cb(crc, byte)
+#endif
+
+#ifdef CRC32C_HW_TARGET
+CRC32C_HW_TARGET static uint32_t crc32c_hw_update(uint32_t crc,
+                                                  const uint8_t *bytes,
+                                                  size_t len) {
+  for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    crc = (uint32_t)CRC32C_U64(crc, word);
+    bytes += sizeof(word);
+  }
+  for (; len > 0; len--) crc = CRC32C_U8(crc, *bytes++);
+  return crc;
+}
+
+CRC32C_HW_TARGET static uint32_t crc32c_fast(uint32_t crc, const void *data,
+                                             size_t len) {
+  return ~crc32c_hw_update(~crc, (const uint8_t *)data, len);
+}
+
+CRC32C_HW_TARGET static void crc32c_blocks_fast(const void *data,
+                                                size_t block_size,
+                                                size_t count, uint32_t *crcs) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  const size_t words = block_size / sizeof(uint64_t);
+  size_t i = 0;
+  for (; i + CRC32C_LANES <= count; i += CRC32C_LANES) {
+    uint32_t lane[CRC32C_LANES];
+    const uint8_t *block[CRC32C_LANES];
+    for (int j = 0; j < CRC32C_LANES; j++) {
+      lane[j] = ~0U;
+      block[j] = bytes + (i + j) * block_size;
+    }
+    for (size_t w = 0; w < words; w++) {
+      for (int j = 0; j < CRC32C_LANES; j++) {
+        uint64_t word;
+        memcpy(&word, block[j] + w * sizeof(word), sizeof(word));
+        lane[j] = (uint32_t)CRC32C_U64(lane[j], word);
+      }
+    }
+    for (int j = 0; j < CRC32C_LANES; j++) {
+      size_t done = words * sizeof(uint64_t);
+      lane[j] = crc32c_hw_update(lane[j], block[j] + done, block_size - done);
+      crcs[i + j] = ~lane[j];
+    }
+  }
+  for (; i < count; i++) {
+    crcs[i] = crc32c_fast(0, bytes + i * block_size, block_size);
+  }
+}
+#endif
+
+bool crc32c_hw() {
+#if defined(__x86_64__)
+  static const bool hw = __builtin_cpu_supports("sse4.2");
+#elif defined(__aarch64__)
+  static const bool hw = getauxval(AT_HWCAP) & HWCAP_CRC32;
+#else
+  static const bool hw = false;
+#endif
+  return hw;
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+#ifdef CRC32C_HW_TARGET
+  if (crc32c_hw()) return crc32c_fast(crc, data, len);
+#endif
+  return crc32c_sw(crc, data, len);
+}
+
+void crc32c_blocks(const void *data, size_t block_size, size_t count,
+                   uint32_t *crcs) {
+#ifdef CRC32C_HW_TARGET
+  if (crc32c_hw()) return crc32c_blocks_fast(data, block_size, count, crcs);
+#endif
+  crc32c_blocks_sw(data, block_size, count, crcs);
+}
@@ -0,0 +1,44 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_CRC32C_H
+#define STOSYS_PROJECT_CRC32C_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/** Extend a CRC32C (Castagnoli) checksum with len bytes of data. Start
+ * with a crc of 0, the result can be fed back in to checksum data that
+ * is not contiguous. */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/** Compute the CRC32C of count blocks of block_size bytes each into
+ * crcs. Several blocks are checksummed at once, which hides most of the
+ * latency of the CRC instructions. */
+void crc32c_blocks(const void *data, size_t block_size, size_t count,
+                   uint32_t *crcs);
+
+/** Whether the CPU has CRC32C instructions that crc32c uses, SSE4.2 on
+ * x86-64 or the CRC extension on ARMv8. Otherwise it uses a table. */
+bool crc32c_hw();
+
+#endif  // STOSYS_PROJECT_CRC32C_H
@@ -0,0 +1,96 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "histogram.h"
+
+#include <stdlib.h>
+
+#include <new>
+
+LatencyHistogram nvme_latency;
+
+uint64_t HistogramSnapshot::percentile(double q) const {
+  if (this->count == 0) return 0;
+  uint64_t rank = q * this->count;
+  if (rank >= this->count) rank = this->count - 1;
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < this->counts.size(); i++) {
+    seen += this->counts[i];
+    if (seen > rank) return LatencyHistogram::bucket_max(i);
+  }
+  return this->max();
+}
+
+uint64_t HistogramSnapshot::max() const {
+  for (uint32_t i = this->counts.size(); i > 0; i--) {
+    if (this->counts[i - 1] != 0) return LatencyHistogram::bucket_max(i - 1);
+  }
+  return 0;
+}
+
+LatencyHistogram::LatencyHistogram() {
+  // new does not align to cache lines before C++17.
+  void *memory;
+  if (posix_memalign(&memory, alignof(Shard),
+                     HISTOGRAM_SHARDS * sizeof(Shard)) != 0) {
+    throw std::bad_alloc();
+  }
+  this->shards = (Shard *)memory;
+  for (uint32_t i = 0; i < HISTOGRAM_SHARDS; i++) {
+    new (&this->shards[i]) Shard();
+    for (std::atomic<uint64_t> &count : this->shards[i].counts) count = 0;
+    this->shards[i].sum = 0;
+  }
+}
+
+LatencyHistogram::~LatencyHistogram() { free(this->shards); }
+
+uint64_t LatencyHistogram::bucket_max(uint32_t index) {
+  const uint32_t half = 1 << (HISTOGRAM_SUB_BITS - 1);
+  if (index < 2 * half) return index;
+  if (index == HISTOGRAM_BUCKETS - 1) return UINT64_MAX;
+  uint32_t shift = index / half - 1;
+  uint64_t sub = index % half + half;
+  return ((sub + 1) << shift) - 1;
+}
+
+uint32_t LatencyHistogram::new_shard_index() {
+  static std::atomic<uint32_t> next_shard(0);
+  return next_shard.fetch_add(1, std::memory_order_relaxed) % HISTOGRAM_SHARDS;
+}
+
+void LatencyHistogram::snapshot(HistogramSnapshot *out, bool reset) {
+  out->counts.assign(HISTOGRAM_BUCKETS, 0);
+  out->count = 0;
+  out->sum = 0;
+  for (uint32_t i = 0; i < HISTOGRAM_SHARDS; i++) {
+    Shard *shard = &this->shards[i];
+    for (uint32_t j = 0; j < HISTOGRAM_BUCKETS; j++) {
+      uint64_t count =
+          reset ? shard->counts[j].exchange(0, std::memory_order_relaxed)
+                : shard->counts[j].load(std::memory_order_relaxed);
+      out->counts[j] += count;
+      out->count += count;
+    }
+    out->sum += reset ? shard->sum.exchange(0, std::memory_order_relaxed)
+                      : shard->sum.load(std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,132 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_HISTOGRAM_H
+#define STOSYS_PROJECT_HISTOGRAM_H
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "utils.h"
+
+/** Every power of two is split into 2^(HISTOGRAM_SUB_BITS - 1) linear
+ * buckets, so a bucket is at most about 3% wide. */
+#define HISTOGRAM_SUB_BITS 5
+
+/** Values from 2^HISTOGRAM_MAX_BITS up all end up in the last bucket,
+ * in clock ticks that is hours. */
+#define HISTOGRAM_MAX_BITS 48
+
+#define HISTOGRAM_BUCKETS                                         \
+  ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 2) *                \
+   (1 << (HISTOGRAM_SUB_BITS - 1)))
+
+/** Number of copies of the counters, threads are spread over them so
+ * that they rarely write to the same cache lines. */
+#define HISTOGRAM_SHARDS 16
+
+/** Counts of a LatencyHistogram summed over all threads */
+struct HistogramSnapshot {
+  std::vector<uint64_t> counts;
+  uint64_t count;
+  /** Sum of all recorded values */
+  uint64_t sum;
+
+  /** The value below which a fraction q of the recorded values are,
+   * rounded up to the end of its bucket. */
+  uint64_t percentile(double q) const;
+
+  /** Upper bound of the largest recorded value */
+  uint64_t max() const;
+};
+
+/** Log-linear histogram of durations in clock_ticks, in the style of
+ * HdrHistogram. Recording is a couple of relaxed atomic increments on
+ * counters that are private to the thread most of the time. */
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+  ~LatencyHistogram();
+
+  LatencyHistogram(const LatencyHistogram &) = delete;
+  LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+  void record(uint64_t ticks) {
+    Shard *shard = &this->shards[shard_index()];
+    shard->counts[bucket(ticks)].fetch_add(1, std::memory_order_relaxed);
+    shard->sum.fetch_add(ticks, std::memory_order_relaxed);
+  }
+
+  /** Sum up the counters of all threads, and clear them if reset is set.
+   * Nothing recorded concurrently is lost, it ends up in either this
+   * snapshot or the next one. */
+  void snapshot(HistogramSnapshot *out, bool reset);
+
+  /** Bucket of a value */
+  static uint32_t bucket(uint64_t value) {
+    const uint32_t half = 1 << (HISTOGRAM_SUB_BITS - 1);
+    if (value < 2 * half) return value;
+    if (value >> HISTOGRAM_MAX_BITS) return HISTOGRAM_BUCKETS - 1;
+    // The top HISTOGRAM_SUB_BITS bits pick the bucket within the power
+    // of two, the shift is which power of two.
+    uint32_t shift = 63 - __builtin_clzll(value) - (HISTOGRAM_SUB_BITS - 1);
+    return shift * half + (value >> shift);
+  }
+
+  /** The largest value that goes in a bucket */
+  static uint64_t bucket_max(uint32_t index);
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> counts[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> sum;
+  };
+
+  /** Shard of the calling thread, handed out round-robin */
+  static uint32_t shard_index() {
+    thread_local int32_t index = -1;
+    if (index < 0) index = new_shard_index();
+    return index;
+  }
+  static uint32_t new_shard_index();
+
+  Shard *shards;
+};
+
+/** Records the lifetime of the object in a histogram. */
+class ScopedLatency {
+ public:
+  explicit ScopedLatency(LatencyHistogram *histogram)
+      : histogram(histogram), start(clock_ticks()) {}
+  ~ScopedLatency() { this->histogram->record(clock_ticks() - this->start); }
+
+ private:
+  LatencyHistogram *histogram;
+  uint64_t start;
+};
+
+/** Latency of every NVMe command sent through nvmewrappers, for all
+ * devices in the process. */
+extern LatencyHistogram nvme_latency;
+
+#endif
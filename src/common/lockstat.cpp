@@ -0,0 +1,107 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "lockstat.h"
+
+#include <atomic>
+
+#include "histogram.h"
+
+#ifdef STOSYS_LOCKSTAT
+/** Locks a thread can hold at once and still have their hold time
+ * measured */
+#define LOCKSTAT_HELD 16
+
+static const char *lock_names[LOCK_IDS] = {
+    "log_map",
+    "data_map",
+    "zones",
+    "block_map",
+    "fs_wp",
+    "fs_inode_map",
+    "fs_inode_cache",
+    "fs_dir_cache",
+    "fs_file_lock",
+};
+
+struct LockStats {
+  std::atomic<uint64_t> acquired{0};
+  std::atomic<uint64_t> contended{0};
+  LatencyHistogram wait;
+  LatencyHistogram hold;
+};
+
+static LockStats lock_stats[LOCK_IDS];
+
+struct HeldLock {
+  const void *lock;
+  uint64_t since;
+};
+
+static thread_local HeldLock held[LOCKSTAT_HELD];
+static thread_local uint32_t nheld = 0;
+
+void lockstat_acquired(LockId id, const void *lock, uint64_t wait_ticks) {
+  LockStats &stats = lock_stats[id];
+  stats.acquired.fetch_add(1, std::memory_order_relaxed);
+  if (wait_ticks != 0) {
+    stats.contended.fetch_add(1, std::memory_order_relaxed);
+  }
+  stats.wait.record(wait_ticks);
+  if (nheld < LOCKSTAT_HELD) held[nheld++] = {lock, clock_ticks()};
+}
+
+void lockstat_released(LockId id, const void *lock) {
+  for (uint32_t i = nheld; i-- > 0;) {
+    if (held[i].lock != lock) continue;
+    lock_stats[id].hold.record(clock_ticks() - held[i].since);
+    held[i] = held[--nheld];
+    return;
+  }
+}
+#endif
+
+void lockstat_dump(FILE *out) {
+#ifdef STOSYS_LOCKSTAT
+  // Times are in microseconds, the percentiles are rounded up.
+  fprintf(out, "%-16s %10s %10s %9s %9s %9s %9s %9s %9s %12s\n", "lock",
+          "acquired", "contended", "wait p50", "p99", "max", "hold p50",
+          "p99", "max", "total wait");
+  for (int id = 0; id < LOCK_IDS; id++) {
+    LockStats &stats = lock_stats[id];
+    HistogramSnapshot wait, hold;
+    stats.wait.snapshot(&wait, false);
+    stats.hold.snapshot(&hold, false);
+    if (stats.acquired == 0) continue;
+    fprintf(out,
+            "%-16s %10lu %10lu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %12.1f\n",
+            lock_names[id], stats.acquired.load(), stats.contended.load(),
+            ticks_to_ns(wait.percentile(0.5)) / 1000.0,
+            ticks_to_ns(wait.percentile(0.99)) / 1000.0,
+            ticks_to_ns(wait.max()) / 1000.0,
+            ticks_to_ns(hold.percentile(0.5)) / 1000.0,
+            ticks_to_ns(hold.percentile(0.99)) / 1000.0,
+            ticks_to_ns(hold.max()) / 1000.0, ticks_to_ns(wait.sum) / 1000.0);
+  }
+#else
+  fprintf(out, "lock profiling is off, build with STOSYS_LOCKSTAT\n");
+#endif
+}
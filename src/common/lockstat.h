@@ -0,0 +1,142 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_LOCKSTAT_H
+#define STOSYS_PROJECT_LOCKSTAT_H
+#pragma once
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include <cstdint>
+#include <mutex>
+
+#include "utils.h"
+
+/** Locks that are profiled in builds with STOSYS_LOCKSTAT. Locks of the
+ * same kind share an id, like the block maps of all the zones. */
+enum LockId {
+  LOCK_LOG_MAP = 0,
+  LOCK_DATA_MAP,
+  LOCK_ZONES,
+  LOCK_BLOCK_MAP,
+  LOCK_FS_WP,
+  LOCK_FS_INODE_MAP,
+  LOCK_FS_INODE_CACHE,
+  LOCK_FS_DIR_CACHE,
+  LOCK_FS_FILE_LOCK,
+  LOCK_IDS,
+};
+
+/** Write how often every lock was taken and contended, and how long it
+ * was waited for and held, to out. */
+void lockstat_dump(FILE *out);
+
+#ifdef STOSYS_LOCKSTAT
+/** A thread got lock after waiting for wait_ticks, 0 if it was free. */
+void lockstat_acquired(LockId id, const void *lock, uint64_t wait_ticks);
+
+/** A thread let go of lock, the hold time is kept per thread so that
+ * shared locks are covered too. */
+void lockstat_released(LockId id, const void *lock);
+
+/** Try the lock first, so that only contended acquisitions are timed. */
+#define LOCKSTAT_ACQUIRE(id, lock, try_lock, do_lock)     \
+  do {                                                    \
+    if (try_lock) {                                       \
+      lockstat_acquired(id, lock, 0);                     \
+    } else {                                              \
+      uint64_t start = clock_ticks();                     \
+      do_lock;                                            \
+      lockstat_acquired(id, lock, clock_ticks() - start); \
+    }                                                     \
+  } while (0)
+#endif
+
+/** The lock functions of pthread and std::mutex, which also profile the
+ * lock in builds with STOSYS_LOCKSTAT. */
+inline void profiled_rdlock(pthread_rwlock_t *lock, LockId id) {
+#ifdef STOSYS_LOCKSTAT
+  LOCKSTAT_ACQUIRE(id, lock, pthread_rwlock_tryrdlock(lock) == 0,
+                   pthread_rwlock_rdlock(lock));
+#else
+  (void)id;
+  pthread_rwlock_rdlock(lock);
+#endif
+}
+
+inline void profiled_wrlock(pthread_rwlock_t *lock, LockId id) {
+#ifdef STOSYS_LOCKSTAT
+  LOCKSTAT_ACQUIRE(id, lock, pthread_rwlock_trywrlock(lock) == 0,
+                   pthread_rwlock_wrlock(lock));
+#else
+  (void)id;
+  pthread_rwlock_wrlock(lock);
+#endif
+}
+
+inline void profiled_unlock(pthread_rwlock_t *lock, LockId id) {
+#ifdef STOSYS_LOCKSTAT
+  lockstat_released(id, lock);
+#else
+  (void)id;
+#endif
+  pthread_rwlock_unlock(lock);
+}
+
+inline void profiled_lock(pthread_mutex_t *lock, LockId id) {
+#ifdef STOSYS_LOCKSTAT
+  LOCKSTAT_ACQUIRE(id, lock, pthread_mutex_trylock(lock) == 0,
+                   pthread_mutex_lock(lock));
+#else
+  (void)id;
+  pthread_mutex_lock(lock);
+#endif
+}
+
+inline void profiled_unlock(pthread_mutex_t *lock, LockId id) {
+#ifdef STOSYS_LOCKSTAT
+  lockstat_released(id, lock);
+#else
+  (void)id;
+#endif
+  pthread_mutex_unlock(lock);
+}
+
+inline void profiled_lock(std::mutex *lock, LockId id) {
+#ifdef STOSYS_LOCKSTAT
+  LOCKSTAT_ACQUIRE(id, lock, lock->try_lock(), lock->lock());
+#else
+  (void)id;
+  lock->lock();
+#endif
+}
+
+inline void profiled_unlock(std::mutex *lock, LockId id) {
+#ifdef STOSYS_LOCKSTAT
+  lockstat_released(id, lock);
+#else
+  (void)id;
+#endif
+  lock->unlock();
+}
+
+#endif
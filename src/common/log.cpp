@@ -0,0 +1,183 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "log.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <string>
+#include <thread>
+
+static int initial_level() {
+  const char *level = getenv("STOSYS_LOG_LEVEL");
+  return level ? atoi(level) : LOG_WARN;
+}
+
+static uint32_t initial_mask() {
+  const char *mask = getenv("STOSYS_LOG_MASK");
+  return mask ? strtoul(mask, nullptr, 0) : DPRINT_MASK;
+}
+
+std::atomic<int> log_level(initial_level());
+std::atomic<uint32_t> log_mask(initial_mask());
+
+namespace {
+
+/** A bounded queue in the style of Dmitry Vyukov's: every slot has a
+ * sequence number that tells the producers and the consumer whose turn
+ * it is, so neither takes a lock. */
+struct LogSlot {
+  std::atomic<uint64_t> seq;
+  char text[LOG_MESSAGE_SIZE];
+};
+
+class LogWriter {
+ public:
+  LogWriter()
+      : enqueue_pos(0), dequeue_pos(0), dropped(0), reported(0), stop(false) {
+    for (uint64_t i = 0; i < LOG_QUEUE_SIZE; i++) this->slots[i].seq = i;
+  }
+
+  ~LogWriter() {
+    this->stop = true;
+    if (this->thread.joinable()) this->thread.join();
+  }
+
+  /** Get a slot to write a message to. If the queue is full, wait for
+   * room if wait is set, otherwise drop the message. */
+  LogSlot *claim(bool wait) {
+    std::call_once(this->started, [this] {
+      this->thread = std::thread(&LogWriter::run, this);
+    });
+    uint64_t pos = this->enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      LogSlot *slot = &this->slots[pos % LOG_QUEUE_SIZE];
+      int64_t diff = slot->seq.load(std::memory_order_acquire) - pos;
+      if (diff == 0) {
+        if (this->enqueue_pos.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          return slot;
+        }
+      } else if (diff < 0) {
+        // The writer thread is a whole queue behind.
+        if (wait) {
+          usleep(100);
+          pos = this->enqueue_pos.load(std::memory_order_relaxed);
+          continue;
+        }
+        this->dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      } else {
+        pos = this->enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void publish(LogSlot *slot) {
+    uint64_t pos = slot->seq.load(std::memory_order_relaxed);
+    slot->seq.store(pos + 1, std::memory_order_release);
+  }
+
+  void flush() {
+    uint64_t target = this->enqueue_pos.load(std::memory_order_relaxed);
+    while (this->thread.joinable() &&
+           this->dequeue_pos.load(std::memory_order_acquire) < target) {
+      usleep(100);
+    }
+  }
+
+  std::atomic<uint64_t> enqueue_pos;
+  std::atomic<uint64_t> dequeue_pos;
+  std::atomic<uint64_t> dropped;
+
+ private:
+  /** Write out whatever is queued in as few writes as possible. */
+  bool drain() {
+    std::string batch;
+    uint64_t pos = this->dequeue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      LogSlot *slot = &this->slots[pos % LOG_QUEUE_SIZE];
+      if (slot->seq.load(std::memory_order_acquire) != pos + 1) break;
+      batch.append(slot->text);
+      slot->seq.store(pos + LOG_QUEUE_SIZE, std::memory_order_release);
+      pos++;
+    }
+    if (batch.empty()) return false;
+    uint64_t dropped = this->dropped.load(std::memory_order_relaxed);
+    if (dropped != this->reported) {
+      batch.append("[log] dropped " + std::to_string(dropped - this->reported) +
+                   " messages\n");
+      this->reported = dropped;
+    }
+    fwrite(batch.data(), 1, batch.size(), stderr);
+    fflush(stderr);
+    this->dequeue_pos.store(pos, std::memory_order_release);
+    return true;
+  }
+
+  void run() {
+    while (true) {
+      if (this->drain()) continue;
+      if (this->stop) break;
+      usleep(1000);
+    }
+  }
+
+  LogSlot slots[LOG_QUEUE_SIZE];
+  /** Dropped messages mentioned in the log so far */
+  uint64_t reported;
+  std::once_flag started;
+  std::thread thread;
+  std::atomic<bool> stop;
+};
+
+LogWriter writer;
+
+}  // namespace
+
+void log_set_level(int level) {
+  log_level.store(level, std::memory_order_relaxed);
+}
+
+void log_set_mask(uint32_t mask) {
+  log_mask.store(mask, std::memory_order_relaxed);
+}
+
+void log_write(int level, const char *fmt, ...) {
+  // Errors are never dropped, they are rare enough to wait for.
+  LogSlot *slot = writer.claim(level == LOG_ERROR);
+  if (slot == nullptr) return;
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+  va_end(args);
+  writer.publish(slot);
+}
+
+void log_flush() { writer.flush(); }
+
+uint64_t log_dropped() {
+  return writer.dropped.load(std::memory_order_relaxed);
+}
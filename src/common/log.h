@@ -0,0 +1,99 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_LOG_H
+#define STOSYS_PROJECT_LOG_H
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "stosys_debug.h"
+
+/** Severity of a message, a message is written if its level is at most
+ * the current level. */
+#define LOG_ERROR 0
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+
+/** Messages above this level are compiled out entirely. */
+#ifndef LOG_MAX_LEVEL
+#ifdef NODEBUG
+#define LOG_MAX_LEVEL LOG_INFO
+#else
+#define LOG_MAX_LEVEL LOG_DEBUG
+#endif
+#endif
+
+/** Messages are cut off at this length */
+#define LOG_MESSAGE_SIZE 240
+
+/** Number of messages that can be waiting for the writer thread, more
+ * are dropped rather than blocking the caller. */
+#define LOG_QUEUE_SIZE 4096
+
+extern std::atomic<int> log_level;
+extern std::atomic<uint32_t> log_mask;
+
+/** Whether a message of level in the DBG_* category is written. Errors
+ * are written no matter their category. */
+inline bool log_enabled(int level, uint32_t category) {
+  return level <= log_level.load(std::memory_order_relaxed) &&
+         (level == LOG_ERROR ||
+          (category & log_mask.load(std::memory_order_relaxed)) != 0);
+}
+
+/** Change what is written at runtime. The initial level and mask are
+ * taken from STOSYS_LOG_LEVEL and STOSYS_LOG_MASK if they are set, and
+ * are LOG_WARN and DPRINT_MASK otherwise. */
+void log_set_level(int level);
+void log_set_mask(uint32_t mask);
+
+/** Format the message and queue it for the writer thread, which writes
+ * it to stderr. Use ss_log so that disabled messages cost nothing. */
+void log_write(int level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/** Wait until everything queued so far has been written. */
+void log_flush();
+
+/** Number of messages dropped because the queue was full */
+uint64_t log_dropped();
+
+#define ss_log(level, category, fmt, ...)                   \
+  do {                                                      \
+    if ((level) <= LOG_MAX_LEVEL &&                         \
+        log_enabled((level), (category))) {                 \
+      log_write((level), fmt, ##__VA_ARGS__);               \
+    }                                                       \
+  } while (0)
+
+#define ss_error(category, fmt, ...) \
+  ss_log(LOG_ERROR, category, fmt, ##__VA_ARGS__)
+#define ss_warn(category, fmt, ...) \
+  ss_log(LOG_WARN, category, fmt, ##__VA_ARGS__)
+#define ss_info(category, fmt, ...) \
+  ss_log(LOG_INFO, category, fmt, ##__VA_ARGS__)
+#define ss_debug(category, fmt, ...) \
+  ss_log(LOG_DEBUG, category, fmt, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,49 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "memstat.h"
+
+#include <stdlib.h>
+
+/** Room in front of a counted buffer, keeps it aligned like malloc */
+#define COUNTED_HEADER 16
+
+void MemCounter::add(uint64_t bytes) {
+  uint64_t now = this->current += bytes;
+  uint64_t peak = this->peak.load(std::memory_order_relaxed);
+  while (now > peak && !this->peak.compare_exchange_weak(peak, now)) {
+  }
+}
+
+void *counted_malloc(MemCounter *counter, size_t size) {
+  char *block = (char *)malloc(size + COUNTED_HEADER);
+  if (block == nullptr) return nullptr;
+  *(size_t *)block = size;
+  counter->add(size);
+  return block + COUNTED_HEADER;
+}
+
+void counted_free(MemCounter *counter, void *buffer) {
+  if (buffer == nullptr) return;
+  char *block = (char *)buffer - COUNTED_HEADER;
+  counter->sub(*(size_t *)block);
+  free(block);
+}
@@ -0,0 +1,77 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_MEMSTAT_H
+#define STOSYS_PROJECT_MEMSTAT_H
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/** Heap bytes of an unordered map or set, following the libstdc++
+ * layout: an array of bucket pointers and a node per element with a
+ * next pointer and the value. Integer keys do not cache their hash.
+ * The overhead of malloc itself is not counted. */
+template <class Map>
+uint64_t hash_map_bytes(const Map &map) {
+  return map.bucket_count() * sizeof(void *) +
+         map.size() * (sizeof(void *) + sizeof(typename Map::value_type));
+}
+
+/** Heap bytes of a vector, including the capacity that is not used */
+template <class T>
+uint64_t vector_bytes(const std::vector<T> &vector) {
+  return vector.capacity() * sizeof(T);
+}
+
+/** Bytes in use for something that is allocated and freed over time,
+ * and the most that was ever in use at once. */
+struct MemCounter {
+  std::atomic<uint64_t> current{0};
+  std::atomic<uint64_t> peak{0};
+
+  void add(uint64_t bytes);
+  void sub(uint64_t bytes) { this->current -= bytes; }
+};
+
+/** Accounts bytes to a counter for as long as it is in scope */
+class MemScope {
+ public:
+  MemScope(MemCounter *counter, uint64_t bytes)
+      : counter(counter), bytes(bytes) {
+    counter->add(bytes);
+  }
+  ~MemScope() { this->counter->sub(this->bytes); }
+
+ private:
+  MemCounter *counter;
+  uint64_t bytes;
+};
+
+/** malloc and free for buffers that are accounted to counter. The size
+ * is kept in front of the buffer, so free needs no size. */
+void *counted_malloc(MemCounter *counter, size_t size);
+void counted_free(MemCounter *counter, void *buffer);
+
+#endif
@@ -9,6 +9,9 @@
 
 #include <cstdint>
 
+#include "histogram.h"
+#include "trace.h"
+
 extern "C" {
 void print_nvme_error(const char *type, const int ret) {
   fprintf(stderr, "NVMe %s error: %s\n", type,
@@ -31,6 +34,8 @@ int ss_nvme_write(int fd, __u32 nsid, __u64 slba, __u16 nlb, __u16 control,
                   __u8 dsm, __u16 dspec, __u32 reftag, __u16 apptag,
                   __u16 appmask, __u32 data_len, void *data, __u32 metadata_len,
                   void *metadata) {
+  ScopedLatency latency(&nvme_latency);
+  ScopedTrace trace(TRACE_NVME_WRITE, 0, slba, nlb + 1);
   int32_t ret =
       nvme_write(fd, nsid, slba, nlb, control, dsm, dspec, reftag, apptag,
                  appmask, data_len, data, metadata_len, metadata);
@@ -52,6 +57,7 @@ int ss_nvme_zns_append(int fd, __u32 nsid, __u64 zslba, __u16 nlb,
                        __u16 control, __u32 ilbrt, __u16 lbat, __u16 lbatm,
                        __u32 data_len, void *data, __u32 metadata_len,
                        void *metadata, __u64 *result) {
+  ScopedLatency latency(&nvme_latency);
   uint32_t ret =
       nvme_zns_append(fd, nsid, zslba, nlb, control, ilbrt, lbat, lbatm,
                       data_len, data, metadata_len, metadata, result);
@@ -70,11 +76,28 @@ int ss_nvme_zns_append(int fd, __u32 nsid, __u64 zslba, __u16 nlb,
 int ss_nvme_write_zeros(int fd, __u32 nsid, __u64 slba, __u16 nlb,
                         __u16 control, __u32 reftag, __u16 apptag,
                         __u16 appmask) {
+  ScopedLatency latency(&nvme_latency);
   return nvme_write_zeros(fd, nsid, slba, nlb, control, reftag, apptag,
                           appmask);
 }
 
+int ss_nvme_flush(int fd, __u32 nsid) {
+  ScopedLatency latency(&nvme_latency);
+  int32_t ret = nvme_flush(fd, nsid);
+  if (ret == -1) {
+    perror("ss_nvme_flush() failed");
+  } else if (ret != 0) {
+    print_nvme_error("flush", ret);
+#ifdef EARLY_EXIT
+    exit(ret);
+#endif
+  }
+
+  return ret;
+}
+
 int ss_device_zone_reset(int fd, uint32_t nsid, uint64_t slba) {
+  ScopedLatency latency(&nvme_latency);
   // this is to supress gcc warnings, remove it when you complete this function
   __u32 cdw10 = slba & 0xffffffff;
   __u32 cdw11 = slba >> 32;
@@ -88,6 +111,7 @@ int ss_device_zone_reset(int fd, uint32_t nsid, uint64_t slba) {
 int ss_nvme_zns_mgmt_send(int t1, unsigned int t2, unsigned long long t3,
                           bool t4, nvme_zns_send_action t5, unsigned int t6,
                           void *t7) {
+  ScopedLatency latency(&nvme_latency);
   return nvme_zns_mgmt_send(t1, t2, t3, t4, t5, t6, t7);
 }
 
@@ -95,6 +119,8 @@ int ss_nvme_read(int fd, __u32 nsid, __u64 slba, __u16 nlb, __u16 control,
                  __u8 dsm, __u32 reftag, __u16 apptag, __u16 appmask,
                  __u32 data_len, void *data, __u32 metadata_len,
                  void *metadata) {
+  ScopedLatency latency(&nvme_latency);
+  ScopedTrace trace(TRACE_NVME_READ, 0, slba, nlb + 1);
   int32_t ret = nvme_read(fd, nsid, slba, nlb, control, dsm, reftag, apptag,
                           appmask, data_len, data, metadata_len, metadata);
 
@@ -0,0 +1,68 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_PROBES_H
+#define STOSYS_PROJECT_PROBES_H
+#pragma once
+
+/* USDT probes of the stosys provider, for bpftrace and friends:
+ *
+ *   bpftrace -e 'usdt:./libstosys.so:stosys:ftl_write_entry { ... }'
+ *
+ * A probe is a single nop until a tracer attaches to it. Without
+ * sys/sdt.h (systemtap-sdt-dev) they compile to nothing.
+ *
+ * ftl_read_entry(lba, size)          ftl_read_return(lba, size, ret)
+ * ftl_write_entry(lba, size, hint)   ftl_write_return(lba, size, ret)
+ * log_map_insert(lba, pa, zone)      log_map_delete(lba, pa, zone)
+ * data_map_insert(region, pa, zone)
+ * gc_victim(zone, alive_blocks, capacity)
+ * gc_merge(log_zone, region, blocks, merged) merged is 0 for an insert
+ * zone_reset(zone, reset_count)
+ * block_append(addr, size, hint)
+ * file_append(name, size)  file_read(name, offset, size)
+ * file_sync(name)
+ */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define STOSYS_HAVE_SDT 1
+#endif
+#endif
+
+#ifdef STOSYS_HAVE_SDT
+#include <sys/sdt.h>
+#define STOSYS_PROBE1(name, a) DTRACE_PROBE1(stosys, name, a)
+#define STOSYS_PROBE2(name, a, b) DTRACE_PROBE2(stosys, name, a, b)
+#define STOSYS_PROBE3(name, a, b, c) DTRACE_PROBE3(stosys, name, a, b, c)
+#define STOSYS_PROBE4(name, a, b, c, d) \
+  DTRACE_PROBE4(stosys, name, a, b, c, d)
+#else
+// Still use the arguments, so that values computed only for a probe do
+// not trigger unused warnings.
+#define STOSYS_PROBE1(name, a) ((void)(a))
+#define STOSYS_PROBE2(name, a, b) ((void)(a), (void)(b))
+#define STOSYS_PROBE3(name, a, b, c) ((void)(a), (void)(b), (void)(c))
+#define STOSYS_PROBE4(name, a, b, c, d) \
+  ((void)(a), (void)(b), (void)(c), (void)(d))
+#endif
+
+#endif
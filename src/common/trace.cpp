@@ -0,0 +1,137 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "trace.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+std::atomic<bool> trace_enabled(false);
+
+namespace {
+
+/** Only written by its own thread, and kept after the thread exits so
+ * that its events can still be dumped, until a new thread takes it. */
+struct TraceRing {
+  uint32_t tid;
+  char name[16];
+  std::atomic<uint64_t> head;
+  TraceEvent events[TRACE_RING_EVENTS];
+};
+
+pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+std::vector<TraceRing *> rings;
+/** The rings of threads that exited, the one that exited first up front */
+std::vector<TraceRing *> free_rings;
+
+/** Hands the ring of a thread back when it exits, so that the number of
+ * rings is bounded by the most threads that were alive at once. */
+struct RingOwner {
+  TraceRing *ring = nullptr;
+
+  ~RingOwner() {
+    if (this->ring == nullptr) return;
+    pthread_mutex_lock(&rings_lock);
+    free_rings.push_back(this->ring);
+    pthread_mutex_unlock(&rings_lock);
+    this->ring = nullptr;
+  }
+};
+
+TraceRing *thread_ring() {
+  thread_local RingOwner owner;
+  if (owner.ring == nullptr) {
+    pthread_mutex_lock(&rings_lock);
+    if (free_rings.empty()) {
+      owner.ring = new TraceRing();
+      rings.push_back(owner.ring);
+    } else {
+      owner.ring = free_rings.front();
+      free_rings.erase(free_rings.begin());
+    }
+    // Under the lock, so that a dump never sees half of the old thread.
+    owner.ring->tid = syscall(SYS_gettid);
+    memset(owner.ring->name, 0, sizeof(owner.ring->name));
+    owner.ring->head = 0;
+    pthread_mutex_unlock(&rings_lock);
+  }
+  return owner.ring;
+}
+
+}  // namespace
+
+void trace_enable(bool on) {
+  trace_enabled.store(on, std::memory_order_relaxed);
+}
+
+void trace_record(uint16_t op, uint16_t zone, uint64_t lba, uint32_t len,
+                  uint64_t start, uint64_t end) {
+  TraceRing *ring = thread_ring();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  ring->events[head % TRACE_RING_EVENTS] = TraceEvent{
+      .start = start, .end = end, .lba = lba, .len = len, .op = op,
+      .zone = zone};
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void trace_thread_name(const char *name) {
+  TraceRing *ring = thread_ring();
+  strncpy(ring->name, name, sizeof(ring->name) - 1);
+}
+
+int trace_dump(const char *path) {
+  FILE *file = fopen(path, "wb");
+  if (file == nullptr) return -errno;
+
+  pthread_mutex_lock(&rings_lock);
+  TraceFileHeader header = {
+      .magic = TRACE_MAGIC,
+      .version = TRACE_VERSION,
+      .ns_per_tick = ticks_to_ns(1ULL << 32) / (double)(1ULL << 32),
+      .nthreads = (uint32_t)rings.size(),
+      .reserved = 0};
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (TraceRing *ring : rings) {
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t count = std::min(head, (uint64_t)TRACE_RING_EVENTS);
+    TraceThreadHeader thread = {};
+    thread.tid = ring->tid;
+    thread.count = count;
+    memcpy(thread.name, ring->name, sizeof(thread.name));
+    ok = ok && fwrite(&thread, sizeof(thread), 1, file) == 1;
+    // Oldest first, the ring may have wrapped.
+    for (uint64_t i = head - count; ok && i < head; i++) {
+      ok = fwrite(&ring->events[i % TRACE_RING_EVENTS], sizeof(TraceEvent), 1,
+                  file) == 1;
+    }
+  }
+  pthread_mutex_unlock(&rings_lock);
+
+  if (fclose(file) != 0) ok = false;
+  return ok ? 0 : -EIO;
+}
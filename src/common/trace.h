@@ -0,0 +1,131 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_TRACE_H
+#define STOSYS_PROJECT_TRACE_H
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "utils.h"
+
+/** Identifies a trace file written by trace_dump */
+#define TRACE_MAGIC 0x4352545a
+#define TRACE_VERSION 1
+
+/** Events kept per thread, older ones are overwritten */
+#define TRACE_RING_EVENTS (1 << 14)
+
+/** Kinds of traced events, also the names in the exported trace */
+enum TraceOp {
+  TRACE_HOST_READ = 1,
+  TRACE_HOST_WRITE = 2,
+  /** A writer blocked until the GC freed a log zone */
+  TRACE_WRITE_STALL = 3,
+  /** Reclaiming a single log zone, zone is the log zone */
+  TRACE_GC_CYCLE = 4,
+  /** The GC copying a block, zone is the target zone */
+  TRACE_GC_COPY = 5,
+  TRACE_ZONE_RESET = 6,
+  TRACE_JOURNAL_COMMIT = 7,
+  TRACE_CHECKPOINT = 8,
+  TRACE_FLUSH = 9,
+  TRACE_NVME_READ = 10,
+  TRACE_NVME_WRITE = 11,
+};
+
+/** A finished operation, times are in clock_ticks. lba is a byte address
+ * for host I/O and a block address for NVMe commands. */
+struct TraceEvent {
+  uint64_t start;
+  uint64_t end;
+  uint64_t lba;
+  uint32_t len;
+  uint16_t op;
+  uint16_t zone;
+};
+
+/** Layout of a trace file: a TraceFileHeader, then for each of nthreads
+ * threads a TraceThreadHeader followed by count TraceEvents. */
+struct TraceFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  /** To convert the clock_ticks of the events to time */
+  double ns_per_tick;
+  uint32_t nthreads;
+  uint32_t reserved;
+};
+
+struct TraceThreadHeader {
+  uint32_t tid;
+  uint32_t count;
+  char name[16];
+};
+
+extern std::atomic<bool> trace_enabled;
+
+/** Whether events are recorded, this is all that tracing costs while
+ * it is off. */
+inline bool tracing() {
+  return trace_enabled.load(std::memory_order_relaxed);
+}
+
+/** Turn recording on or off at runtime. */
+void trace_enable(bool on);
+
+/** Append an event to the ring of the calling thread, without locks. */
+void trace_record(uint16_t op, uint16_t zone, uint64_t lba, uint32_t len,
+                  uint64_t start, uint64_t end);
+
+/** Name the calling thread in the trace. */
+void trace_thread_name(const char *name);
+
+/** Write the events of all threads to path. Those of a thread that
+ * exited are kept until a new thread reuses its ring. Events recorded
+ * while the dump runs may come out garbled, turn tracing off first for a
+ * clean trace. Returns 0 or -errno. */
+int trace_dump(const char *path);
+
+/** Records an event for its lifetime, if tracing was on when it began. */
+class ScopedTrace {
+ public:
+  ScopedTrace(uint16_t op, uint16_t zone, uint64_t lba, uint32_t len)
+      : on(tracing()), op(op), zone(zone), lba(lba), len(len) {
+    if (this->on) this->start = clock_ticks();
+  }
+  ~ScopedTrace() {
+    if (this->on) {
+      trace_record(this->op, this->zone, this->lba, this->len, this->start,
+                   clock_ticks());
+    }
+  }
+
+ private:
+  bool on;
+  uint16_t op;
+  uint16_t zone;
+  uint64_t lba;
+  uint32_t len;
+  uint64_t start;
+};
+
+#endif
@@ -79,6 +79,29 @@ uint64_t microseconds_since_epoch() {
       .count();
 }
 
+// Measures the rate of clock_ticks against the steady clock once, the
+// counter is assumed to run at a constant rate from then on.
+static double calibrate_ticks() {
+  auto start = std::chrono::steady_clock::now();
+  uint64_t ticks = clock_ticks();
+  std::chrono::steady_clock::duration elapsed;
+  do {
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed < std::chrono::milliseconds(2));
+  uint64_t ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  return (double)ns / (clock_ticks() - ticks);
+}
+
+uint64_t ticks_to_ns(uint64_t ticks) {
+  static const double ns_per_tick = calibrate_ticks();
+  return ticks * ns_per_tick;
+}
+
+uint64_t monotonic_microseconds() {
+  return ticks_to_ns(clock_ticks()) / 1000;
+}
+
 static void process_mem_usage_stat(double &vm_usage, double &resident_set) {
   using std::ifstream;
   using std::ios_base;
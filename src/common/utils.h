@@ -27,9 +27,14 @@ SOFTWARE.
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <cstdint>
 #include <string>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
 #define ONE_BILLION 1000000000.0
 
 extern "C" {
@@ -41,5 +46,28 @@ void match_pattern_with_start(char *data, uint64_t len, uint64_t s);
 }
 
 uint64_t microseconds_since_epoch();
+
+/** A monotonic clock that is cheap enough for the hot paths: the time
+ * stamp counter of the CPU, assumed to be invariant, where there is one.
+ * Only differences between ticks mean anything. */
+inline uint64_t clock_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t ticks;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+/** Converts a number of clock_ticks to nanoseconds. */
+uint64_t ticks_to_ns(uint64_t ticks);
+
+/** Microseconds on the clock_ticks clock, for measuring intervals. */
+uint64_t monotonic_microseconds();
 std::string get_vm_stats();
 #endif  // STOSYS_PROJECT_UTILS_H
@@ -0,0 +1,269 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "checkpoint.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "../common/crc32c.h"
+#include "../common/nvmewrappers.h"
+#include "recovery.hpp"
+
+CheckpointWriter::CheckpointWriter(int fd, uint32_t nsid, uint16_t lba_size,
+                                   uint64_t mdts, uint64_t slba,
+                                   uint64_t nblocks) {
+  this->fd = fd;
+  this->nsid = nsid;
+  this->lba_size = lba_size;
+  this->start_lba = slba;
+  this->next_lba = slba;
+  this->end_lba = slba + nblocks;
+  uint64_t chunk = std::max(mdts / lba_size, (uint64_t)1);
+  this->buffer = std::vector<char>(chunk * lba_size);
+  this->used = 0;
+  this->crc = 0;
+  this->failed = false;
+}
+
+void CheckpointWriter::flush_buffer() {
+  // Only whole blocks can be written, the tail of the last one is zeroed.
+  uint64_t nblocks = (this->used + this->lba_size - 1) / this->lba_size;
+  if (nblocks == 0 || this->failed) {
+    this->used = 0;
+    return;
+  }
+  if (this->next_lba + nblocks > this->end_lba) {
+    this->failed = true;
+    return;
+  }
+  memset(this->buffer.data() + this->used, 0,
+         nblocks * this->lba_size - this->used);
+  if (ss_nvme_write(this->fd, this->nsid, this->next_lba, nblocks - 1, 0, 0, 0,
+                    0, 0, 0, nblocks * this->lba_size, this->buffer.data(), 0,
+                    nullptr) != 0) {
+    this->failed = true;
+  }
+  this->next_lba += nblocks;
+  this->used = 0;
+}
+
+void CheckpointWriter::put_raw(const void *data, size_t size) {
+  const char *bytes = (const char *)data;
+  while (size > 0) {
+    if (this->used == this->buffer.size()) this->flush_buffer();
+    size_t n = std::min(size, this->buffer.size() - this->used);
+    memcpy(this->buffer.data() + this->used, bytes, n);
+    this->used += n;
+    bytes += n;
+    size -= n;
+  }
+}
+
+void CheckpointWriter::begin(CheckpointSection section) {
+  uint8_t type = section;
+  this->crc = crc32c(0, &type, sizeof(type));
+  this->put_raw(&type, sizeof(type));
+}
+
+void CheckpointWriter::put_bytes(const void *data, size_t size) {
+  this->crc = crc32c(this->crc, data, size);
+  this->put_raw(data, size);
+}
+
+void CheckpointWriter::put_u32(uint32_t value) {
+  this->put_bytes(&value, sizeof(value));
+}
+
+void CheckpointWriter::put_varint(uint64_t value) {
+  uint8_t bytes[10];
+  size_t n = 0;
+  while (value >= 0x80) {
+    bytes[n++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  bytes[n++] = value;
+  this->put_bytes(bytes, n);
+}
+
+void CheckpointWriter::put_svarint(int64_t value) {
+  this->put_varint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+void CheckpointWriter::end() {
+  uint32_t sum = this->crc;
+  this->put_raw(&sum, sizeof(sum));
+}
+
+uint64_t CheckpointWriter::offset() const {
+  return (this->next_lba - this->start_lba) * this->lba_size + this->used;
+}
+
+uint64_t CheckpointWriter::written() const {
+  return (this->next_lba - this->start_lba) * this->lba_size;
+}
+
+bool CheckpointWriter::finish(uint64_t index) {
+  this->flush_buffer();
+  // The trailer gets a block of its own, so it is always the last one.
+  std::vector<char> block(this->lba_size, 0);
+  CheckpointTrailer trailer = {
+      .magic = CHECKPOINT_MAGIC, .crc = 0, .index = index};
+  trailer.crc = crc32c(0, &trailer, sizeof(trailer));
+  memcpy(block.data(), &trailer, sizeof(trailer));
+  this->put_raw(block.data(), block.size());
+  this->flush_buffer();
+  return !this->failed;
+}
+
+CheckpointReader::CheckpointReader(int fd, uint32_t nsid, uint16_t lba_size,
+                                   uint64_t mdts, uint64_t slba, uint64_t end,
+                                   uint32_t window) {
+  this->fd = fd;
+  this->nsid = nsid;
+  this->lba_size = lba_size;
+  this->mdts = mdts;
+  this->start_lba = slba;
+  this->next_lba = slba;
+  this->end_lba = end;
+  // By default enough to keep every recovery thread busy with one command.
+  if (window == 0) window = recovery_threads();
+  uint64_t chunk = std::max(mdts / lba_size, (uint64_t)1);
+  this->buffer = std::vector<char>(chunk * window * lba_size);
+  this->buffer_offset = 0;
+  this->pos = 0;
+  this->len = 0;
+  this->crc = 0;
+  this->failed = false;
+}
+
+bool CheckpointReader::fill() {
+  if (this->failed || this->next_lba >= this->end_lba) {
+    this->failed = true;
+    return false;
+  }
+  uint64_t nblocks = std::min(this->buffer.size() / this->lba_size,
+                              this->end_lba - this->next_lba);
+  this->buffer_offset = (this->next_lba - this->start_lba) * this->lba_size;
+  if (parallel_read(this->fd, this->nsid, this->next_lba, nblocks,
+                    this->lba_size, this->mdts, this->buffer.data()) != 0) {
+    this->failed = true;
+    return false;
+  }
+  this->next_lba += nblocks;
+  this->pos = 0;
+  this->len = nblocks * this->lba_size;
+  return true;
+}
+
+bool CheckpointReader::read_trailer(uint64_t *index) {
+  if (this->end_lba <= this->start_lba) return false;
+  std::vector<char> block(this->lba_size);
+  if (ss_nvme_read(this->fd, this->nsid, this->end_lba - 1, 0, 0, 0, 0, 0, 0,
+                   block.size(), block.data(), 0, nullptr) != 0) {
+    return false;
+  }
+  CheckpointTrailer trailer;
+  memcpy(&trailer, block.data(), sizeof(trailer));
+  uint32_t crc = trailer.crc;
+  trailer.crc = 0;
+  if (trailer.magic != CHECKPOINT_MAGIC ||
+      crc32c(0, &trailer, sizeof(trailer)) != crc) {
+    return false;
+  }
+  *index = trailer.index;
+  return *index < (this->end_lba - 1 - this->start_lba) * this->lba_size;
+}
+
+void CheckpointReader::seek(uint64_t offset) {
+  this->failed = false;
+  if (offset >= this->buffer_offset &&
+      offset < this->buffer_offset + this->len) {
+    this->pos = offset - this->buffer_offset;
+    return;
+  }
+  this->next_lba = this->start_lba + offset / this->lba_size;
+  this->pos = 0;
+  this->len = 0;
+  if (this->fill()) this->pos = offset % this->lba_size;
+}
+
+void CheckpointReader::get_raw(void *data, size_t size) {
+  char *bytes = (char *)data;
+  while (size > 0) {
+    if (this->pos == this->len && !this->fill()) {
+      memset(bytes, 0, size);
+      return;
+    }
+    size_t n = std::min(size, this->len - this->pos);
+    memcpy(bytes, this->buffer.data() + this->pos, n);
+    this->pos += n;
+    bytes += n;
+    size -= n;
+  }
+}
+
+bool CheckpointReader::begin(CheckpointSection section) {
+  uint8_t type;
+  this->get_raw(&type, sizeof(type));
+  this->crc = crc32c(0, &type, sizeof(type));
+  return this->ok() && type == section;
+}
+
+void CheckpointReader::get_bytes(void *data, size_t size) {
+  this->get_raw(data, size);
+  this->crc = crc32c(this->crc, data, size);
+}
+
+uint32_t CheckpointReader::get_u32() {
+  uint32_t value;
+  this->get_bytes(&value, sizeof(value));
+  return value;
+}
+
+uint64_t CheckpointReader::get_varint() {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte;
+    this->get_bytes(&byte, sizeof(byte));
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return value;
+  }
+  // Too long to be one of ours.
+  this->failed = true;
+  return 0;
+}
+
+int64_t CheckpointReader::get_svarint() {
+  uint64_t value = this->get_varint();
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+bool CheckpointReader::end() {
+  uint32_t expected = this->crc;
+  uint32_t sum;
+  this->get_raw(&sum, sizeof(sum));
+  if (sum != expected) this->failed = true;
+  return this->ok();
+}
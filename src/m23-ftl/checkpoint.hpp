@@ -0,0 +1,157 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_CHECKPOINT_H
+#define STOSYS_PROJECT_CHECKPOINT_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** Identifies a checkpoint, the first thing in the checkpoint zone */
+#define CHECKPOINT_MAGIC 0x504b4346
+
+/** Bumped whenever the layout of the checkpoint changes, older
+ * checkpoints are then ignored instead of misread. */
+#define CHECKPOINT_VERSION 3
+
+/** A checkpoint is a series of sections, each starting with its type and
+ * ending with the CRC32C of the type and the payload. Counts and
+ * addresses in the payload are LEB128 varints, differences that can be
+ * negative are zigzag encoded first. */
+enum CheckpointSection {
+  /** magic, version, journal sequence number, the zone geometry and
+   * the highest reserved block sequence number */
+  CKPT_HEADER = 1,
+  /** Per data zone a bitmap of the valid blocks */
+  CKPT_DATA_ZONES = 2,
+  /** Data map entries sorted by region */
+  CKPT_DATA_MAP = 3,
+  /** Reset count of every zone */
+  CKPT_WEAR = 4,
+  /** Extents of the log map for the LBAs of a single region, so that a
+   * region can be loaded on its own. One section per mapped region. */
+  CKPT_REGION = 5,
+  /** Offset of every CKPT_REGION section, sorted by region */
+  CKPT_INDEX = 6
+};
+
+/** Last block of a checkpoint, it points to the CKPT_INDEX section. */
+struct CheckpointTrailer {
+  uint32_t magic;
+  /** CRC32C of the trailer with this field set to zero */
+  uint32_t crc;
+  uint64_t index;
+};
+
+/** Streams a checkpoint to a zone in MDTS sized writes, so only a single
+ * write buffer is needed no matter how large the maps are. */
+class CheckpointWriter {
+ public:
+  /** Write at most nblocks starting at slba, the zone must be empty. */
+  CheckpointWriter(int fd, uint32_t nsid, uint16_t lba_size, uint64_t mdts,
+                   uint64_t slba, uint64_t nblocks);
+
+  void begin(CheckpointSection section);
+  void put_u32(uint32_t value);
+  void put_varint(uint64_t value);
+  void put_svarint(int64_t value);
+  void put_bytes(const void *data, size_t size);
+  /** Close the section by appending its CRC */
+  void end();
+
+  /** Bytes written so far, where the next section will start */
+  uint64_t offset() const;
+
+  /** Bytes written to the device so far, in whole blocks */
+  uint64_t written() const;
+
+  /** Write out the last partial chunk and the trailer pointing to the
+   * index section at offset index. Returns false if any write failed or
+   * the checkpoint did not fit. */
+  bool finish(uint64_t index);
+
+ private:
+  void put_raw(const void *data, size_t size);
+  void flush_buffer();
+
+  int fd;
+  uint32_t nsid;
+  uint16_t lba_size;
+  uint64_t start_lba;
+  uint64_t next_lba;
+  uint64_t end_lba;
+  std::vector<char> buffer;
+  size_t used;
+  uint32_t crc;
+  bool failed;
+};
+
+/** Reads back what CheckpointWriter wrote. The zone is read in windows
+ * of MDTS sized commands issued in parallel. A reader that ran into an
+ * error returns zeroes from then on and ok() is false. */
+class CheckpointReader {
+ public:
+  /** Read the checkpoint from slba up to, but not including, end. Every
+   * read fills window MDTS sized chunks, 0 for one per recovery thread. */
+  CheckpointReader(int fd, uint32_t nsid, uint16_t lba_size, uint64_t mdts,
+                   uint64_t slba, uint64_t end, uint32_t window = 0);
+
+  /** Get the offset of the index section from the trailer. */
+  bool read_trailer(uint64_t *index);
+
+  /** Continue reading at offset bytes from the start of the checkpoint,
+   * forgetting about any earlier error. */
+  void seek(uint64_t offset);
+
+  /** Start the next section, false if it is of another type. */
+  bool begin(CheckpointSection section);
+  uint32_t get_u32();
+  uint64_t get_varint();
+  int64_t get_svarint();
+  void get_bytes(void *data, size_t size);
+  /** Check the CRC of the section */
+  bool end();
+
+  bool ok() const { return !this->failed; }
+
+ private:
+  void get_raw(void *data, size_t size);
+  bool fill();
+
+  int fd;
+  uint32_t nsid;
+  uint16_t lba_size;
+  uint64_t mdts;
+  uint64_t start_lba;
+  uint64_t next_lba;
+  uint64_t end_lba;
+  std::vector<char> buffer;
+  /** Offset in the checkpoint of the first byte in buffer */
+  uint64_t buffer_offset;
+  size_t pos;
+  size_t len;
+  uint32_t crc;
+  bool failed;
+};
+
+#endif
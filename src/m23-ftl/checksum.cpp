@@ -0,0 +1,127 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "checksum.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "../common/crc32c.h"
+#include "../common/memstat.h"
+#include "znsblock.hpp"
+
+/** Set in an in-memory checksum of a block that has one */
+#define CHECKSUM_KNOWN (1ULL << 32)
+
+BlockChecksums::BlockChecksums() {
+  this->in_meta = false;
+  this->on = false;
+  this->lba_size = 0;
+  this->meta_size = 0;
+}
+
+BlockChecksums::BlockChecksums(const BlockChecksums &other) {
+  *this = other;
+}
+
+BlockChecksums &BlockChecksums::operator=(const BlockChecksums &other) {
+  if (this == &other) return *this;
+  this->in_meta = other.in_meta;
+  this->on = other.on;
+  this->lba_size = other.lba_size;
+  this->meta_size = other.meta_size;
+  this->sums = std::vector<std::atomic<uint64_t>>(other.sums.size());
+  for (uint64_t i = 0; i < other.sums.size(); i++) {
+    this->sums[i].store(other.sums[i].load());
+  }
+  return *this;
+}
+
+void BlockChecksums::enable(uint64_t capacity, uint16_t lba_size,
+                            uint16_t meta_size) {
+  this->on = true;
+  this->lba_size = lba_size;
+  this->meta_size = meta_size;
+  this->in_meta = meta_size >= sizeof(BlockMeta) + sizeof(BlockChecksum);
+  if (!this->in_meta) {
+    this->sums = std::vector<std::atomic<uint64_t>>(capacity);
+    for (std::atomic<uint64_t> &sum : this->sums) sum.store(0);
+  }
+}
+
+void BlockChecksums::store(const void *data, uint64_t index, uint64_t count,
+                           void *meta) {
+  if (!this->on) return;
+  std::vector<uint32_t> crcs(count);
+  crc32c_blocks(data, this->lba_size, count, crcs.data());
+  for (uint64_t i = 0; i < count; i++) {
+    if (this->in_meta) {
+      BlockChecksum checksum = {.crc = crcs[i], .magic = CHECKSUM_MAGIC};
+      memcpy((char *)meta + i * this->meta_size + sizeof(BlockMeta),
+             &checksum, sizeof(checksum));
+    } else {
+      this->sums[index + i].store(CHECKSUM_KNOWN | crcs[i]);
+    }
+  }
+}
+
+void BlockChecksums::forget(uint64_t index) {
+  if (this->on && !this->in_meta) this->sums[index].store(0);
+}
+
+void BlockChecksums::carry(uint64_t index, const BlockChecksums &from,
+                           uint64_t from_index) {
+  if (!this->on || this->in_meta) return;
+  this->sums[index].store(from.sums[from_index].load());
+}
+
+uint64_t BlockChecksums::verify(const void *data, uint64_t index,
+                                uint64_t count, const void *meta) const {
+  if (!this->on) return count;
+  std::vector<uint32_t> crcs(count);
+  crc32c_blocks(data, this->lba_size, count, crcs.data());
+  for (uint64_t i = 0; i < count; i++) {
+    if (this->in_meta) {
+      BlockChecksum checksum;
+      memcpy(&checksum,
+             (const char *)meta + i * this->meta_size + sizeof(BlockMeta),
+             sizeof(checksum));
+      if (checksum.magic == CHECKSUM_MAGIC && checksum.crc != crcs[i]) {
+        return i;
+      }
+    } else {
+      uint64_t sum = this->sums[index + i].load();
+      if ((sum & CHECKSUM_KNOWN) && (uint32_t)sum != crcs[i]) return i;
+    }
+  }
+  return count;
+}
+
+void BlockChecksums::clear() {
+  if (this->on && !this->in_meta) {
+    for (std::atomic<uint64_t> &sum : this->sums) sum.store(0);
+  }
+}
+
+uint64_t BlockChecksums::memory_bytes() const {
+  return vector_bytes(this->sums);
+}
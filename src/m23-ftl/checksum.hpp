@@ -0,0 +1,92 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_CHECKSUM_H
+#define STOSYS_PROJECT_CHECKSUM_H
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/** Marks a BlockChecksum that holds a checksum */
+#define CHECKSUM_MAGIC 0x4d555343
+
+/** Follows the BlockMeta in the metadata of a block, when checksums are
+ * on and the LBA format has room for it. */
+struct BlockChecksum {
+  uint32_t crc;
+  /** CHECKSUM_MAGIC, or zero for a block that has no checksum */
+  uint32_t magic;
+};
+
+/** The CRC32C of the data of every block in a zone. They are kept in the
+ * metadata of the blocks if there is room, so they are persistent and
+ * copies take them along for free. Otherwise they are kept in memory,
+ * and blocks written before a restart are not checked. The ones in
+ * memory are atomic, host writes and GC copies store them while reads
+ * verify them without a lock. */
+class BlockChecksums {
+ public:
+  BlockChecksums();
+  BlockChecksums(const BlockChecksums &other);
+  BlockChecksums &operator=(const BlockChecksums &other);
+
+  /** Start checksumming the blocks of a zone */
+  void enable(uint64_t capacity, uint16_t lba_size, uint16_t meta_size);
+
+  bool enabled() const { return this->on; }
+
+  /** Checksum count blocks of data written at index in the zone. meta
+   * holds the metadata of the blocks when there is room in it. */
+  void store(const void *data, uint64_t index, uint64_t count, void *meta);
+
+  /** The block at index was written partially and has no checksum. */
+  void forget(uint64_t index);
+
+  /** A copy of the block from_index of another zone is written to index.
+   * With checksums in the metadata they come along with it already. */
+  void carry(uint64_t index, const BlockChecksums &from, uint64_t from_index);
+
+  /** Check count blocks of data read from index. Returns the number of
+   * the first block that does not match, or count if they all do. */
+  uint64_t verify(const void *data, uint64_t index, uint64_t count,
+                  const void *meta) const;
+
+  /** Forget all checksums, the zone was reset. */
+  void clear();
+
+  /** Heap bytes of the checksums kept in memory */
+  uint64_t memory_bytes() const;
+
+  /** Whether the checksums are in the metadata of the blocks */
+  bool in_meta;
+
+ private:
+  bool on;
+  uint16_t lba_size;
+  uint16_t meta_size;
+  /** Used when the checksums are not in the metadata. The CRC of a
+   * block with CHECKSUM_KNOWN set, or zero for a block without one. */
+  std::vector<std::atomic<uint64_t>> sums;
+};
+
+#endif
@@ -23,6 +23,7 @@ SOFTWARE.
 
 #include <cstdint>
 
+#include "../common/utils.h"
 #include "libnvme.h"
 
 ZNSDataZone::ZNSDataZone(const int zns_fd, const uint32_t nsid,
@@ -44,6 +45,11 @@ ZNSDataZone::ZNSDataZone(const int zns_fd, const uint32_t nsid,
   this->slba = slba;
   this->lba_size = lba_size;
   this->mdts_size = mdts_size;
+  this->reset_count = 0;
+  this->last_write = 0;
+  this->hot = false;
+  this->region = UINT64_MAX;
+  this->meta_size = 0;
 
   this->block_map = std::vector<int>();
   for (uint16_t i = 0; i < this->capacity; i++) {
@@ -79,6 +85,8 @@ int ZNSDataZone::get_index() {
 int ZNSDataZone::reset() {
   int ret = this->reset_zone();
   this->position = this->base;
+  this->last_write = 0;
+  this->hot = false;
 
   // Remove all blocks from the memory of this zone
   for (uint16_t i = 0; i < this->capacity; i++) {
@@ -122,6 +130,8 @@ int ZNSDataZone::finish_zone(void) const {
 int ZNSDataZone::reset_zone(void) {
   int ret = send_management_command(NVME_ZNS_ZSA_RESET);
   this->position = this->slba;
+  this->reset_count++;
+  this->checksums.clear();
   return ret;
 }
 
@@ -146,7 +156,8 @@ int ZNSDataZone::ss_sequential_write(const void *buffer,
   uint64_t i;
   uint64_t data_len = max_nlb_per_round * this->lba_size;
   void *buffer_ptr;
-  for (i = 0; i < total_nlb; i += max_nlb_per_round) {
+  // Whole rounds first, only as many as fit in total_nlb.
+  for (i = 0; i + max_nlb_per_round <= total_nlb; i += max_nlb_per_round) {
     buffer_ptr = (void *)((uint64_t)buffer + i * this->lba_size);
     int ret = ss_nvme_write(this->zns_fd, this->nsid, this->position,
                             max_nlb_per_round - 1, 0, 0, 0, 0, 0, 0, data_len,
@@ -156,9 +167,9 @@ int ZNSDataZone::ss_sequential_write(const void *buffer,
     }
     this->position += max_nlb_per_round;
   }
-  if (i > total_nlb) {
+  if (i < total_nlb) {
     // write remaining blocks.
-    uint64_t ream_blocks = (total_nlb - (i - max_nlb_per_round));
+    uint64_t ream_blocks = total_nlb - i;
     buffer_ptr = (void *)((uint64_t)buffer + i * this->lba_size);
     data_len = ream_blocks * this->lba_size;
     int ret =
@@ -191,7 +202,8 @@ int ZNSDataZone::invalidate_block(uint16_t index) {
 
 // used for data zone, should be merged in the future.
 // return true if there's no data conflicts else false.
-bool ZNSDataZone::write_until(void *buffer, uint32_t size, uint32_t index) {
+bool ZNSDataZone::write_until(void *buffer, uint32_t size, uint32_t index,
+                              const void *meta) {
   // index must ok, because these data are mod by zcap.
   // size is the multiple of lba_size.
   uint64_t curr_wp = this->position - this->base;
@@ -211,13 +223,17 @@ bool ZNSDataZone::write_until(void *buffer, uint32_t size, uint32_t index) {
     this->position += num_blocks_until;
   }
 
+  // Zeroed padding has a zero seq, so it is skipped when scanning.
+  if (this->meta_size == 0) meta = nullptr;
   int write_t = ss_nvme_write(this->zns_fd, this->nsid, this->position, 0, 0, 0,
-                              0, 0, 0, 0, size, buffer, 0, nullptr);
+                              0, 0, 0, 0, size, buffer,
+                              meta ? this->meta_size : 0, (void *)meta);
   this->block_map[this->position - this->base] = 1;
   if (write_t != 0) {
     return false;
   }
   this->position += 1;
+  this->last_write = monotonic_microseconds();
   return true;
 }
 
@@ -233,7 +249,7 @@ bool ZNSDataZone::can_write(uint32_t index) {
 }
 
 uint32_t ZNSDataZone::read(const uint64_t pa, const void *buffer, uint32_t size,
-                           uint32_t *read_size) {
+                           uint32_t *read_size, void *meta, bool verify) {
   if (pa + size / this->lba_size > this->base + this->capacity) {
     // cross boundary read.
     size = (this->base + this->capacity - pa) * this->lba_size;
@@ -241,13 +257,28 @@ uint32_t ZNSDataZone::read(const uint64_t pa, const void *buffer, uint32_t size,
   uint32_t nlb = size / this->lba_size;
   *read_size = size;
 
-  int read_ret =
-      ss_nvme_read(this->zns_fd, this->nsid, pa, nlb - 1, 0, 0, 0, 0, 0,
-                   nlb * this->lba_size, (void *)buffer, 0, nullptr);
+  if (this->meta_size == 0) meta = nullptr;
+  verify &= this->checksums.enabled() && nlb > 0;
+  std::vector<char> own_meta;
+  if (verify && meta == nullptr && this->checksums.in_meta) {
+    own_meta.resize(nlb * this->meta_size);
+    meta = own_meta.data();
+  }
+  int read_ret = ss_nvme_read(this->zns_fd, this->nsid, pa, nlb - 1, 0, 0, 0,
+                              0, 0, nlb * this->lba_size, (void *)buffer,
+                              meta ? nlb * this->meta_size : 0, meta);
   if (read_ret != 0) {
     return read_ret;
   }
 
+  if (verify) {
+    uint64_t bad = this->checksums.verify(buffer, pa - this->base, nlb, meta);
+    if (bad != nlb) {
+      std::cerr << "Error: checksum mismatch at block " << pa + bad
+                << " of zone " << this->zone_id << std::endl;
+      return -EIO;
+    }
+  }
   return 0;
 }
 
@@ -275,6 +306,7 @@ uint32_t ZNSDataZone::write_nounce(const void *buffer, uint32_t size,
     int ret = ss_sequential_write(buffer, max_nlb_per_round, total_nlb);
     if (ret != 0) return ret;
   }
+  this->last_write = monotonic_microseconds();
 
   return 0;
 }
@@ -309,6 +341,7 @@ uint32_t ZNSDataZone::write(const void *buffer, uint32_t size,
   for (uint16_t i = init_index; i < this->position - this->base; i++) {
     this->block_map[i] = 1;
   }
+  this->last_write = monotonic_microseconds();
 
   return 0;
 }
@@ -35,6 +35,7 @@ SOFTWARE.
 #include <vector>
 
 #include "../common/nvmewrappers.h"
+#include "checksum.hpp"
 #include "znsblock.hpp"
 #include "zone.hpp"
 
@@ -69,9 +70,11 @@ class ZNSDataZone {
   /** Calculates the current capacity of the block. */
   uint32_t get_current_capacity() const;
 
-  /** Gets a block from the zone based on the block id. */
+  /** Gets a block from the zone based on the block id. With verify,
+   * returns -EIO if the data does not match its checksum. */
   uint32_t read(const uint64_t lba, const void *buffer, uint32_t size,
-                uint32_t *read_size);
+                uint32_t *read_size, void *meta = nullptr,
+                bool verify = false);
 
   uint32_t write(const void *buffer, uint32_t size, uint32_t *write_size);
 
@@ -96,7 +99,10 @@ class ZNSDataZone {
                                                    const uint64_t lba_size,
                                                    const uint64_t mdts_size);
 
-  bool write_until(void *buffer, uint32_t size, uint32_t index);
+  /** Write a single block at index, padding the gap with zeroes. meta is
+   * the metadata of the block as read from its previous location. */
+  bool write_until(void *buffer, uint32_t size, uint32_t index,
+                   const void *meta = nullptr);
 
   /** Returns the number of blocks which are still valid */
   uint64_t get_alive_capacity() const;
@@ -117,6 +123,19 @@ class ZNSDataZone {
   /** Write pointer */
   uint64_t position;
 
+  /** Number of times the zone has been reset, persisted by FTL::backup */
+  uint32_t reset_count;
+
+  /** monotonic_microseconds of the last write, 0 if empty */
+  uint64_t last_write;
+
+  /** Whether the GC filled the zone from the hot log stream */
+  bool hot;
+
+  /** Region the data map points to this zone for, UINT64_MAX if none.
+   * Kept up to date by the FTL under the data map lock. */
+  uint64_t region;
+
   /** Zone Logical Block Address or the lowest addressable point */
   uint64_t base;
 
@@ -126,6 +145,13 @@ class ZNSDataZone {
   /** Maximum transfer size */
   uint64_t mdts_size;
 
+  /** Bytes of metadata per block, 0 if we do not store BlockMeta */
+  uint16_t meta_size;
+
+  /** Checksums of the blocks, only used in checksum mode. write_until
+   * leaves them to the metadata or to BlockChecksums::carry. */
+  BlockChecksums checksums;
+
   /** Map of the physical addresses to the buffer and state */
   std::vector<int> block_map;
 
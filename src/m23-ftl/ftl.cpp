@@ -34,16 +34,22 @@ SOFTWARE.
 #include <cstring>
 #include <vector>
 
+#include "../common/lockstat.h"
+#include "../common/nvmewrappers.h"
+#include "../common/probes.h"
+#include "../common/trace.h"
+#include "../common/utils.h"
+#include "checkpoint.hpp"
 #include "datazone.hpp"
 #include "ftlgc.hpp"
 #include "logzone.hpp"
+#include "recovery.hpp"
 #include "znsblock.hpp"
 #include "zone.hpp"
 
 void create_zones(const int zns_fd, const uint32_t nsid,
                   const uint64_t lba_size, const uint64_t mdts_size,
                   const uint16_t logs, std::vector<ZNSLogZone> *log_zones,
-                  std::vector<ZNSDataZone> *rerv_zones,
                   std::vector<ZNSDataZone> *data_zones,
                   const bool force_reset) {
   // TODO(valentijn): don't hard code this please
@@ -93,8 +99,7 @@ void create_zones(const int zns_fd, const uint32_t nsid,
   *log_zones = zones;
 
   std::vector<ZNSDataZone> temp_data_zones = std::vector<ZNSDataZone>();
-  std::vector<ZNSDataZone> temp_rerved_zones = std::vector<ZNSDataZone>();
-  for (; i < zns_report->nr_zones - 1; i++) {
+  for (; i < zns_report->nr_zones - FTL_META_ZONES; i++) {
     struct nvme_zns_desc current = zns_report->entries[i];
 
     const enum ZoneZNSType ztype = static_cast<ZoneZNSType>(current.zt);
@@ -129,147 +134,147 @@ void create_zones(const int zns_fd, const uint32_t nsid,
   free(zns_report);
 }
 
-FTL::FTL(int fd, uint64_t mdts, uint32_t nsid, uint16_t lba_size, int gc_wmark,
-         int log_zones, bool force_reset) {
+FTL::FTL(int fd, uint64_t mdts, uint32_t nsid, uint16_t lba_size,
+         uint16_t meta_size, const struct zdev_init_params *params) {
+  const int log_zones = params->log_zones;
+  // Inspecting a device never wipes it.
+  const bool force_reset = params->force_reset && !params->read_only;
   this->fd = fd;
+  this->read_only = params->read_only;
+  this->open_error = 0;
+  this->mori = nullptr;
   this->mdts_size = mdts;
   this->nsid = nsid;
   this->lba_size = lba_size;
-  this->gc_wmark = gc_wmark;
+  this->gc_wmark = params->gc_wmark;
   this->log_zones = log_zones;
+  this->gc_mode = params->gc_mode;
+  this->gc_soft_wmark = this->gc_wmark + std::max(1, log_zones / 4);
+  this->last_host_io = 0;
+  this->writers_waiting = 0;
+  this->reads_inflight = 0;
+  this->gc_reclaim_rate = 0;
+  uint64_t gc_rate_mbps =
+      params->gc_rate_mbps ? params->gc_rate_mbps : GC_DEFAULT_RATE_MBPS;
+  this->gc_bucket = new TokenBucket(gc_rate_mbps << 20, mdts);
+  this->write_bucket = new TokenBucket(0, mdts);
+  this->hot_cold = params->hot_cold;
+  this->heat = nullptr;
+  this->merges_since_decay = 0;
+  this->meta_size = meta_size;
+  // Raised to what the checkpoint and the journal reserved on restart.
+  this->block_seq = 1;
+  this->block_seq_limit = 1;
+  this->block_seq_reserved = 1;
+  this->seq_lock = PTHREAD_MUTEX_INITIALIZER;
   this->log_map = Ftlmap{.lock = PTHREAD_RWLOCK_INITIALIZER, .map = raw_map()};
   this->data_map = Ftlmap{.lock = PTHREAD_RWLOCK_INITIALIZER, .map = raw_map()};
   this->zone_lock = PTHREAD_RWLOCK_INITIALIZER;
-  this->init_code = 2333;
   this->force_reset = force_reset;
 
-  this->zones_reserved = std::vector<ZNSDataZone>();
+  this->zones_reserved = std::vector<ZNSDataZone *>();
   this->zones_data = std::vector<ZNSDataZone>();
   this->zones_log = std::vector<ZNSLogZone>();
 
   create_zones(fd, nsid, lba_size, mdts_size, log_zones, &zones_log,
-               &zones_reserved, &zones_data, force_reset);
+               &zones_data, force_reset);
   this->zcap = zones_log.at(0).capacity;
+  this->data_zone_readers =
+      std::vector<std::atomic<uint32_t>>(this->zones_data.size());
+  this->journal = new MetaJournal(
+      fd, nsid, lba_size, mdts, zcap * (zones_log.size() + zones_data.size()),
+      zcap, FTL_JOURNAL_ZONES);
+  this->checkpoint_lock = PTHREAD_MUTEX_INITIALIZER;
+  this->checkpoint_wake_lock = PTHREAD_MUTEX_INITIALIZER;
+  this->checkpoint_wake = PTHREAD_COND_INITIALIZER;
+  this->checkpoint_requested = false;
+  this->checkpointer_exit = false;
+  this->checkpoint_zone = 0;
+  this->checkpoint_generation = 0;
+  this->foreign_log_zones = 0;
+  this->restore_lock = PTHREAD_MUTEX_INITIALIZER;
+  this->restore_pending = false;
+  this->flush_lock = PTHREAD_MUTEX_INITIALIZER;
+  this->flush_done = PTHREAD_COND_INITIALIZER;
+  this->flushing = false;
+  for (ZNSLogZone &zone : this->zones_log) zone.meta_size = meta_size;
+  for (ZNSDataZone &zone : this->zones_data) zone.meta_size = meta_size;
+  if (params->checksums) {
+    for (ZNSLogZone &zone : this->zones_log) {
+      zone.checksums.enable(zone.capacity, lba_size, meta_size);
+    }
+    for (ZNSDataZone &zone : this->zones_data) {
+      zone.checksums.enable(zone.capacity, lba_size, meta_size);
+    }
+  }
+  // Consider a chunk hot if it keeps being overwritten within roughly
+  // the time it takes to fill a single log zone.
+  if (this->hot_cold) this->heat = new HeatTracker(this->zcap);
 
   if (!force_reset) {
     std::cout << "FTL restart" << std::endl;
-    uint64_t last_zone_addr =
-        zcap * (this->zones_log.size() + this->zones_data.size());
-    char meta_block[lba_size];
-    int ret =
-        ss_nvme_read_wrapper(fd, nsid, last_zone_addr, 0, lba_size, meta_block);
-    assert(ret == 0);
-
-    uint64_t init_code_disk;
-    memcpy(&init_code_disk, meta_block, sizeof(uint64_t));
-    // printf("init code is %ld, current is %ld\n", init_code_disk,
-    // this->init_code);
-    if (init_code_disk == this->init_code) {
-      // restore the previous status of ftl.
-      std::cout << "restore from the previous status." << std::endl;
-      uint64_t buf_size;
-      memcpy(&buf_size, meta_block + sizeof(uint64_t), sizeof(uint64_t));
-      char meta_buffer[buf_size];
-      uint16_t nlb = buf_size / lba_size;
-      int ret = ss_nvme_read_wrapper(fd, nsid, last_zone_addr, nlb, buf_size,
-                                     meta_buffer);
-      assert(ret == 0);
-
-      uint64_t lzone_buf_size;
-      uint64_t dzone_buf_size;
-      uint64_t lmap_buf_size;
-      uint64_t dmap_buf_size;
-      memcpy(&lzone_buf_size, meta_buffer + 2 * sizeof(uint64_t),
-             sizeof(uint64_t));
-      memcpy(&dzone_buf_size, meta_buffer + 3 * sizeof(uint64_t),
-             sizeof(uint64_t));
-      memcpy(&lmap_buf_size, meta_buffer + 4 * sizeof(uint64_t),
-             sizeof(uint64_t));
-      memcpy(&dmap_buf_size, meta_buffer + 5 * sizeof(uint64_t),
-             sizeof(uint64_t));
-      uint16_t buffer_index = sizeof(uint64_t) * 6;
-      // restore lzone.
-      // restore lzone pas.
-      std::vector<uint64_t> pas;
-      for (uint16_t i = 0; i < this->zones_log.size(); i++) {
-        uint64_t num;
-        memcpy(&num, meta_buffer + buffer_index, sizeof(uint64_t));
-        if (num == 0) {
-          buffer_index += sizeof(uint64_t);
-          continue;
-        }
-        buffer_index += sizeof(uint64_t);
-
-        uint64_t lbas[num];
-        ZNSBlock blocks[num];
-        memcpy(&lbas, meta_buffer + buffer_index, sizeof(uint64_t) * num);
-        buffer_index += sizeof(uint64_t) * num;
-        memcpy(&blocks, meta_buffer + buffer_index, sizeof(ZNSBlock) * num);
-        buffer_index += sizeof(ZNSBlock) * num;
-
-        // printf("\n");
-        for (uint64_t j = 0; j < num; j++) {
-          this->zones_log[i].block_map.map[lbas[j]] = blocks[j];
-          // printf("zone %d lab %lx -> %lx valid: %d \n", i, lbas[j],
-          // blocks[j].logical_address, blocks[j].valid);
-        }
-
-        // printf("\n");
-      }
-
-      // restore dzone.
-      for (uint16_t i = 0; i < this->zones_data.size(); i++) {
-        int dzone_buf[this->zcap];
-        memcpy(dzone_buf, meta_buffer + buffer_index, sizeof(int) * this->zcap);
-        this->zones_data[i].block_map.assign(dzone_buf, dzone_buf + this->zcap);
-        buffer_index += this->zcap * sizeof(int);
-      }
+    uint64_t ckpt_seq = 0;
+    bool restored = this->restore_checkpoint(
+        &ckpt_seq,
+        params->lazy_restore && !params->media_scan && !this->read_only);
+
+    // Everything that changed since the checkpoint is in the journal.
+    uint64_t replayed = 0;
+    if (!restored && this->foreign_log_zones != 0) {
+      // Opened with the wrong number of log zones, reading or writing
+      // anything would take data zones for log zones and vice versa.
+      std::cout << "the checkpoint is for " << this->foreign_log_zones
+                << " log zones, not " << log_zones << "." << std::endl;
+      this->open_error = -EINVAL;
+    } else {
+      replayed =
+          this->journal->replay(ckpt_seq, [this](const JournalEntry &entry) {
+            this->replay_entry(entry);
+          });
+    }
 
-      // restore lmap.
-      uint64_t lmap_num = lmap_buf_size / (sizeof(uint64_t) + sizeof(Addr));
-      for (uint64_t i = 0; i < lmap_num; i++) {
-        uint64_t lba;
-        Addr pa;
-        memcpy(&lba, meta_buffer + buffer_index, sizeof(uint64_t));
-        buffer_index += sizeof(uint64_t);
-        memcpy(&pa, meta_buffer + buffer_index, sizeof(Addr));
-        buffer_index += sizeof(Addr);
-        this->log_map.map[lba] = pa;
-        printf("LBA %d -> %d %d\n", lba, pa.addr, pa.zone_num);
+    if (this->open_error != 0) {
+      // Nothing to restore.
+    } else if (this->read_only) {
+      // Whatever the checkpoint and the journal have is all we show.
+      this->drop_empty_zones();
+    } else if (meta_size != 0 &&
+               (params->media_scan || (!restored && !replayed))) {
+      // The media knows better, start over from a fresh checkpoint so the
+      // journal can never be replayed on top of the rebuilt maps.
+      std::cout << "rebuild from the block metadata." << std::endl;
+      this->rebuild_from_media();
+      pthread_mutex_lock(&this->checkpoint_lock);
+      if (!this->write_checkpoint()) {
+        // The zones that lost a region may still be needed by the next
+        // rebuild, so they stay as they are.
+        this->unreset_data_zones.clear();
       }
-
-      // restore dmap.
-      if (dmap_buf_size) {
-        // printf("data map:\n");
-        uint64_t dmap_num = dmap_buf_size / (sizeof(uint64_t) + sizeof(Addr));
-        for (uint64_t i = 0; i < dmap_num; i++) {
-          uint64_t lba;
-          Addr pa;
-          memcpy(&lba, meta_buffer + buffer_index, sizeof(uint64_t));
-          buffer_index += sizeof(uint64_t);
-          memcpy(&pa, meta_buffer + buffer_index, sizeof(Addr));
-          buffer_index += sizeof(Addr);
-          this->data_map.map[lba] = pa;
-        }
+      pthread_mutex_unlock(&this->checkpoint_lock);
+    } else {
+      this->drop_empty_zones();
+    }
+    if (this->restore_pending) {
+      // Regions loaded later skip these zones, like drop_empty_zones did.
+      for (ZNSLogZone &zone : this->zones_log) {
+        this->empty_log_zones.push_back(zone.get_wp() == zone.base);
+        // Faults add to the block maps while writers use them.
+        zone.block_map.map.reserve(this->zcap);
       }
-      printf("meta data size is %d, slba is %lx, init code is %d\n", buf_size,
-             last_zone_addr, init_code);
-
-      ss_device_zone_reset(fd, nsid, last_zone_addr);
     }
+  } else {
+    this->journal->clear();
+  }
+  // The data map is only changed through insert_datamap from here on.
+  for (auto &entry : this->data_map.map) {
+    this->zones_data[entry.second.zone_num].region = entry.first;
   }
   // zones_log.at(0).reset_all_zones();
-  // Start our reaper rapper and store her as a void pointer in our FTL
   this->need_gc = PTHREAD_COND_INITIALIZER;
   this->need_gc_lock = PTHREAD_MUTEX_INITIALIZER;
   this->clean_finish = PTHREAD_COND_INITIALIZER;
   this->clean_finish_lock = PTHREAD_MUTEX_INITIALIZER;
 
-  Calliope *mori = new Calliope(this, &this->need_gc, &this->need_gc_lock,
-                                &this->clean_finish, &this->clean_finish_lock);
-  mori->initialize();
-  this->mori = mori;
-
   // Setup the free zone logs
   this->zones_lock = PTHREAD_RWLOCK_INITIALIZER;
 
@@ -281,67 +286,270 @@ FTL::FTL(int fd, uint64_t mdts, uint32_t nsid, uint16_t lba_size, int gc_wmark,
       this->free_log_zones.push_back(&this->zones_log[i]);
     }
   }
+  this->open_log_zones = std::vector<ZNSLogZone *>(LOG_STREAMS, nullptr);
 
   for (size_t i = 0; i < this->zones_data.size(); i++) {
     if (!this->zones_data[i].is_full()) {
       this->free_data_zones.push_back(&this->zones_data[i]);
     }
   }
+
+  // The reserved zones are not persisted, any empty zone will do since
+  // the capacity we expose guarantees there are enough of them.
+  this->refill_reserved_zones();
+
+  // Whatever made it to the device before we started is as durable as
+  // it will ever be.
+  this->durable_seq = this->journal->last_seq();
+  // The first write reserves a range above anything a previous run used.
+  this->block_seq_limit = this->block_seq.load();
+  this->block_seq_reserved = this->block_seq.load();
+
+  // Nothing may change the device behind the back of an inspection.
+  if (this->open_error != 0 || this->read_only) return;
+  if (this->restore_pending) {
+    this->restore_thread = std::thread(&FTL::finish_restore, this);
+  }
+  // Start our reaper rapper and store her as a void pointer in our FTL.
+  // Last, as she may pick a victim right away and needs all of the above.
+  Calliope *mori = new Calliope(this, &this->need_gc, &this->need_gc_lock,
+                                &this->clean_finish, &this->clean_finish_lock);
+  this->mori = mori;
+  mori->initialize();
+  this->checkpoint_thread = std::thread(&FTL::checkpointer, this);
 }
 
-ZNSLogZone *FTL::get_free_log_zone() {
-  return this->free_log_zones.empty() ? nullptr : this->free_log_zones.front();
+ZNSLogZone *FTL::get_free_log_zone(int stream) {
+  profiled_wrlock(&this->zones_lock, LOCK_ZONES);
+  ZNSLogZone *zone = this->open_log_zones[stream];
+  if (zone != nullptr && !zone->is_full()) {
+    profiled_unlock(&this->zones_lock, LOCK_ZONES);
+    return zone;
+  }
+
+  // Prefer a zone that no other stream is appending to, so that the
+  // streams do not get mixed again. If there is none we rather share
+  // than wait for the GC. Among the untaken zones we first finish the
+  // ones that were already written to, and otherwise open the least
+  // worn one.
+  zone = nullptr;
+  ZNSLogZone *shared = nullptr;
+  for (ZNSLogZone *candidate : this->free_log_zones) {
+    if (candidate->is_full()) continue;
+    bool taken = std::find(this->open_log_zones.begin(),
+                           this->open_log_zones.end(),
+                           candidate) != this->open_log_zones.end();
+    if (taken) {
+      if (shared == nullptr) shared = candidate;
+      continue;
+    }
+    if (zone == nullptr) {
+      zone = candidate;
+      continue;
+    }
+    bool zone_empty = zone->get_wp() == zone->base;
+    bool candidate_empty = candidate->get_wp() == candidate->base;
+    if (zone_empty != candidate_empty) {
+      if (zone_empty) zone = candidate;
+    } else if (candidate->reset_count < zone->reset_count) {
+      zone = candidate;
+    }
+  }
+  if (zone == nullptr) zone = shared;
+  this->open_log_zones[stream] = zone;
+  if (zone != nullptr && zone->get_wp() == zone->base) zone->stream = stream;
+  profiled_unlock(&this->zones_lock, LOCK_ZONES);
+  return zone;
+}
+
+void FTL::retire_log_zone(ZNSLogZone *zone) {
+  profiled_wrlock(&this->zones_lock, LOCK_ZONES);
+  // The GC may have reset the zone and handed it out again in the
+  // meantime, only a zone that is still open and full is retired.
+  bool open = std::find(this->open_log_zones.begin(),
+                        this->open_log_zones.end(),
+                        zone) != this->open_log_zones.end();
+  if (!open || zone->get_current_capacity() > 0) {
+    profiled_unlock(&this->zones_lock, LOCK_ZONES);
+    return;
+  }
+  auto found =
+      std::find(this->free_log_zones.begin(), this->free_log_zones.end(), zone);
+  if (found != this->free_log_zones.end()) this->free_log_zones.erase(found);
+  for (ZNSLogZone *&open : this->open_log_zones) {
+    if (open == zone) open = nullptr;
+  }
+  profiled_unlock(&this->zones_lock, LOCK_ZONES);
+}
+
+int FTL::classify_write(uint64_t lba, uint32_t size, int hint) {
+  // The application knows best, so hints overrule our own guesses.
+  switch (hint) {
+    case ZNS_WLTH_SHORT:
+      return LOG_STREAM_SHORT;
+    case ZNS_WLTH_MEDIUM:
+      return LOG_STREAM_MEDIUM;
+    case ZNS_WLTH_LONG:
+      return LOG_STREAM_LONG;
+    case ZNS_WLTH_EXTREME:
+      return LOG_STREAM_EXTREME;
+    default:
+      break;
+  }
+  if (!this->hot_cold) return LOG_STREAM_COLD;
+
+  // Every block counts towards the temperature of its chunk, the write
+  // as a whole goes where the majority of its blocks belong.
+  uint64_t block = lba / this->lba_size;
+  uint32_t nblocks = std::max(size / this->lba_size, (uint32_t)1);
+  uint32_t hot = 0;
+  for (uint32_t i = 0; i < nblocks; i++) {
+    if (this->heat->record(block + i)) hot++;
+  }
+  return hot * 2 >= nblocks ? LOG_STREAM_HOT : LOG_STREAM_COLD;
 }
 
-ZNSDataZone *FTL::get_free_data_zone(const uint32_t needed) {
+ZNSDataZone *FTL::get_free_data_zone(const uint32_t needed, bool hot) {
+  // Hot data will be merged again soon and resets its zone along the
+  // way, so it goes to the youngest zone. Cold data stays put for a
+  // long time and gives the most worn zones some rest.
+  ZNSDataZone *best = nullptr;
   for (uint16_t i = 0; i < this->zones_data.size(); i++) {
-    if ((&this->zones_data[i])->get_current_capacity() >= needed)
-      return &this->zones_data[i];
+    ZNSDataZone *zone = &this->zones_data[i];
+    if (zone->get_current_capacity() < needed) continue;
+    if (std::find(this->zones_reserved.begin(), this->zones_reserved.end(),
+                  zone) != this->zones_reserved.end()) {
+      continue;
+    }
+    if (best == nullptr || (hot && zone->reset_count < best->reset_count) ||
+        (!hot && zone->reset_count > best->reset_count)) {
+      best = zone;
+    }
+  }
+  return best;
+}
+
+ZNSDataZone *FTL::take_reserved_zone() {
+  if (this->zones_reserved.empty()) return nullptr;
+  ZNSDataZone *zone = this->zones_reserved.back();
+  this->zones_reserved.pop_back();
+  return zone;
+}
+
+void FTL::refill_reserved_zones() {
+  while (this->zones_reserved.size() < FTL_RESERVED_ZONES) {
+    // Park the youngest zone, it is the one we would like to write next.
+    ZNSDataZone *zone = this->get_free_data_zone(this->zcap, true);
+    if (zone == nullptr) return;
+    this->zones_reserved.push_back(zone);
+  }
+}
+
+ZNSDataZone *FTL::get_gc_zone(bool hot) {
+  ZNSDataZone *zone = this->get_free_data_zone(this->zcap, hot);
+  if (zone != nullptr) return zone;
+  zone = this->take_reserved_zone();
+  if (zone != nullptr) return zone;
+  // Zones this cycle freed up may not be in the pool yet.
+  this->refill_reserved_zones();
+  return this->take_reserved_zone();
+}
+
+bool FTL::is_hot_region(uint64_t base_addr, int stream) {
+  switch (stream) {
+    case LOG_STREAM_HOT:
+    case LOG_STREAM_SHORT:
+      return true;
+    case LOG_STREAM_LONG:
+    case LOG_STREAM_EXTREME:
+      return false;
+    default:
+      break;
+  }
+  auto found = this->region_merges.find(base_addr);
+  return found != this->region_merges.end() &&
+         found->second >= WEAR_HOT_MERGES;
+}
+
+void FTL::note_region_merge(uint64_t base_addr) {
+  this->region_merges[base_addr]++;
+  if (++this->merges_since_decay < this->zones_data.size()) return;
+
+  // Forget about old merges, so regions that cooled down get parked on
+  // the worn zones again.
+  this->merges_since_decay = 0;
+  for (auto iter = this->region_merges.begin();
+       iter != this->region_merges.end();) {
+    iter->second /= 2;
+    if (iter->second == 0) {
+      iter = this->region_merges.erase(iter);
+    } else {
+      iter++;
+    }
   }
-  return nullptr;
 }
 
 bool FTL::get_ppa(uint64_t lba, Addr *addr) {
-  pthread_rwlock_rdlock(&this->log_map.lock);
+  profiled_rdlock(&this->log_map.lock, LOCK_LOG_MAP);
   auto ret = this->log_map.map.find(lba);
   if (ret == this->log_map.map.end()) {
-    pthread_rwlock_unlock(&this->log_map.lock);
+    profiled_unlock(&this->log_map.lock, LOCK_LOG_MAP);
     return false;
   } else {
-    pthread_rwlock_unlock(&this->log_map.lock);
+    profiled_unlock(&this->log_map.lock, LOCK_LOG_MAP);
     *addr = ret->second;
     return true;
   }
 }
 
 bool FTL::get_pba_by_base(uint64_t base_addr, Addr *addr) {
-  pthread_rwlock_rdlock(&this->data_map.lock);
+  profiled_rdlock(&this->data_map.lock, LOCK_DATA_MAP);
   auto ret = this->data_map.map.find(base_addr);
   if (ret == this->data_map.map.end()) {
-    pthread_rwlock_unlock(&this->data_map.lock);
+    profiled_unlock(&this->data_map.lock, LOCK_DATA_MAP);
     return false;
   } else {
-    pthread_rwlock_unlock(&this->data_map.lock);
+    profiled_unlock(&this->data_map.lock, LOCK_DATA_MAP);
     *addr = ret->second;
     return true;
   }
 }
 
 bool FTL::get_pba(u_int64_t lba, Addr *addr) {
-  pthread_rwlock_rdlock(&this->data_map.lock);
+  profiled_rdlock(&this->data_map.lock, LOCK_DATA_MAP);
   uint64_t base_addr = ((lba / this->lba_size) / this->zcap) * this->zcap;
   auto ret = this->data_map.map.find(base_addr);
   if (ret == this->data_map.map.end()) {
-    pthread_rwlock_unlock(&this->data_map.lock);
+    profiled_unlock(&this->data_map.lock, LOCK_DATA_MAP);
     return false;
   } else {
     bool exist = this->zones_data[ret->second.zone_num].exists(lba);
-    pthread_rwlock_unlock(&this->data_map.lock);
+    profiled_unlock(&this->data_map.lock, LOCK_DATA_MAP);
     *addr = ret->second;
     return exist;
   }
 }
 
+bool FTL::pin_pba(uint64_t lba, Addr *addr) {
+  profiled_rdlock(&this->data_map.lock, LOCK_DATA_MAP);
+  uint64_t base_addr = ((lba / this->lba_size) / this->zcap) * this->zcap;
+  auto ret = this->data_map.map.find(base_addr);
+  bool exist = ret != this->data_map.map.end() &&
+               this->zones_data[ret->second.zone_num].exists(lba);
+  if (exist) {
+    // Taken under the lock, so once the GC switched the map away from
+    // the zone it only has to wait for the readers that got in before.
+    this->data_zone_readers[ret->second.zone_num]++;
+    *addr = ret->second;
+  }
+  profiled_unlock(&this->data_map.lock, LOCK_DATA_MAP);
+  return exist;
+}
+
+void FTL::unpin_data_zone(uint16_t zone_num) {
+  this->data_zone_readers[zone_num]--;
+}
+
 inline bool FTL::has_pa(uint64_t addr) {
   bool in_log = this->log_map.map.count(addr) > 0;
   bool in_data = this->data_map.map.count(addr) > 0;
@@ -349,28 +557,720 @@ inline bool FTL::has_pa(uint64_t addr) {
 }
 
 void FTL::insert_logmap(uint64_t lba, uint64_t pa, uint16_t zone_num) {
-  pthread_rwlock_wrlock(&this->log_map.lock);
+  STOSYS_PROBE3(log_map_insert, lba, pa, zone_num);
+  profiled_wrlock(&this->log_map.lock, LOCK_LOG_MAP);
   this->log_map.map[lba] =
       Addr{.addr = pa, .zone_num = zone_num, .alive = true};
-  pthread_rwlock_unlock(&this->log_map.lock);
+  // Log with the lock held, so the journal has the same order as the map.
+  this->journal->log(JOURNAL_LOG_INSERT, zone_num, lba, pa);
+  profiled_unlock(&this->log_map.lock, LOCK_LOG_MAP);
+  this->commit_journal(false);
 }
 
-void FTL::delete_logmap(uint64_t lba) {
-  pthread_rwlock_wrlock(&this->log_map.lock);
-  this->log_map.map.erase(lba);
-  pthread_rwlock_unlock(&this->log_map.lock);
+void FTL::delete_logmap(uint64_t lba, uint64_t pa, uint16_t zone_num) {
+  STOSYS_PROBE3(log_map_delete, lba, pa, zone_num);
+  profiled_wrlock(&this->log_map.lock, LOCK_LOG_MAP);
+  auto found = this->log_map.map.find(lba);
+  if (found != this->log_map.map.end() && found->second.addr == pa &&
+      found->second.zone_num == zone_num) {
+    this->log_map.map.erase(found);
+    this->journal->log(JOURNAL_LOG_DELETE, zone_num, lba, pa);
+  }
+  profiled_unlock(&this->log_map.lock, LOCK_LOG_MAP);
+  this->commit_journal(false);
 }
 
 void FTL::insert_datamap(uint64_t base_addr, uint64_t pa, uint16_t zone_num) {
-  pthread_rwlock_wrlock(&this->data_map.lock);
+  STOSYS_PROBE3(data_map_insert, base_addr, pa, zone_num);
+  profiled_wrlock(&this->data_map.lock, LOCK_DATA_MAP);
   uint64_t pa_base = (pa / this->zcap) * this->zcap;
+  auto old = this->data_map.map.find(base_addr);
+  if (old != this->data_map.map.end()) {
+    this->zones_data[old->second.zone_num].region = UINT64_MAX;
+  }
   this->data_map.map[base_addr] =
       Addr{.addr = pa_base, .zone_num = zone_num, .alive = true};
-  pthread_rwlock_unlock(&this->data_map.lock);
+  this->zones_data[zone_num].region = base_addr;
+
+  // The valid blocks of the new zone go first, as runs of blocks.
+  std::vector<int> &valid = this->zones_data[zone_num].block_map;
+  for (uint64_t start = 0; start < valid.size();) {
+    if (!valid[start]) {
+      start++;
+      continue;
+    }
+    uint64_t end = start;
+    while (end < valid.size() && valid[end]) end++;
+    this->journal->log(JOURNAL_DATA_RANGE, zone_num, start, end - start);
+    start = end;
+  }
+  this->journal->log(JOURNAL_DATA_INSERT, zone_num, base_addr, pa_base);
+  profiled_unlock(&this->data_map.lock, LOCK_DATA_MAP);
+  this->commit_journal(false);
+}
+
+bool FTL::reset_log_zone(ZNSLogZone *zone) {
+  // The changes that moved the data out of the zone have to be durable
+  // before the data is gone.
+  if (!this->commit_journal(true)) return false;
+  uint64_t start = clock_ticks();
+  zone->reset();
+  uint64_t end = clock_ticks();
+  this->latency[ZNS_LAT_ZONE_RESET].record(end - start);
+  if (tracing()) {
+    trace_record(TRACE_ZONE_RESET, zone->zone_id, zone->base, 0, start, end);
+  }
+  this->journal->log(JOURNAL_ZONE_RESET, zone->zone_id, 0, zone->reset_count);
+  this->stats.zone_resets++;
+  STOSYS_PROBE2(zone_reset, zone->zone_id, zone->reset_count);
+  return true;
+}
+
+bool FTL::reset_data_zone(ZNSDataZone *zone) {
+  if (!this->commit_journal(true)) {
+    // Nothing maps to the zone anymore, so only the GC can find it.
+    this->unreset_data_zones.push_back(zone);
+    return false;
+  }
+  // Reads that found the zone before it was unmapped finish first.
+  std::atomic<uint32_t> &readers =
+      this->data_zone_readers[zone->zone_id - this->log_zones];
+  while (readers.load() != 0) std::this_thread::yield();
+  uint64_t start = clock_ticks();
+  zone->reset();
+  uint64_t end = clock_ticks();
+  this->latency[ZNS_LAT_ZONE_RESET].record(end - start);
+  if (tracing()) {
+    trace_record(TRACE_ZONE_RESET, zone->zone_id, zone->base, 0, start, end);
+  }
+  this->journal->log(JOURNAL_ZONE_RESET, zone->zone_id, 0, zone->reset_count);
+  this->stats.zone_resets++;
+  STOSYS_PROBE2(zone_reset, zone->zone_id, zone->reset_count);
+  return true;
+}
+
+void FTL::retry_data_zone_resets() {
+  std::vector<ZNSDataZone *> zones;
+  zones.swap(this->unreset_data_zones);
+  for (ZNSDataZone *zone : zones) this->reset_data_zone(zone);
+}
+
+bool FTL::commit_journal(bool sync) {
+  bool written = this->journal->flush(sync);
+  if (written) {
+    // Make room before the ring is full, in the background so that the
+    // I/O of the checkpoint does not end up in a host write.
+    if (this->journal->needs_checkpoint()) this->request_checkpoint();
+    return true;
+  }
+
+  // The ring is full, nothing more can be written until a checkpoint
+  // frees a zone. Whoever got the lock first may have done that already.
+  pthread_mutex_lock(&this->checkpoint_lock);
+  written = this->journal->flush(sync);
+  if (!written && this->write_checkpoint()) {
+    written = this->journal->flush(sync);
+  }
+  pthread_mutex_unlock(&this->checkpoint_lock);
+  return written;
+}
+
+void FTL::request_checkpoint() {
+  if (this->checkpoint_requested.exchange(true)) return;
+  pthread_mutex_lock(&this->checkpoint_wake_lock);
+  pthread_cond_signal(&this->checkpoint_wake);
+  pthread_mutex_unlock(&this->checkpoint_wake_lock);
+}
+
+void FTL::checkpointer() {
+  trace_thread_name("checkpoint");
+  pthread_mutex_lock(&this->checkpoint_wake_lock);
+  while (!this->checkpointer_exit) {
+    if (!this->checkpoint_requested) {
+      pthread_cond_wait(&this->checkpoint_wake, &this->checkpoint_wake_lock);
+      continue;
+    }
+    pthread_mutex_unlock(&this->checkpoint_wake_lock);
+    // Requests that come in while we are busy ask for the next one.
+    this->checkpoint_requested = false;
+    if (this->journal->needs_checkpoint()) this->checkpoint();
+    pthread_mutex_lock(&this->checkpoint_wake_lock);
+  }
+  pthread_mutex_unlock(&this->checkpoint_wake_lock);
+}
+
+uint64_t FTL::checkpoint_zone_slba(uint32_t index) const {
+  return this->zcap * (this->zones_log.size() + this->zones_data.size() +
+                       FTL_JOURNAL_ZONES + index);
+}
+
+bool FTL::read_checkpoint_header(CheckpointReader *reader,
+                                 uint64_t *generation, uint64_t *seq,
+                                 uint64_t *block_seq) {
+  if (!reader->begin(CKPT_HEADER) || reader->get_u32() != CHECKPOINT_MAGIC ||
+      reader->get_u32() != CHECKPOINT_VERSION) {
+    return false;
+  }
+  *generation = reader->get_varint();
+  uint64_t ckpt_seq = reader->get_varint();
+  if (seq != nullptr) *seq = ckpt_seq;
+  uint64_t ckpt_log_zones = reader->get_varint();
+  bool same_layout = ckpt_log_zones == this->zones_log.size();
+  same_layout &= reader->get_varint() == this->zones_data.size();
+  same_layout &= reader->get_varint() == this->zcap;
+  same_layout &= reader->get_varint() == this->lba_size;
+  uint64_t reserved = reader->get_varint();
+  if (block_seq != nullptr) *block_seq = reserved;
+  if (!reader->end()) return false;
+  if (ckpt_log_zones != this->zones_log.size()) {
+    this->foreign_log_zones = ckpt_log_zones;
+  }
+  return same_layout;
+}
+
+bool FTL::restore_checkpoint(uint64_t *ckpt_seq, bool lazy) {
+  // The newest checkpoint wins. If it is torn we crashed while writing
+  // it, then the journal still goes back to the one before.
+  std::vector<std::pair<uint64_t, uint32_t>> checkpoints;
+  for (uint32_t i = 0; i < FTL_CHECKPOINT_ZONES; i++) {
+    uint64_t slba = this->checkpoint_zone_slba(i);
+    uint64_t end = zone_write_pointer(this->fd, this->nsid, slba, this->zcap);
+    if (end == slba) continue;
+    CheckpointReader reader(this->fd, this->nsid, this->lba_size,
+                            this->mdts_size, slba, end, 1);
+    uint64_t generation;
+    if (this->read_checkpoint_header(&reader, &generation, nullptr)) {
+      checkpoints.push_back({generation, i});
+      this->checkpoint_generation =
+          std::max(this->checkpoint_generation, generation);
+    }
+  }
+  std::sort(checkpoints.rbegin(), checkpoints.rend());
+
+  for (auto &checkpoint : checkpoints) {
+    this->checkpoint_slba = this->checkpoint_zone_slba(checkpoint.second);
+    this->checkpoint_end = zone_write_pointer(
+        this->fd, this->nsid, this->checkpoint_slba, this->zcap);
+    CheckpointReader reader(this->fd, this->nsid, this->lba_size,
+                            this->mdts_size, this->checkpoint_slba,
+                            this->checkpoint_end);
+    uint64_t generation;
+    uint64_t seq;
+    uint64_t block_seq;
+    if (!this->read_checkpoint_header(&reader, &generation, &seq,
+                                      &block_seq)) {
+      continue;
+    }
+
+    // restore the previous status of ftl.
+    printf("restore from checkpoint %lu in zone %u.\n", generation,
+           checkpoint.second);
+    if (this->read_checkpoint(&reader, lazy)) {
+      this->checkpoint_zone = checkpoint.second;
+      *ckpt_seq = seq;
+      this->block_seq = block_seq;
+      return true;
+    }
+
+    // Torn or corrupt, forget whatever we got out of it.
+    std::cout << "checkpoint is corrupt, ignoring it." << std::endl;
+    for (ZNSLogZone &zone : this->zones_log) {
+      zone.block_map.map.clear();
+      zone.reset_count = 0;
+    }
+    for (ZNSDataZone &zone : this->zones_data) {
+      std::fill(zone.block_map.begin(), zone.block_map.end(), 0);
+      zone.reset_count = 0;
+    }
+    this->log_map.map.clear();
+    this->data_map.map.clear();
+    this->pending_regions.clear();
+    this->restore_pending = false;
+  }
+  return false;
+}
+
+bool FTL::read_checkpoint(CheckpointReader *reader, bool lazy) {
+  // restore dzone.
+  if (!reader->begin(CKPT_DATA_ZONES)) return false;
+  std::vector<uint8_t> bitmap((this->zcap + 7) / 8);
+  for (ZNSDataZone &zone : this->zones_data) {
+    reader->get_bytes(bitmap.data(), bitmap.size());
+    for (uint32_t i = 0; i < this->zcap; i++) {
+      zone.block_map[i] = (bitmap[i / 8] >> (i % 8)) & 1;
+    }
+  }
+  if (!reader->end()) return false;
+
+  // restore dmap.
+  if (!reader->begin(CKPT_DATA_MAP)) return false;
+  uint64_t count = reader->get_varint();
+  uint64_t base = 0;
+  for (uint64_t i = 0; i < count && reader->ok(); i++) {
+    base += reader->get_varint();
+    uint64_t zone = reader->get_varint();
+    uint64_t pa = reader->get_varint();
+    if ((zone >> 1) >= this->zones_data.size()) return false;
+    this->data_map.map[base] = Addr{.addr = pa,
+                                    .zone_num = (uint16_t)(zone >> 1),
+                                    .alive = (bool)(zone & 1)};
+  }
+  if (!reader->end()) return false;
+
+  // restore the wear of every zone.
+  if (!reader->begin(CKPT_WEAR)) return false;
+  for (ZNSLogZone &zone : this->zones_log) {
+    zone.reset_count = reader->get_varint();
+  }
+  for (ZNSDataZone &zone : this->zones_data) {
+    zone.reset_count = reader->get_varint();
+  }
+  if (!reader->end()) return false;
+
+  // The log map is stored per region, the index says where each one is.
+  uint64_t index;
+  if (!reader->read_trailer(&index)) return false;
+  reader->seek(index);
+  if (!reader->begin(CKPT_INDEX)) return false;
+  uint64_t mapped = reader->get_varint();
+  count = reader->get_varint();
+  std::map<uint64_t, uint64_t> regions;
+  uint64_t region = 0;
+  uint64_t offset = 0;
+  for (uint64_t i = 0; i < count && reader->ok(); i++) {
+    region += reader->get_varint();
+    offset += reader->get_varint();
+    regions[region] = offset;
+  }
+  if (!reader->end()) return false;
+  this->log_map.map.reserve(mapped);
+
+  if (lazy) {
+    // Loaded on first access, or by the restore thread.
+    this->pending_regions = std::move(regions);
+    this->restore_pending = !this->pending_regions.empty();
+    return true;
+  }
+
+  // restore lmap. Every region is decoded by a task with a reader of
+  // its own, the maps are merged afterwards.
+  std::vector<std::pair<uint64_t, uint64_t>> offsets(regions.begin(),
+                                                     regions.end());
+  std::vector<raw_map> decoded(offsets.size());
+  std::atomic<bool> corrupt(false);
+  parallel_for(offsets.size(), [&](uint64_t i) {
+    CheckpointReader region_reader(this->fd, this->nsid, this->lba_size,
+                                   this->mdts_size, this->checkpoint_slba,
+                                   this->checkpoint_end, 1);
+    region_reader.seek(offsets[i].second);
+    if (!this->decode_region(&region_reader, offsets[i].first,
+                             &decoded[i])) {
+      corrupt = true;
+    }
+  });
+  if (corrupt) return false;
+  for (uint64_t i = 0; i < offsets.size(); i++) {
+    this->insert_region(offsets[i].first, &decoded[i]);
+    raw_map().swap(decoded[i]);
+  }
+  return true;
+}
+
+bool FTL::decode_region(CheckpointReader *reader, uint64_t region,
+                        raw_map *entries) {
+  if (!reader->begin(CKPT_REGION) || reader->get_varint() != region) {
+    return false;
+  }
+  uint64_t count = reader->get_varint();
+  uint64_t lba = 0;
+  uint64_t addr = 0;
+  for (uint64_t i = 0; i < count && reader->ok(); i++) {
+    lba += reader->get_svarint();
+    addr += reader->get_svarint();
+    uint64_t zone_num = reader->get_varint();
+    uint64_t run = reader->get_varint();
+    uint64_t len = run >> 1;
+    if (zone_num >= this->zones_log.size() || len > this->zcap) return false;
+    for (uint64_t j = 0; j < len; j++) {
+      (*entries)[lba] = Addr{.addr = addr,
+                             .zone_num = (uint16_t)zone_num,
+                             .alive = (bool)(run & 1)};
+      lba += this->lba_size;
+      addr++;
+    }
+  }
+  return reader->end();
+}
+
+void FTL::insert_region(uint64_t region, raw_map *entries) {
+  // The changes the journal had for the region since the checkpoint.
+  auto deferred = this->deferred_entries.find(region);
+  if (deferred != this->deferred_entries.end()) {
+    for (const JournalEntry &entry : deferred->second) {
+      auto found = entries->find(entry.lba);
+      if (entry.type == JOURNAL_LOG_INSERT) {
+        (*entries)[entry.lba] = Addr{.addr = entry.pa,
+                                     .zone_num = (uint16_t)entry.zone,
+                                     .alive = true};
+      } else if (found != entries->end() && found->second.addr == entry.pa &&
+                 found->second.zone_num == entry.zone) {
+        entries->erase(found);
+      }
+    }
+    this->deferred_entries.erase(deferred);
+  }
+
+  // Only the live blocks make it into the block maps of the log zones,
+  // nothing needs to know about the dead ones until the zone is reset.
+  profiled_wrlock(&this->log_map.lock, LOCK_LOG_MAP);
+  for (auto &entry : *entries) {
+    uint16_t zone_num = entry.second.zone_num;
+    if (!this->empty_log_zones.empty() && this->empty_log_zones[zone_num]) {
+      continue;
+    }
+    ZNSLogZone *zone = &this->zones_log[zone_num];
+    this->log_map.map[entry.first] = entry.second;
+    profiled_wrlock(&zone->block_map.lock, LOCK_BLOCK_MAP);
+    zone->block_map.map[entry.second.addr] = {.address = entry.second.addr,
+                                              .logical_address = entry.first,
+                                              .valid = true};
+    profiled_unlock(&zone->block_map.lock, LOCK_BLOCK_MAP);
+  }
+  profiled_unlock(&this->log_map.lock, LOCK_LOG_MAP);
+}
+
+void FTL::load_pending_region(CheckpointReader *reader,
+                              std::map<uint64_t, uint64_t>::iterator region) {
+  raw_map entries;
+  reader->seek(region->second);
+  if (!this->decode_region(reader, region->first, &entries)) {
+    // Too late to fall back to the media, keep what the journal knows.
+    std::cout << "region " << region->first << " of the checkpoint is corrupt."
+              << std::endl;
+    entries.clear();
+  }
+  this->insert_region(region->first, &entries);
+  this->pending_regions.erase(region);
+  if (this->pending_regions.empty()) {
+    this->restore_pending = false;
+    std::cout << "restore finished." << std::endl;
+  }
+}
+
+void FTL::fault_region(uint64_t lba, uint32_t size) {
+  if (!this->restore_pending) return;
+  uint64_t first = ((lba / this->lba_size) / this->zcap) * this->zcap;
+  uint64_t last = (((lba + std::max(size, 1U) - 1) / this->lba_size) /
+                   this->zcap) * this->zcap;
+  pthread_mutex_lock(&this->restore_lock);
+  for (uint64_t region = first; region <= last; region += this->zcap) {
+    auto found = this->pending_regions.find(region);
+    if (found == this->pending_regions.end()) continue;
+    // A single command is enough for most regions.
+    CheckpointReader reader(this->fd, this->nsid, this->lba_size,
+                            this->mdts_size, this->checkpoint_slba,
+                            this->checkpoint_end, 1);
+    this->load_pending_region(&reader, found);
+  }
+  pthread_mutex_unlock(&this->restore_lock);
+}
+
+void FTL::finish_restore() {
+  if (!this->restore_pending) return;
+  CheckpointReader reader(this->fd, this->nsid, this->lba_size,
+                          this->mdts_size, this->checkpoint_slba,
+                          this->checkpoint_end);
+  pthread_mutex_lock(&this->restore_lock);
+  while (!this->pending_regions.empty()) {
+    this->load_pending_region(&reader, this->pending_regions.begin());
+    // Let a host I/O that waits for its region go first.
+    pthread_mutex_unlock(&this->restore_lock);
+    pthread_mutex_lock(&this->restore_lock);
+  }
+  pthread_mutex_unlock(&this->restore_lock);
+}
+
+void FTL::replay_entry(const JournalEntry &entry) {
+  // A checkpoint is taken while the FTL runs, so it may already contain
+  // some of the changes after its sequence number. Replaying an entry
+  // on state that has it already must not change that state.
+
+  // Regions still in the checkpoint get their entries once loaded.
+  if (this->restore_pending && (entry.type == JOURNAL_LOG_INSERT ||
+                                entry.type == JOURNAL_LOG_DELETE)) {
+    uint64_t region = ((entry.lba / this->lba_size) / this->zcap) * this->zcap;
+    if (this->pending_regions.count(region)) {
+      this->deferred_entries[region].push_back(entry);
+      return;
+    }
+  }
+
+  switch (entry.type) {
+    case JOURNAL_LOG_INSERT: {
+      auto found = this->log_map.map.find(entry.lba);
+      // Even if the log map has it already, replaying a reset that the
+      // checkpoint had seen may have cleared the block map of the zone
+      // since, so the block always goes back in.
+      if (found != this->log_map.map.end() &&
+          (found->second.addr != entry.pa ||
+           found->second.zone_num != entry.zone)) {
+        this->zones_log[found->second.zone_num].invalidate_block(
+            found->second.addr);
+      }
+      this->zones_log[entry.zone].block_map.map[entry.pa] = {
+          .address = entry.pa, .logical_address = entry.lba, .valid = true};
+      this->log_map.map[entry.lba] = Addr{
+          .addr = entry.pa, .zone_num = (uint16_t)entry.zone, .alive = true};
+      break;
+    }
+    case JOURNAL_LOG_DELETE: {
+      auto found = this->log_map.map.find(entry.lba);
+      if (found != this->log_map.map.end() &&
+          found->second.addr == entry.pa &&
+          found->second.zone_num == entry.zone) {
+        this->log_map.map.erase(found);
+      }
+      break;
+    }
+    case JOURNAL_DATA_RANGE: {
+      std::vector<int> &valid = this->zones_data[entry.zone].block_map;
+      for (uint64_t i = entry.lba; i < entry.lba + entry.pa; i++) valid[i] = 1;
+      break;
+    }
+    case JOURNAL_DATA_INSERT:
+      this->data_map.map[entry.lba] = Addr{
+          .addr = entry.pa, .zone_num = (uint16_t)entry.zone, .alive = true};
+      break;
+    case JOURNAL_SEQ_RESERVE:
+      if (entry.pa > this->block_seq) this->block_seq = entry.pa;
+      break;
+    case JOURNAL_ZONE_RESET:
+      if (entry.zone < this->zones_log.size()) {
+        ZNSLogZone *zone = &this->zones_log[entry.zone];
+        zone->block_map.map.clear();
+        zone->reset_count = (uint32_t)entry.pa;
+      } else {
+        ZNSDataZone *zone = &this->zones_data[entry.zone - this->log_zones];
+        std::fill(zone->block_map.begin(), zone->block_map.end(), 0);
+        zone->reset_count = (uint32_t)entry.pa;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void FTL::rebuild_from_media() {
+  const uint64_t chunk = std::max(this->mdts_size / this->lba_size, 1UL);
+
+  // Every zone is scanned by its own task into a fragment of its own,
+  // the fragments are merged by sequence number afterwards.
+  struct LogCopy {
+    uint64_t lba;
+    uint64_t seq;
+    uint64_t pa;
+  };
+  std::vector<std::vector<LogCopy>> copies(this->zones_log.size());
+  parallel_for(this->zones_log.size(), [&](uint64_t i) {
+    ZNSLogZone *zone = &this->zones_log[i];
+    std::vector<char> buffer(chunk * this->lba_size);
+    std::vector<char> meta(chunk * this->meta_size);
+    zone->block_map.map.clear();
+    for (uint64_t pa = zone->base; pa < zone->get_wp(); pa += chunk) {
+      uint64_t nblocks = std::min(chunk, zone->get_wp() - pa);
+      uint32_t read_size;
+      if (zone->read(pa, buffer.data(), nblocks * this->lba_size, &read_size,
+                     meta.data()) != 0) {
+        break;
+      }
+      for (uint64_t j = 0; j < nblocks; j++) {
+        BlockMeta block;
+        memcpy(&block, meta.data() + j * this->meta_size, sizeof(block));
+        if (block.seq == 0) continue;
+        zone->block_map.map[pa + j] = {
+            .address = pa + j, .logical_address = block.lba, .valid = false};
+        copies[i].push_back(
+            LogCopy{.lba = block.lba, .seq = block.seq, .pa = pa + j});
+      }
+    }
+  });
+
+  // Newest copy of every LBA in the log.
+  struct Newest {
+    uint64_t seq;
+    uint16_t zone;
+    uint64_t pa;
+  };
+  std::unordered_map<uint64_t, Newest> newest;
+  uint64_t max_seq = 0;
+  for (uint16_t i = 0; i < copies.size(); i++) {
+    for (const LogCopy &copy : copies[i]) {
+      max_seq = std::max(max_seq, copy.seq);
+      auto found = newest.find(copy.lba);
+      if (found == newest.end() || found->second.seq < copy.seq) {
+        newest[copy.lba] = Newest{.seq = copy.seq, .zone = i, .pa = copy.pa};
+      }
+    }
+    std::vector<LogCopy>().swap(copies[i]);
+  }
+  this->log_map.map.clear();
+  this->log_map.map.reserve(newest.size());
+
+  // Data zones only know the region they hold through their blocks. Two
+  // zones claim the same region if we crashed during a merge or a wear
+  // leveling copy, then the old zone is complete while the new one may
+  // not be. The new one is written in block order, so it is complete if
+  // it has every block the old one has. If it is not, the old one wins,
+  // the blocks merged from the log are still in the log.
+  struct Claim {
+    uint16_t zone;
+    uint64_t max_seq;
+  };
+  std::vector<Claim> zone_claims(this->zones_data.size());
+  std::vector<uint64_t> regions(this->zones_data.size(), UINT64_MAX);
+  std::vector<std::vector<uint64_t>> seqs(this->zones_data.size());
+  parallel_for(this->zones_data.size(), [&](uint64_t i) {
+    ZNSDataZone *zone = &this->zones_data[i];
+    std::vector<char> buffer(chunk * this->lba_size);
+    std::vector<char> meta(chunk * this->meta_size);
+    std::fill(zone->block_map.begin(), zone->block_map.end(), 0);
+    seqs[i].assign(this->zcap, 0);
+    Claim claim = {.zone = (uint16_t)i, .max_seq = 0};
+    uint64_t written = zone->get_wp() - zone->base;
+    for (uint64_t index = 0; index < written; index += chunk) {
+      uint64_t nblocks = std::min(chunk, written - index);
+      uint32_t read_size;
+      if (zone->read(zone->base + index, buffer.data(),
+                     nblocks * this->lba_size, &read_size, meta.data()) != 0) {
+        break;
+      }
+      for (uint64_t j = 0; j < nblocks; j++) {
+        BlockMeta block;
+        memcpy(&block, meta.data() + j * this->meta_size, sizeof(block));
+        if (block.seq == 0) continue;
+        zone->block_map[index + j] = 1;
+        seqs[i][index + j] = block.seq;
+        regions[i] = ((block.lba / this->lba_size) / this->zcap) * this->zcap;
+        claim.max_seq = std::max(claim.max_seq, block.seq);
+      }
+    }
+    zone_claims[i] = claim;
+  });
+
+  // Whether zone a has a block everywhere zone b has one.
+  auto covers = [&](uint16_t a, uint16_t b) {
+    for (uint64_t index = 0; index < this->zcap; index++) {
+      if (seqs[b][index] != 0 && seqs[a][index] == 0) return false;
+    }
+    return true;
+  };
+
+  std::unordered_map<uint64_t, Claim> claims;
+  this->data_map.map.clear();
+  for (uint16_t i = 0; i < this->zones_data.size(); i++) {
+    if (regions[i] == UINT64_MAX) continue;
+    const Claim &claim = zone_claims[i];
+    max_seq = std::max(max_seq, claim.max_seq);
+
+    auto found = claims.find(regions[i]);
+    if (found == claims.end()) {
+      claims[regions[i]] = claim;
+      continue;
+    }
+    bool covers_other = covers(claim.zone, found->second.zone);
+    bool covered = covers(found->second.zone, claim.zone);
+    bool wins;
+    if (covers_other && covered) {
+      // Both complete, the newer one has what a merge added.
+      wins = claim.max_seq > found->second.max_seq;
+    } else if (covers_other || covered) {
+      wins = covers_other;
+    } else {
+      wins = claim.max_seq < found->second.max_seq;
+    }
+    Claim loser = claim;
+    if (wins) {
+      loser = found->second;
+      found->second = claim;
+    }
+    // Recovery never erases anything, the GC resets the zone once the
+    // rebuilt maps are in a checkpoint.
+    ZNSDataZone *zone = &this->zones_data[loser.zone];
+    std::fill(zone->block_map.begin(), zone->block_map.end(), 0);
+    this->unreset_data_zones.push_back(zone);
+  }
+  for (auto &claim : claims) {
+    ZNSDataZone *zone = &this->zones_data[claim.second.zone];
+    this->data_map.map[claim.first] =
+        Addr{.addr = zone->base, .zone_num = claim.second.zone, .alive = true};
+  }
+
+  // A log copy is only live if the data zone does not have the same or a
+  // newer version of the block.
+  for (auto &copy : newest) {
+    uint64_t block = copy.first / this->lba_size;
+    uint64_t region = (block / this->zcap) * this->zcap;
+    auto claim = claims.find(region);
+    if (claim != claims.end() &&
+        seqs[claim->second.zone][block % this->zcap] >= copy.second.seq) {
+      continue;
+    }
+    ZNSLogZone *zone = &this->zones_log[copy.second.zone];
+    zone->block_map.map[copy.second.pa].valid = true;
+    this->log_map.map[copy.first] = Addr{
+        .addr = copy.second.pa, .zone_num = copy.second.zone, .alive = true};
+  }
+
+  if (max_seq >= this->block_seq) this->block_seq = max_seq + 1;
+}
+
+void FTL::drop_empty_zones() {
+  // Resets whose journal entry did not make it to the device.
+  for (uint16_t i = 0; i < this->zones_log.size(); i++) {
+    ZNSLogZone *zone = &this->zones_log[i];
+    if (zone->get_wp() != zone->base) continue;
+    zone->block_map.map.clear();
+    for (auto iter = this->log_map.map.begin();
+         iter != this->log_map.map.end();) {
+      if (iter->second.zone_num == i) {
+        iter = this->log_map.map.erase(iter);
+      } else {
+        iter++;
+      }
+    }
+  }
+  for (uint16_t i = 0; i < this->zones_data.size(); i++) {
+    ZNSDataZone *zone = &this->zones_data[i];
+    if (zone->get_wp() != zone->base) continue;
+    std::fill(zone->block_map.begin(), zone->block_map.end(), 0);
+    for (auto iter = this->data_map.map.begin();
+         iter != this->data_map.map.end();) {
+      if (iter->second.zone_num == i) {
+        iter = this->data_map.map.erase(iter);
+      } else {
+        iter++;
+      }
+    }
+  }
 }
 
 int FTL::read(uint64_t lba, void *buffer, uint32_t size) {
+  ScopedLatency timer(&this->latency[ZNS_LAT_READ]);
+  ScopedTrace trace(TRACE_HOST_READ, 0, lba, size);
+  STOSYS_PROBE2(ftl_read_entry, lba, size);
+  this->fault_region(lba, size);
+  this->reads_inflight++;
+  int ret = this->read_blocks(lba, buffer, size);
+  this->reads_inflight--;
+  if (ret == 0) this->stats.host_bytes_read += size;
+  STOSYS_PROBE3(ftl_read_return, lba, size, ret);
+  return ret;
+}
+
+int FTL::read_blocks(uint64_t lba, void *buffer, uint32_t size) {
   uint64_t pages_num = size / this->lba_size;
+  this->last_host_io.store(monotonic_microseconds(),
+                           std::memory_order_relaxed);
 
   for (uint64_t i = 0; i < pages_num; i++) {
     Addr pa;
@@ -378,20 +1278,22 @@ int FTL::read(uint64_t lba, void *buffer, uint32_t size) {
     if (contains) {
       ZNSLogZone *zone = &this->zones_log[pa.zone_num];
       uint32_t read_size;
-      int ret = zone->read(pa.addr, buffer, this->lba_size, &read_size);
+      int ret = zone->read(pa.addr, buffer, this->lba_size, &read_size,
+                           nullptr, true);
       if (ret != 0) {
         return ret;
       }
       buffer = (void *)((uint64_t)buffer + this->lba_size);
     } else {
       // in the block zones.
-      bool contains = this->get_pba(lba, &pa);
+      bool contains = this->pin_pba(lba, &pa);
       if (contains) {
         ZNSDataZone *zone = &this->zones_data[pa.zone_num];
         uint32_t read_size;
         uint64_t index = (lba / this->lba_size) % this->zcap;
-        int ret =
-            zone->read(zone->base + index, buffer, this->lba_size, &read_size);
+        int ret = zone->read(zone->base + index, buffer, this->lba_size,
+                             &read_size, nullptr, true);
+        this->unpin_data_zone(pa.zone_num);
         if (ret != 0) {
           return ret;
         }
@@ -404,16 +1306,173 @@ int FTL::read(uint64_t lba, void *buffer, uint32_t size) {
   return 0;
 }
 
+void FTL::get_stats(struct zns_stats *out) {
+  out->host_bytes_read = this->stats.host_bytes_read;
+  out->host_bytes_written = this->stats.host_bytes_written;
+  out->dev_bytes_host = this->stats.dev_bytes_host;
+  out->dev_bytes_gc_merge = this->stats.dev_bytes_gc_merge;
+  out->dev_bytes_gc_insert = this->stats.dev_bytes_gc_insert;
+  out->dev_bytes_wear_level = this->stats.dev_bytes_wear_level;
+  out->dev_bytes_padding = this->stats.dev_bytes_padding;
+  out->dev_bytes_journal = this->journal->bytes_written;
+  out->dev_bytes_checkpoint = this->stats.dev_bytes_checkpoint;
+  out->zone_resets = this->stats.zone_resets;
+  out->gc_cycles = this->stats.gc_cycles;
+
+  profiled_rdlock(&this->log_map.lock, LOCK_LOG_MAP);
+  out->log_map_entries = this->log_map.map.size();
+  profiled_unlock(&this->log_map.lock, LOCK_LOG_MAP);
+  profiled_rdlock(&this->data_map.lock, LOCK_DATA_MAP);
+  out->data_map_entries = this->data_map.map.size();
+  profiled_unlock(&this->data_map.lock, LOCK_DATA_MAP);
+  profiled_rdlock(&this->zones_lock, LOCK_ZONES);
+  out->free_log_zones = this->free_log_zones.size();
+  out->free_data_zones = this->free_data_zones.size();
+  profiled_unlock(&this->zones_lock, LOCK_ZONES);
+
+  uint64_t device = out->dev_bytes_host + out->dev_bytes_gc_merge +
+                    out->dev_bytes_gc_insert + out->dev_bytes_wear_level +
+                    out->dev_bytes_padding + out->dev_bytes_journal +
+                    out->dev_bytes_checkpoint;
+  out->write_amplification =
+      out->host_bytes_written ? (double)device / out->host_bytes_written : 0;
+}
+
+void FTL::get_memory(struct zns_mem_stats *out) {
+  profiled_rdlock(&this->log_map.lock, LOCK_LOG_MAP);
+  out->log_map_bytes = hash_map_bytes(this->log_map.map);
+  profiled_unlock(&this->log_map.lock, LOCK_LOG_MAP);
+  profiled_rdlock(&this->data_map.lock, LOCK_DATA_MAP);
+  out->data_map_bytes = hash_map_bytes(this->data_map.map);
+  profiled_unlock(&this->data_map.lock, LOCK_DATA_MAP);
+
+  // The block maps are only sized, which is fine to race with writers.
+  out->block_map_bytes = 0;
+  out->checksum_bytes = 0;
+  for (ZNSLogZone &zone : this->zones_log) {
+    out->block_map_bytes += hash_map_bytes(zone.block_map.map);
+    out->checksum_bytes += zone.checksums.memory_bytes();
+  }
+  for (ZNSDataZone &zone : this->zones_data) {
+    out->block_map_bytes += vector_bytes(zone.block_map);
+    out->checksum_bytes += zone.checksums.memory_bytes();
+  }
+  out->journal_bytes = this->journal->memory_bytes();
+  out->heat_bytes = this->heat ? this->heat->memory_bytes() : 0;
+  out->gc_scratch_bytes = this->gc_scratch.current;
+  out->gc_scratch_peak_bytes = this->gc_scratch.peak;
+  out->total_bytes = out->log_map_bytes + out->data_map_bytes +
+                     out->block_map_bytes + out->checksum_bytes +
+                     out->journal_bytes + out->heat_bytes +
+                     out->gc_scratch_bytes;
+}
+
+uint32_t FTL::get_zones(struct zns_zone_info *zones, uint32_t max) {
+  const uint32_t total = this->zones_log.size() + this->zones_data.size();
+  if (max == 0) return total;
+
+  // Only the zone lists and the data map are locked, the zones
+  // themselves are read as they are written.
+  profiled_rdlock(&this->zones_lock, LOCK_ZONES);
+  std::vector<ZNSLogZone *> open_zones = this->open_log_zones;
+  profiled_unlock(&this->zones_lock, LOCK_ZONES);
+  std::vector<uint64_t> regions(this->zones_data.size(), UINT64_MAX);
+  profiled_rdlock(&this->data_map.lock, LOCK_DATA_MAP);
+  for (const auto &entry : this->data_map.map) {
+    regions[entry.second.zone_num] = entry.first * this->lba_size;
+  }
+  profiled_unlock(&this->data_map.lock, LOCK_DATA_MAP);
+
+  const uint64_t now = monotonic_microseconds();
+  auto state_of = [](uint64_t written, uint64_t capacity) {
+    if (written == 0) return ZNS_ZONE_EMPTY;
+    return written < capacity ? ZNS_ZONE_OPEN : ZNS_ZONE_FULL;
+  };
+  auto idle_of = [now](uint64_t last_write) {
+    return last_write == 0 ? UINT64_MAX : now - std::min(now, last_write);
+  };
+  uint32_t n = 0;
+  for (ZNSLogZone &zone : this->zones_log) {
+    if (n == max) return total;
+    uint64_t wp = zone.position;
+    zns_zone_info &info = zones[n++];
+    info.zone_id = zone.zone_id;
+    info.type = ZNS_ZONE_LOG;
+    info.state = state_of(wp - zone.base, zone.capacity);
+    info.stream = zone.stream;
+    info.active = std::find(open_zones.begin(), open_zones.end(), &zone) !=
+                  open_zones.end();
+    info.hot =
+        zone.stream == LOG_STREAM_HOT || zone.stream == LOG_STREAM_SHORT;
+    info.slba = zone.slba;
+    info.write_pointer = wp;
+    info.capacity = zone.capacity;
+    info.valid_blocks = zone.get_alive_capacity();
+    info.reset_count = zone.reset_count;
+    info.region = UINT64_MAX;
+    info.idle_us = idle_of(zone.last_write);
+  }
+  for (uint32_t i = 0; i < this->zones_data.size(); i++) {
+    if (n == max) return total;
+    ZNSDataZone &zone = this->zones_data[i];
+    uint64_t wp = zone.position;
+    zns_zone_info &info = zones[n++];
+    info.zone_id = zone.zone_id;
+    info.type = ZNS_ZONE_DATA;
+    info.state = state_of(wp - zone.base, zone.capacity);
+    info.stream = -1;
+    info.active = false;
+    info.hot = zone.hot;
+    info.slba = zone.slba;
+    info.write_pointer = wp;
+    info.capacity = zone.capacity;
+    info.valid_blocks =
+        std::count(zone.block_map.begin(), zone.block_map.end(), 1);
+    info.reset_count = zone.reset_count;
+    info.region = regions[i];
+    info.idle_us = idle_of(zone.last_write);
+  }
+  return total;
+}
+
+int FTL::get_latency(int op, struct zns_latency *out, bool reset) {
+  HistogramSnapshot snapshot;
+  if (op == ZNS_LAT_NVME) {
+    nvme_latency.snapshot(&snapshot, reset);
+  } else if (op >= 0 && op < ZNS_LAT_NVME) {
+    this->latency[op].snapshot(&snapshot, reset);
+  } else {
+    return -EINVAL;
+  }
+  out->count = snapshot.count;
+  out->mean_ns =
+      snapshot.count ? ticks_to_ns(snapshot.sum / snapshot.count) : 0;
+  out->p50_ns = ticks_to_ns(snapshot.percentile(0.5));
+  out->p99_ns = ticks_to_ns(snapshot.percentile(0.99));
+  out->p999_ns = ticks_to_ns(snapshot.percentile(0.999));
+  out->max_ns = ticks_to_ns(snapshot.max());
+  return 0;
+}
+
 int16_t FTL::get_free_log_regions() { return this->free_log_zones.size(); }
 
 bool FTL::pba_exist(uint64_t base_addr) {
-  pthread_rwlock_rdlock(&this->data_map.lock);
+  profiled_rdlock(&this->data_map.lock, LOCK_DATA_MAP);
   bool ret = this->data_map.map.count(base_addr) > 0;
-  pthread_rwlock_unlock(&this->data_map.lock);
+  profiled_unlock(&this->data_map.lock, LOCK_DATA_MAP);
   return ret;
 }
 
-int FTL::write(uint64_t lba, void *buffer, uint32_t size) {
+int FTL::write(uint64_t lba, void *buffer, uint32_t size, int hint) {
+  ScopedLatency timer(&this->latency[ZNS_LAT_WRITE]);
+  ScopedTrace trace(TRACE_HOST_WRITE, 0, lba, size);
+  STOSYS_PROBE3(ftl_write_entry, lba, size, hint);
+  if (this->read_only) {
+    STOSYS_PROBE3(ftl_write_return, lba, size, -EROFS);
+    return -EROFS;
+  }
+  const uint64_t start_lba = lba;
+  const uint32_t total_size = size;
   // If we don't have enough free regions we wait for our GC
   // to clean our mess. Until that time we are locking the
   // zone since we are reading to it.
@@ -421,40 +1480,59 @@ int FTL::write(uint64_t lba, void *buffer, uint32_t size) {
   // why use volatile here?
   // We have a lock to sync and data dependency, compiler won't reorder this.
 
+  this->fault_region(lba, size);
+  const bool background = this->gc_mode == ZNS_GC_BACKGROUND;
+  const int stream = this->classify_write(lba, size, hint);
   // get none full zone.
   while (size != 0) {
+    this->last_host_io.store(monotonic_microseconds(),
+                             std::memory_order_relaxed);
     int16_t free_regions = get_free_log_regions();
-    if (free_regions <= this->gc_wmark) {
+    if (free_regions <= this->gc_wmark ||
+        (background && free_regions <= this->gc_soft_wmark)) {
       // wake up the gc thread.
       pthread_mutex_lock(&this->need_gc_lock);
       pthread_cond_signal(&this->need_gc);
       pthread_mutex_unlock(&this->need_gc_lock);
     }
+    if (background) this->throttle_write(size);
 
     // wait until gc clean up.
-    ZNSLogZone *zone = get_free_log_zone();
-    while (zone == nullptr) {
-      // wait gc cleans up.
-      pthread_mutex_lock(&this->clean_finish_lock);
-      pthread_cond_wait(&this->clean_finish, &this->clean_finish_lock);
-      pthread_mutex_unlock(&this->clean_finish_lock);
-      zone = get_free_log_zone();
+    ZNSLogZone *zone = get_free_log_zone(stream);
+    if (zone == nullptr) {
+      ScopedLatency stall(&this->latency[ZNS_LAT_WRITE_STALL]);
+      ScopedTrace stall_trace(TRACE_WRITE_STALL, 0, lba, size);
+      while (zone == nullptr) {
+        // wait gc cleans up.
+        this->writers_waiting++;
+        pthread_mutex_lock(&this->clean_finish_lock);
+        pthread_cond_wait(&this->clean_finish, &this->clean_finish_lock);
+        pthread_mutex_unlock(&this->clean_finish_lock);
+        this->writers_waiting--;
+        zone = get_free_log_zone(stream);
+      }
     }
 
     uint64_t wp_starts = zone->get_wp();
     uint32_t write_size;
     // printf("zone %d wp is %ld, size is %ld, current cap is %d\n",
     // zone->zone_id, zone->position, size, zone->get_current_capacity());
-    int ret = zone->write(buffer, size, &write_size, lba);
+    uint64_t seq;
+    if (!this->next_block_seq((size + this->lba_size - 1) / this->lba_size,
+                              &seq)) {
+      STOSYS_PROBE3(ftl_write_return, start_lba, total_size, -EIO);
+      return -EIO;
+    }
+    int ret = zone->write(buffer, size, &write_size, lba, seq);
 
     // If we haven't written the entire buffer then we know that the
     // log is full and that we can move on to the next zone
     if (zone->get_current_capacity() <= 0) {
-      pthread_rwlock_wrlock(&this->zones_lock);
-      this->free_log_zones.erase(this->free_log_zones.begin());
-      pthread_rwlock_unlock(&this->zones_lock);
+      this->retire_log_zone(zone);
     }
+    this->stats.dev_bytes_host += (zone->get_wp() - wp_starts) * this->lba_size;
     if (ret != 0) {
+      STOSYS_PROBE3(ftl_write_return, start_lba, total_size, ret);
       return ret;
     }
 
@@ -472,172 +1550,256 @@ int FTL::write(uint64_t lba, void *buffer, uint32_t size) {
     size -= write_size;
     buffer = (void *)((uint64_t)buffer + write_size);
   }
+  this->stats.host_bytes_written += total_size;
+  STOSYS_PROBE3(ftl_write_return, start_lba, total_size, 0);
   return 0;
 }
 
-void FTL::backup() {
-  // Store everything in the last zone.
-  // Calculate the last zone address.
-  uint32_t zones_num = this->zones_log.size() + this->zones_data.size();
-  uint64_t last_zone_addr = this->zcap * zones_num;
+bool FTL::next_block_seq(uint64_t count, uint64_t *seq) {
+  *seq = this->block_seq.fetch_add(count);
+  if (*seq + count <= this->block_seq_limit.load(std::memory_order_acquire)) {
+    return true;
+  }
+  pthread_mutex_lock(&this->seq_lock);
+  bool ok = true;
+  while (ok && *seq + count > this->block_seq_limit) {
+    uint64_t limit =
+        std::max(this->block_seq_limit.load(), *seq + count) + FTL_SEQ_BATCH;
+    this->block_seq_reserved = limit;
+    this->journal->log(JOURNAL_SEQ_RESERVE, 0, 0, limit);
+    ok = this->commit_journal(true);
+    if (ok) this->block_seq_limit.store(limit, std::memory_order_release);
+  }
+  pthread_mutex_unlock(&this->seq_lock);
+  return ok;
+}
 
-  uint64_t init_code = this->init_code;
+void FTL::throttle_write(uint32_t size) {
+  int16_t free_regions = this->get_free_log_regions();
+  uint64_t reclaim_rate = this->gc_reclaim_rate.load();
+  // Nothing to base our pace on until the GC finished its first cycle.
+  if (free_regions > this->gc_soft_wmark || reclaim_rate == 0) return;
+
+  // At the soft watermark we allow the writers to outrun the GC by
+  // GC_THROTTLE_SLACK, this linearly drops to the reclaim rate of the
+  // GC itself when we hit gc_wmark.
+  double pressure = (double)(free_regions - this->gc_wmark) /
+                    (this->gc_soft_wmark - this->gc_wmark);
+  pressure = std::min(std::max(pressure, 0.0), 1.0);
+  this->write_bucket->set_rate(reclaim_rate *
+                               (1.0 + GC_THROTTLE_SLACK * pressure));
+  this->write_bucket->consume(size);
+}
 
-  // store log zones data.
-  // char logzone_buf[zones_log.size() ]
-  std::vector<std::vector<uint64_t>> lbas_group;
-  std::vector<std::vector<ZNSBlock>> blocks_group;
-  for (uint16_t i = 0; i < this->zones_log.size(); i++) {
-    std::vector<uint64_t> lbas;
-    std::vector<ZNSBlock> blocks;
-    ZNSLogZone *zone = &this->zones_log[i];
-    pthread_rwlock_rdlock(&zone->block_map.lock);
-    BlockMap bmap = zone->block_map.map;
-    pthread_rwlock_unlock(&zone->block_map.lock);
+void FTL::backup() { this->commit_journal(true); }
 
-    // printf("\n");
-    for (BlockMap::iterator iter = bmap.begin(); iter != bmap.end(); iter++) {
-      uint64_t lba = iter->first;
-      ZNSBlock block = iter->second;
-      // printf("zone %d : %lx -> %lx, valid %d\n", i, lba,
-      // block.logical_address, block.valid);
-      lbas.push_back(lba);
-      blocks.push_back(block);
-    }
-    lbas_group.push_back(lbas);
-    blocks_group.push_back(blocks);
-    // printf("\n");
-  }
-  uint64_t lzone_buf_size = 0;
+int FTL::flush() {
+  // Every write is in the journal once it completes, so a caller only
+  // needs the journal to be durable up to what it was when it came in.
+  uint64_t target = this->journal->last_seq();
+  if (this->durable_seq.load(std::memory_order_acquire) >= target) return 0;
 
-  for (uint16_t i = 0; i < this->zones_log.size(); i++) {
-    uint64_t lba_cap = lbas_group[i].size() * sizeof(uint64_t);
-    uint64_t block_cap = blocks_group[i].size() * sizeof(ZNSBlock);
-    lzone_buf_size += (lba_cap + block_cap + sizeof(uint64_t));
-    // [size of lba_cap + block_cap] [lbas] [blocks].
+  pthread_mutex_lock(&this->flush_lock);
+  while (this->flushing) {
+    pthread_cond_wait(&this->flush_done, &this->flush_lock);
   }
-
-  // store data zones data.
-  uint64_t dzone_buf_size = this->zones_data.size() * this->zcap * sizeof(int);
-  char datazone_buf[dzone_buf_size];
-  uint64_t map_buf_addr = (uint64_t)datazone_buf;
-  for (uint16_t i = 0; i < this->zones_data.size(); i++) {
-    ZNSDataZone *zone = &this->zones_data[i];
-    std::vector<int> map = zone->block_map;
-    // printf("zone %d\n", i);
-    // for (auto val : map) {
-    // 	printf("valid: %d\n", val);
-    // }
-    // printf("\n");
-    memcpy((void *)map_buf_addr, map.data(), map.size() * sizeof(int));
-    map_buf_addr += map.size() * sizeof(int);
+  if (this->durable_seq.load(std::memory_order_relaxed) >= target) {
+    pthread_mutex_unlock(&this->flush_lock);
+    return 0;
   }
+  this->flushing = true;
+  pthread_mutex_unlock(&this->flush_lock);
+  ScopedTrace trace(TRACE_FLUSH, 0, 0, 0);
+
+  // Everyone who came in while we waited is covered by this one. The
+  // device flush covers the data and the journal together, a mapping
+  // that reaches the media before its data can only belong to a write
+  // that no flush has returned for yet.
+  uint64_t seq = this->journal->last_seq();
+  int ret = -EIO;
+  if (this->commit_journal(true)) ret = ss_nvme_flush(this->fd, this->nsid);
+
+  pthread_mutex_lock(&this->flush_lock);
+  if (ret == 0) this->durable_seq.store(seq, std::memory_order_release);
+  this->flushing = false;
+  pthread_cond_broadcast(&this->flush_done);
+  pthread_mutex_unlock(&this->flush_lock);
+  return ret;
+}
 
-  // store log zone map.
-  pthread_rwlock_rdlock(&this->log_map.lock);
-  raw_map logmap = this->log_map.map;
-  pthread_rwlock_unlock(&this->log_map.lock);
+void FTL::checkpoint() {
+  pthread_mutex_lock(&this->checkpoint_lock);
+  this->write_checkpoint();
+  pthread_mutex_unlock(&this->checkpoint_lock);
+}
 
-  uint64_t lmap_buf_size = logmap.size() * (sizeof(uint64_t) + sizeof(Addr));
-  char logmap_buf[lmap_buf_size];
-  map_buf_addr = (uint64_t)logmap_buf;
-  // printf("\n");
-  std::cout << "log map" << std::endl;
-  for (raw_map::iterator iter = logmap.begin(); iter != logmap.end(); iter++) {
-    uint64_t lba = iter->first;
-    Addr pa = iter->second;
-    memcpy((void *)map_buf_addr, &lba, sizeof(uint64_t));
-    map_buf_addr += sizeof(uint64_t);
-    memcpy((void *)map_buf_addr, &pa, sizeof(Addr));
-    map_buf_addr += sizeof(Addr);
+bool FTL::write_checkpoint() {
+  ScopedTrace trace(TRACE_CHECKPOINT, 0, 0, 0);
+  // The snapshot needs all of the map.
+  this->finish_restore();
+
+  // Never overwrite the newest checkpoint, take turns instead.
+  uint32_t target = (this->checkpoint_zone + 1) % FTL_CHECKPOINT_ZONES;
+  uint64_t slba = this->checkpoint_zone_slba(target);
+  // Everything up to here is part of the snapshot, replay starts after.
+  // The maps are copied while writers and the GC go on, so any of the
+  // entries logged after this may be in the snapshot as well. Replay
+  // copes with that, see replay_entry.
+  uint64_t ckpt_seq = this->journal->last_seq();
+  uint64_t generation = this->checkpoint_generation + 1;
+
+  // Normally already done after the previous checkpoint.
+  if (zone_write_pointer(this->fd, this->nsid, slba, this->zcap) != slba) {
+    ss_device_zone_reset(this->fd, this->nsid, slba);
   }
-
-  // printf("\n");
+  CheckpointWriter writer(this->fd, this->nsid, this->lba_size,
+                          this->mdts_size, slba, this->zcap);
+
+  writer.begin(CKPT_HEADER);
+  writer.put_u32(CHECKPOINT_MAGIC);
+  writer.put_u32(CHECKPOINT_VERSION);
+  writer.put_varint(generation);
+  writer.put_varint(ckpt_seq);
+  writer.put_varint(this->zones_log.size());
+  writer.put_varint(this->zones_data.size());
+  writer.put_varint(this->zcap);
+  writer.put_varint(this->lba_size);
+  writer.put_varint(this->block_seq_reserved);
+  writer.end();
+
+  // store data zones data, one bit per block.
+  writer.begin(CKPT_DATA_ZONES);
+  std::vector<uint8_t> bitmap((this->zcap + 7) / 8);
+  for (ZNSDataZone &zone : this->zones_data) {
+    std::fill(bitmap.begin(), bitmap.end(), 0);
+    for (uint32_t i = 0; i < this->zcap; i++) {
+      if (zone.block_map[i]) bitmap[i / 8] |= 1 << (i % 8);
+    }
+    writer.put_bytes(bitmap.data(), bitmap.size());
+  }
+  writer.end();
 
   // store data zone map.
-  pthread_rwlock_rdlock(&this->data_map.lock);
-  raw_map datamap = this->data_map.map;
-  pthread_rwlock_unlock(&this->data_map.lock);
-
-  uint64_t dmap_buf_size = datamap.size() * (sizeof(uint64_t) + sizeof(Addr));
-  uint64_t total_size =
-      lzone_buf_size + dzone_buf_size + lmap_buf_size + dmap_buf_size;
-  // [init_code] [buf_size] [lzone_buf_size] [dzone_buf_size] [lmap_buf_size]
-  // [dmap_buf_size] [metadata]. we know the number of log zones and data zones,
-  // so it should be easy to restore them.
-
-  // make sure it always be the multiple of lba_size.
-  uint64_t buf_size =
-      ((sizeof(uint64_t) * 6 + total_size) / this->lba_size) * this->lba_size +
-      this->lba_size;
-  uint16_t nlb = buf_size / this->lba_size;
-  char final_buf[buf_size];
-  uint64_t final_buf_addr = (uint64_t)final_buf;
-
-  memcpy((void *)final_buf_addr, &init_code, sizeof(uint64_t));
-  final_buf_addr += sizeof(uint64_t);
-  memcpy((void *)final_buf_addr, &buf_size, sizeof(uint64_t));
-  final_buf_addr += sizeof(uint64_t);
-  memcpy((void *)final_buf_addr, &lzone_buf_size, sizeof(uint64_t));
-  final_buf_addr += sizeof(uint64_t);
-  memcpy((void *)final_buf_addr, &dzone_buf_size, sizeof(uint64_t));
-  final_buf_addr += sizeof(uint64_t);
-  memcpy((void *)final_buf_addr, &lmap_buf_size, sizeof(uint64_t));
-  final_buf_addr += sizeof(uint64_t);
-  memcpy((void *)final_buf_addr, &dmap_buf_size, sizeof(uint64_t));
-  final_buf_addr += sizeof(uint64_t);
+  std::vector<std::pair<uint64_t, Addr>> datamap;
+  profiled_rdlock(&this->data_map.lock, LOCK_DATA_MAP);
+  datamap.assign(this->data_map.map.begin(), this->data_map.map.end());
+  profiled_unlock(&this->data_map.lock, LOCK_DATA_MAP);
+  std::sort(datamap.begin(), datamap.end(),
+            [](const std::pair<uint64_t, Addr> &a,
+               const std::pair<uint64_t, Addr> &b) {
+              return a.first < b.first;
+            });
+
+  writer.begin(CKPT_DATA_MAP);
+  writer.put_varint(datamap.size());
+  uint64_t base = 0;
+  for (auto &entry : datamap) {
+    writer.put_varint(entry.first - base);
+    writer.put_varint((uint64_t)entry.second.zone_num << 1 |
+                      entry.second.alive);
+    writer.put_varint(entry.second.addr);
+    base = entry.first;
+  }
+  writer.end();
 
-  for (uint16_t i = 0; i < this->zones_log.size(); i++) {
-    if (lbas_group[i].size() == 0) {
-      uint64_t num = 0;
-      memcpy((void *)final_buf_addr, &num, sizeof(uint64_t));
-      final_buf_addr += sizeof(uint64_t);
-      continue;
+  writer.begin(CKPT_WEAR);
+  for (ZNSLogZone &zone : this->zones_log) writer.put_varint(zone.reset_count);
+  for (ZNSDataZone &zone : this->zones_data) {
+    writer.put_varint(zone.reset_count);
+  }
+  writer.end();
+
+  // store log zone map, one section per region so that a region can be
+  // loaded on its own. The block maps of the log zones follow from it.
+  std::vector<std::pair<uint64_t, Addr>> logmap;
+  profiled_rdlock(&this->log_map.lock, LOCK_LOG_MAP);
+  logmap.assign(this->log_map.map.begin(), this->log_map.map.end());
+  profiled_unlock(&this->log_map.lock, LOCK_LOG_MAP);
+  std::sort(logmap.begin(), logmap.end(),
+            [](const std::pair<uint64_t, Addr> &a,
+               const std::pair<uint64_t, Addr> &b) {
+              return a.first < b.first;
+            });
+
+  // Runs of LBAs stored next to each other.
+  struct MapExtent {
+    uint64_t lba;
+    Addr pa;
+    uint64_t len;
+  };
+  std::vector<std::pair<uint64_t, uint64_t>> index;
+  for (size_t start = 0; start < logmap.size();) {
+    uint64_t region =
+        ((logmap[start].first / this->lba_size) / this->zcap) * this->zcap;
+    std::vector<MapExtent> extents;
+    size_t i = start;
+    for (; i < logmap.size(); i++) {
+      const std::pair<uint64_t, Addr> &entry = logmap[i];
+      if (((entry.first / this->lba_size) / this->zcap) * this->zcap !=
+          region) {
+        break;
+      }
+      if (!extents.empty()) {
+        MapExtent &last = extents.back();
+        if (entry.first == last.lba + last.len * this->lba_size &&
+            entry.second.addr == last.pa.addr + last.len &&
+            entry.second.zone_num == last.pa.zone_num &&
+            entry.second.alive == last.pa.alive) {
+          last.len++;
+          continue;
+        }
+      }
+      extents.push_back(
+          MapExtent{.lba = entry.first, .pa = entry.second, .len = 1});
+    }
+    start = i;
+
+    index.push_back({region, writer.offset()});
+    writer.begin(CKPT_REGION);
+    writer.put_varint(region);
+    writer.put_varint(extents.size());
+    uint64_t lba = 0;
+    uint64_t addr = 0;
+    for (const MapExtent &extent : extents) {
+      writer.put_svarint(extent.lba - lba);
+      writer.put_svarint(extent.pa.addr - addr);
+      writer.put_varint(extent.pa.zone_num);
+      writer.put_varint(extent.len << 1 | extent.pa.alive);
+      lba = extent.lba + extent.len * this->lba_size;
+      addr = extent.pa.addr + extent.len;
     }
-    void *lbas_buf = lbas_group[i].data();
-    uint64_t lbas_num = lbas_group[i].size();
-    void *blocks_buf = blocks_group[i].data();
-    uint64_t blocks_num = blocks_group[i].size();
-    uint64_t num = lbas_num;
-
-    memcpy((void *)final_buf_addr, &num, sizeof(uint64_t));
-    final_buf_addr += sizeof(uint64_t);
-    memcpy((void *)final_buf_addr, lbas_buf, lbas_num * sizeof(uint64_t));
-    final_buf_addr += lbas_num * sizeof(uint64_t);
-    memcpy((void *)final_buf_addr, blocks_buf, blocks_num * sizeof(ZNSBlock));
-    final_buf_addr += blocks_num * sizeof(ZNSBlock);
-  }
-
-  memcpy((void *)final_buf_addr, datazone_buf, dzone_buf_size);
-  final_buf_addr += dzone_buf_size;
-  memcpy((void *)final_buf_addr, logmap_buf, lmap_buf_size);
-  final_buf_addr += lmap_buf_size;
-
-  std::cout << "Data map" << std::endl;
-  if (dmap_buf_size) {
-    // no GC if datamap size is zero.
-    char datamap_buf[dmap_buf_size];
-    map_buf_addr = (uint64_t)datamap_buf;
-    // printf("data zone\n");
-    for (raw_map::iterator iter = datamap.begin(); iter != datamap.end();
-         iter++) {
-      uint64_t lba = iter->first;
-      Addr pa = iter->second;
-      memcpy((void *)map_buf_addr, &lba, sizeof(uint64_t));
-      map_buf_addr += sizeof(uint64_t);
-      memcpy((void *)map_buf_addr, &pa, sizeof(Addr));
-      map_buf_addr += sizeof(Addr);
-    }
-    memcpy((void *)final_buf_addr, datamap_buf, dmap_buf_size);
-  }
-  // printf("data zone end\n");
-  final_buf_addr += dmap_buf_size;
-  printf(
-      "meta data size is %d, slba is %lx, zones num is %d, init code is %d\n",
-      buf_size, last_zone_addr, zones_num, init_code);
-
-  ss_nvme_write_wrapper(this->fd, this->nsid, last_zone_addr, nlb, buf_size,
-                        final_buf);
+    writer.end();
+  }
+
+  uint64_t index_offset = writer.offset();
+  writer.begin(CKPT_INDEX);
+  writer.put_varint(logmap.size());
+  writer.put_varint(index.size());
+  uint64_t region = 0;
+  uint64_t offset = 0;
+  for (auto &entry : index) {
+    writer.put_varint(entry.first - region);
+    writer.put_varint(entry.second - offset);
+    region = entry.first;
+    offset = entry.second;
+  }
+  writer.end();
+
+  bool finished = writer.finish(index_offset);
+  this->stats.dev_bytes_checkpoint += writer.written();
+  if (!finished) {
+    std::cout << "failed to write the checkpoint." << std::endl;
+    return false;
+  }
+  this->checkpoint_zone = target;
+  this->checkpoint_generation = generation;
+  this->journal->checkpointed(ckpt_seq);
+
+  // The older checkpoint is not needed anymore, get its zone ready for
+  // the next checkpoint now rather than when that one is taken.
+  uint32_t next = (target + 1) % FTL_CHECKPOINT_ZONES;
+  ss_device_zone_reset(this->fd, this->nsid, this->checkpoint_zone_slba(next));
+  return true;
 }
 
 #endif
@@ -25,13 +25,24 @@ SOFTWARE.
 #include <pthread.h>
 #include <sys/types.h>
 
+#include <atomic>
 #include <cstdint>
 #include <map>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include "../common/histogram.h"
+#include "../common/memstat.h"
+#include "checkpoint.hpp"
 #include "datazone.hpp"
+#include "gchistory.hpp"
+#include "heat.hpp"
+#include "journal.hpp"
 #include "logzone.hpp"
+#include "ratelimit.hpp"
+#include "stats.hpp"
+#include "zns_device.h"
 
 struct Addr {
   uint64_t addr;
@@ -41,6 +52,42 @@ struct Addr {
 
 using raw_map = std::unordered_map<uint64_t, struct Addr>;
 
+/** A region that got merged this often since the last decay is
+ * considered hot when picking a data zone for it. */
+#define WEAR_HOT_MERGES 2
+
+/** Data zones kept aside as merge destinations for when all the other
+ * data zones are in use. They are not part of the device capacity. */
+#define FTL_RESERVED_ZONES 1
+
+/** Zones at the end of the device that hold the metadata journal */
+#define FTL_JOURNAL_ZONES 2
+
+/** Zones after the journal that checkpoints take turns in, so that the
+ * previous checkpoint is intact while the next one is written. */
+#define FTL_CHECKPOINT_ZONES 2
+
+/** Zones not available for data: the journal ring and the checkpoints */
+#define FTL_META_ZONES (FTL_JOURNAL_ZONES + FTL_CHECKPOINT_ZONES)
+
+/** Block sequence numbers reserved in the journal at a time, so a
+ * synchronous journal write is needed every 4 GiB of 4 KiB blocks. */
+#define FTL_SEQ_BATCH (1 << 20)
+
+/** Log streams, every stream appends to its own open log zone. */
+enum LogStream {
+  /** Default stream, and the one for cold data when separating. */
+  LOG_STREAM_COLD = 0,
+  /** Data that is frequently overwritten according to the HeatTracker */
+  LOG_STREAM_HOT = 1,
+  /** Streams for the lifetime hints passed by zns_udevice_write_hint */
+  LOG_STREAM_SHORT = 2,
+  LOG_STREAM_MEDIUM = 3,
+  LOG_STREAM_LONG = 4,
+  LOG_STREAM_EXTREME = 5,
+  LOG_STREAMS = 6
+};
+
 struct Ftlmap {
   pthread_rwlock_t lock;
   raw_map map;
@@ -51,6 +98,10 @@ class FTL {
   int fd;
   int gc_wmark;
   bool force_reset;
+  /** Opened for inspection, nothing is written and no threads run */
+  bool read_only;
+  /** Why the device could not be opened as -errno, or 0 */
+  int open_error;
   uint32_t zcap;
   uint32_t nsid;
   uint64_t mdts_size;
@@ -62,7 +113,100 @@ class FTL {
   pthread_mutex_t clean_finish_lock;
 
   int log_zones;
-  uint64_t init_code;
+
+  /** Either ZNS_GC_ONDEMAND or ZNS_GC_BACKGROUND */
+  int gc_mode;
+
+  /** Number of free log zones at which the background GC starts
+   * throttling the writers. Always above gc_wmark. */
+  int gc_soft_wmark;
+
+  /** monotonic_microseconds of the last host read or write, used for
+   * idle detection */
+  std::atomic<uint64_t> last_host_io;
+
+  /** Number of writers that are blocked until the GC frees a zone */
+  std::atomic<int> writers_waiting;
+
+  /** Number of host reads in flight, the GC backs off while non-zero */
+  std::atomic<int> reads_inflight;
+
+  /** Moving average of the bytes per second the GC reclaims, 0 when
+   * the GC has not finished a cycle yet. */
+  std::atomic<uint64_t> gc_reclaim_rate;
+
+  /** Paces the idle reclamation of the background GC */
+  TokenBucket *gc_bucket;
+
+  /** Paces the writers when free log zones are running out */
+  TokenBucket *write_bucket;
+
+  /** Route hot and cold writes to different log zones */
+  bool hot_cold;
+
+  /** Update frequency of the logical blocks, only used with hot_cold */
+  HeatTracker *heat;
+
+  /** Write-ahead log of all the changes to the maps since the last
+   * checkpoint. */
+  MetaJournal *journal;
+
+  /** Held while a checkpoint is written */
+  pthread_mutex_t checkpoint_lock;
+
+  /** Wakes the checkpointer once the journal is running out of space,
+   * so that writers do not take the checkpoint themselves. */
+  pthread_mutex_t checkpoint_wake_lock;
+  pthread_cond_t checkpoint_wake;
+  std::atomic<bool> checkpoint_requested;
+  bool checkpointer_exit;
+  std::thread checkpoint_thread;
+
+  /** Checkpoint zone holding the newest checkpoint, and its generation.
+   * The generation goes up with every checkpoint. */
+  uint32_t checkpoint_zone;
+  uint64_t checkpoint_generation;
+  /** Log zones of a checkpoint that was written with another number of
+   * log zones than we have, or 0 if there was none */
+  uint64_t foreign_log_zones;
+
+  /** Bytes of metadata per block, 0 if we do not store BlockMeta */
+  uint16_t meta_size;
+
+  /** Set while lazy restore has regions left in the checkpoint */
+  std::atomic<bool> restore_pending;
+
+  /** Next BlockMeta sequence number */
+  std::atomic<uint64_t> block_seq;
+
+  /** Sequence numbers below block_seq_limit can be handed out, every
+   * range is durable in the journal before it is used, so that a
+   * restart continues above anything that can be on the media.
+   * Checkpoints store block_seq_reserved, which is raised before the
+   * journal entry is logged. Both are protected by seq_lock. */
+  std::atomic<uint64_t> block_seq_limit;
+  std::atomic<uint64_t> block_seq_reserved;
+  pthread_mutex_t seq_lock;
+
+  /** Counters for zns_udevice_get_stats */
+  FtlStats stats;
+
+  /** Latencies for zns_udevice_get_latency, the NVMe commands are timed
+   * for the whole process in nvme_latency. */
+  LatencyHistogram latency[ZNS_LAT_NVME];
+
+  /** Memory the GC holds on to while moving blocks */
+  MemCounter gc_scratch;
+
+  /** Last cycles of the GC for zns_udevice_get_gc_history */
+  GcHistory gc_history;
+
+  /** Journal sequence number up to which everything is durable */
+  std::atomic<uint64_t> durable_seq;
+
+  /** Recent merges per region, halved every zones_data.size() merges */
+  std::unordered_map<uint64_t, uint32_t> region_merges;
+  uint64_t merges_since_decay;
 
   /** Store a list of all the zones in the system */
   std::vector<ZNSLogZone> zones;
@@ -71,10 +215,24 @@ class FTL {
   // get into a circulair dpeendency of header imports
   void* mori;
 
-  FTL(int fd, uint64_t mdts, uint32_t nsid, uint16_t lba_size, int gc_wmark,
-      int log_num, bool force_reset);
+  FTL(int fd, uint64_t mdts, uint32_t nsid, uint16_t lba_size,
+      uint16_t meta_size, const struct zdev_init_params *params);
 
   ~FTL() {
+    if (this->restore_thread.joinable()) this->restore_thread.join();
+    pthread_mutex_lock(&this->checkpoint_wake_lock);
+    this->checkpointer_exit = true;
+    pthread_cond_signal(&this->checkpoint_wake);
+    pthread_mutex_unlock(&this->checkpoint_wake_lock);
+    if (this->checkpoint_thread.joinable()) this->checkpoint_thread.join();
+    pthread_mutex_destroy(&this->checkpoint_wake_lock);
+    pthread_cond_destroy(&this->checkpoint_wake);
+    pthread_mutex_destroy(&this->flush_lock);
+    pthread_cond_destroy(&this->flush_done);
+    delete this->heat;
+    delete this->journal;
+    delete this->gc_bucket;
+    delete this->write_bucket;
     this->zones.clear();
     pthread_rwlock_destroy(&this->log_map.lock);
     pthread_rwlock_destroy(&this->data_map.lock);
@@ -89,37 +247,131 @@ class FTL {
 
   inline bool has_pa(uint64_t);
   int read(uint64_t addr, void* buffer, uint32_t size);
-  int write(uint64_t addr, void* buffer, uint32_t size);
+
+  /** Does the actual work for FTL::read */
+  int read_blocks(uint64_t addr, void* buffer, uint32_t size);
+  int write(uint64_t addr, void* buffer, uint32_t size,
+            int hint = ZNS_WLTH_NOT_SET);
+
+  /** Delay a write in proportion to how close we are to gc_wmark. Only
+   * used by the background GC mode. */
+  void throttle_write(uint32_t size);
 
   // return index of all the free log zones.
   std::vector<int> get_free_logzones();
 
+  /** Make all changes durable, called on shutdown. This only writes
+   * the tail of the journal. */
   void backup();
 
+  /** Make all completed writes durable, both data and mappings. Callers
+   * that arrive while a flush is in progress wait for it and share the
+   * next one, so any number of them costs one journal write and one
+   * device flush. Returns 0 right away if nothing changed, and -EIO if
+   * the journal could not be written. */
+  int flush();
+
+  /** Fill out with the counters, map sizes and free zones. */
+  void get_stats(struct zns_stats* out);
+
+  /** Fill out with the memory used per structure. */
+  void get_memory(struct zns_mem_stats* out);
+
+  /** Summarize the latencies of op, and start over if reset is set. */
+  int get_latency(int op, struct zns_latency* out, bool reset);
+
+  /** Describe up to max zones, the log zones first. Returns the number
+   * of log and data zones. */
+  uint32_t get_zones(struct zns_zone_info* zones, uint32_t max);
+
+  /** Write a snapshot of all the maps to the next checkpoint zone,
+   * which allows the journal zones to be reused. */
+  void checkpoint();
+
+  /** Write out the journal, everything staged if sync is set. Takes a
+   * checkpoint when the journal runs out of space. Returns false if the
+   * entries that were to be written did not make it to the device. */
+  bool commit_journal(bool sync);
+
+  /** Reset a zone the GC is done with and record it in the journal.
+   * Returns false and leaves the zone alone if the journal could not be
+   * made durable first, the next GC cycle tries again. */
+  bool reset_log_zone(ZNSLogZone* zone);
+  bool reset_data_zone(ZNSDataZone* zone);
+
+  /** Reset the data zones whose reset was skipped, GC thread only */
+  void retry_data_zone_resets();
+
   // return index of all the free log zones.
   std::vector<int> get_free_datazones();
 
-  /** Get a free zone with enough space to hold a number of blocks. */
-  ZNSLogZone* get_free_log_zone();
+  /** Get the open log zone of a stream, or pick a new one if it is full.
+   * Returns nullptr if there is no zone left to write to. */
+  ZNSLogZone* get_free_log_zone(int stream);
+
+  /** Decide the log stream of a write based on its lifetime hint, or on
+   * its temperature if the caller did not pass one. */
+  int classify_write(uint64_t lba, uint32_t size, int hint);
+
+  /** Drop a zone that just filled up from the free list, unless the GC
+   * reset it in the meantime and it is no longer open. */
+  void retire_log_zone(ZNSLogZone* zone);
+
+  /** Get an empty data zone, hot regions go to the least worn zone and
+   * cold ones to the most worn zone. Returns nullptr if there is none. */
+  ZNSDataZone* get_free_data_zone(const uint32_t needed, bool hot = false);
+
+  /** Take a zone from the reserved pool, nullptr if it is empty. */
+  ZNSDataZone* take_reserved_zone();
+
+  /** Top the reserved pool up to FTL_RESERVED_ZONES with empty zones. */
+  void refill_reserved_zones();
+
+  /** A free data zone for the GC to copy a region to, or a reserved one
+   * if every zone is in use. nullptr if both ran out even after a
+   * refill, which can happen when earlier resets failed. */
+  ZNSDataZone* get_gc_zone(bool hot);
+
+  /** Whether a region, given the log stream its blocks came from, is
+   * expected to be rewritten soon. Only used by the GC. */
+  bool is_hot_region(uint64_t base_addr, int stream);
 
-  ZNSDataZone* get_free_data_zone(const uint32_t needed);
+  /** Count a merge of the region for is_hot_region. Only used by the GC. */
+  void note_region_merge(uint64_t base_addr);
 
   void insert_logmap(uint64_t lba, uint64_t pa, uint16_t zone_num);
 
+  /** With lazy restore, load the regions the range touches from the
+   * checkpoint if that did not happen yet. Called before every I/O. */
+  void fault_region(uint64_t lba, uint32_t size);
+
+  /** Load every region still in the checkpoint. Runs in the restore
+   * thread, and anything that needs the whole map calls it first. */
+  void finish_restore();
+
   /** Get the number of free regions in our system */
   int16_t get_free_log_regions();
 
   void insert_datamap(uint64_t lba, uint64_t pa, uint16_t zone_num);
 
-  void delete_logmap(uint64_t lba);
+  /** Delete the mapping of lba only if it still points to pa, so that a
+   * write that raced with the GC is not lost. */
+  void delete_logmap(uint64_t lba, uint64_t pa, uint16_t zone_num);
 
   struct Ftlmap log_map;
   struct Ftlmap data_map;
   pthread_rwlock_t zone_lock;
 
   std::vector<ZNSLogZone> zones_log;
-  std::vector<ZNSDataZone> zones_reserved;
+  /** Empty data zones that get_free_data_zone does not hand out. Which
+   * zones are in the pool changes as merges swap them with old zones. */
+  std::vector<ZNSDataZone*> zones_reserved;
   std::vector<ZNSDataZone> zones_data;
+  /** Host reads in flight per data zone, see pin_pba */
+  std::vector<std::atomic<uint32_t>> data_zone_readers;
+  /** Unmapped data zones that still have to be reset, GC thread only
+   * once the constructor is done */
+  std::vector<ZNSDataZone*> unreset_data_zones;
   // return physical page address from log map.
   bool get_ppa(uint64_t, Addr*);
 
@@ -128,12 +380,101 @@ class FTL {
   // return physical block address from data map.
   bool get_pba(uint64_t, Addr*);
 
+  /** Like get_pba, but if the block is found its data zone is not reset
+   * until unpin_data_zone. */
+  bool pin_pba(uint64_t lba, Addr* addr);
+  void unpin_data_zone(uint16_t zone_num);
+
   // Given a base address to check the existence of the data entry.
   bool pba_exist(uint64_t);
 
   pthread_rwlock_t zones_lock;
   std::vector<ZNSLogZone*> free_log_zones;
+
+  /** The log zone each stream is currently appending to, protected by
+   * zones_lock. Streams share a zone when there are not enough left. */
+  std::vector<ZNSLogZone*> open_log_zones;
   std::vector<ZNSDataZone*> free_data_zones;
+
+ private:
+  /** Load the maps from the newest valid checkpoint. Returns false if
+   * there is none, the maps are left empty then. With lazy, only
+   * the index of the log map is loaded and the regions come later. */
+  bool restore_checkpoint(uint64_t* ckpt_seq, bool lazy);
+
+  /** Start LBA of one of the FTL_CHECKPOINT_ZONES */
+  uint64_t checkpoint_zone_slba(uint32_t index) const;
+
+  /** Decode the header of a checkpoint, false if it is not one of ours.
+   * seq and block_seq may be nullptr. */
+  bool read_checkpoint_header(CheckpointReader* reader, uint64_t* generation,
+                              uint64_t* seq, uint64_t* block_seq = nullptr);
+
+  /** Decode the sections after the header, false if one is corrupt. */
+  bool read_checkpoint(CheckpointReader* reader, bool lazy);
+
+  /** Decode the log map of a region from its CKPT_REGION section. */
+  bool decode_region(CheckpointReader* reader, uint64_t region,
+                     raw_map* entries);
+
+  /** Add the log map of a region to the maps, with what the journal had
+   * for it applied on top. */
+  void insert_region(uint64_t region, raw_map* entries);
+
+  /** Load a region with lazy restore, restore_lock must be held. */
+  void load_pending_region(CheckpointReader* reader,
+                           std::map<uint64_t, uint64_t>::iterator region);
+
+  /** Protects everything below that lazy restore uses */
+  pthread_mutex_t restore_lock;
+
+  /** Offset in the checkpoint of every region not loaded yet */
+  std::map<uint64_t, uint64_t> pending_regions;
+
+  /** Journal entries of the regions not loaded yet, in order */
+  std::unordered_map<uint64_t, std::vector<JournalEntry>> deferred_entries;
+
+  /** Log zones that were empty on restart, by zone number */
+  std::vector<bool> empty_log_zones;
+
+  /** Where the checkpoint being restored is, in checkpoint_zone */
+  uint64_t checkpoint_slba;
+  uint64_t checkpoint_end;
+
+  std::thread restore_thread;
+
+  /** Group commit of flush, protects flushing */
+  pthread_mutex_t flush_lock;
+  pthread_cond_t flush_done;
+  bool flushing;
+
+  /** Take count block sequence numbers, reserving more in the journal
+   * when needed. Returns false if the reservation is not durable. */
+  bool next_block_seq(uint64_t count, uint64_t* seq);
+
+  /** Body of checkpoint, checkpoint_lock must be held. Returns false if
+   * the checkpoint could not be written. Host writes and the GC go on
+   * meanwhile, so the checkpoint holds every journal entry up to its
+   * sequence number and possibly some of the ones after it. */
+  bool write_checkpoint();
+
+  /** Have the checkpointer take a checkpoint, without waiting for it */
+  void request_checkpoint();
+
+  /** Body of checkpoint_thread */
+  void checkpointer();
+
+  /** Apply a change read back from the journal at startup. */
+  void replay_entry(const JournalEntry& entry);
+
+  /** Drop whatever the metadata claims is stored in zones that are
+   * empty on the device. */
+  void drop_empty_zones();
+
+  /** Rebuild all the maps from the BlockMeta of every written block. A
+   * data zone that loses its region to another one is left as it is and
+   * queued in unreset_data_zones. */
+  void rebuild_from_media();
 };
 
 #endif
@@ -41,7 +41,10 @@ SOFTWARE.
  */
 #include "ftlgc.hpp"
 
+#include <errno.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <chrono>
@@ -52,7 +55,12 @@ SOFTWARE.
 #include <unordered_map>
 #include <vector>
 
+#include "../common/lockstat.h"
+#include "../common/memstat.h"
 #include "../common/nvmewrappers.h"
+#include "../common/probes.h"
+#include "../common/trace.h"
+#include "../common/utils.h"
 #include "datazone.hpp"
 #include "znsblock.hpp"
 #include "zone.hpp"
@@ -63,6 +71,10 @@ Calliope::Calliope(FTL *ftl, pthread_cond_t *cond, pthread_mutex_t *mutex,
                    pthread_cond_t *clean_cond, pthread_mutex_t *clean_lock) {
   this->ftl = ftl;
   this->can_reap = false;
+  this->chunk_blocks = 0;
+  this->cycle = {};
+  this->select_ticks = 0;
+  this->starved = false;
   this->need_gc = cond;
   this->need_gc_lock = mutex;
   this->clean_cond = clean_cond;
@@ -70,39 +82,124 @@ Calliope::Calliope(FTL *ftl, pthread_cond_t *cond, pthread_mutex_t *mutex,
 }
 
 bool Calliope::select_log_zone(uint16_t *zone_num) {
-  // Select the region with the most undead blocks compared to the
-  // total capacity. This safes on the copies we need to do.
+  // Select the full region with the fewest live blocks. This safes on
+  // the copies we need to do, and lets zones that only held hot data
+  // go first since most of their blocks have been overwritten already.
+  uint64_t start = clock_ticks();
+  bool found = false;
+  uint64_t min_alive = UINT64_MAX;
   for (uint16_t i = 0; i < ftl->zones_log.size(); i++) {
     ZNSLogZone *current = &ftl->zones_log[i];
-    if (current->is_full()) {
+    if (!current->is_full()) continue;
+
+    uint64_t alive = current->get_alive_capacity();
+    if (alive < min_alive) {
+      min_alive = alive;
       *zone_num = i;
-      return true;
+      found = true;
     }
   }
 
   // If we cannot find something decent to do, we flag the thread to
   // just keep going.
-  // this->can_reap = max_util != 0.0f;
-  return false;
+  this->can_reap = found;
+  this->select_ticks = clock_ticks() - start;
+  return found;
 }
 
 bool compare_block(ZNSBlock *block1, ZNSBlock *block2) {
   return (block1->logical_address < block2->logical_address);
 }
 
+bool Calliope::is_urgent() {
+  return this->ftl->writers_waiting > 0 ||
+         this->ftl->get_free_log_regions() <= this->ftl->gc_soft_wmark;
+}
+
+bool Calliope::should_reap() {
+  if (this->ftl->gc_mode != ZNS_GC_BACKGROUND) return true;
+  if (this->is_urgent()) return true;
+
+  // Nobody is waiting for us, so only reclaim when the host is idle.
+  uint64_t last_io = this->ftl->last_host_io.load(std::memory_order_relaxed);
+  return monotonic_microseconds() - last_io >= GC_IDLE_US;
+}
+
+void Calliope::pace(uint32_t bytes) {
+  if (this->ftl->gc_mode != ZNS_GC_BACKGROUND || this->is_urgent()) return;
+  this->ftl->gc_bucket->consume(bytes);
+}
+
+void Calliope::preempt_point() {
+  if (++this->chunk_blocks < GC_CHUNK_BLOCKS) return;
+  this->chunk_blocks = 0;
+
+  // Reads go first, unless writers are stuck until we free a zone.
+  uint64_t waited = 0;
+  while (this->ftl->reads_inflight > 0 && this->ftl->writers_waiting == 0 &&
+         waited < GC_MAX_YIELD_US) {
+    usleep(GC_YIELD_US);
+    waited += GC_YIELD_US;
+  }
+}
+
+void Calliope::update_reclaim_rate(uint64_t bytes, uint64_t duration_us,
+                                   bool paced) {
+  if (duration_us == 0) duration_us = 1;
+  uint64_t rate = bytes * 1000000 / duration_us;
+  uint64_t old_rate = this->ftl->gc_reclaim_rate.load();
+  // Idle cycles are paced by the bucket, so they say nothing about how
+  // fast we can reclaim under pressure.
+  if (old_rate != 0 && paced) return;
+  this->ftl->gc_reclaim_rate = old_rate == 0 ? rate : (3 * old_rate + rate) / 4;
+}
+
+void Calliope::back_off() {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_nsec += GC_STARVED_MS * 1000000L;
+  deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+  deadline.tv_nsec %= 1000000000L;
+  pthread_mutex_lock(this->need_gc_lock);
+  int ret = 0;
+  // Writers keep signalling while they wait for us, only a free data
+  // zone, the deadline or deinit ends the wait.
+  while (ret != ETIMEDOUT && !death_sensei &&
+         this->ftl->get_free_data_zone(this->ftl->zcap, true) == nullptr) {
+    ret = pthread_cond_timedwait(this->need_gc, this->need_gc_lock,
+                                 &deadline);
+  }
+  pthread_mutex_unlock(this->need_gc_lock);
+}
+
 uint16_t Calliope::wait_for_mutex() {
   uint16_t log_zone_num;
-  while (!this->select_log_zone(&log_zone_num)) {
+  // The victim that was left behind would be picked again right away.
+  if (this->starved) {
+    this->starved = false;
+    this->back_off();
+    if (death_sensei) return -1;
+  }
+  while (!this->should_reap() || !this->select_log_zone(&log_zone_num)) {
     // if there is no full zone exists, let the consumer consumes.
     pthread_mutex_lock(this->clean_lock);
     pthread_cond_signal(this->clean_cond);
     pthread_mutex_unlock(this->clean_lock);
 
     pthread_mutex_lock(this->need_gc_lock);
-    pthread_cond_wait(this->need_gc, this->need_gc_lock);
+    if (this->ftl->gc_mode == ZNS_GC_BACKGROUND) {
+      // Wake up every now and then to check whether the host went idle.
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += GC_POLL_MS * 1000000L;
+      deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+      deadline.tv_nsec %= 1000000000L;
+      pthread_cond_timedwait(this->need_gc, this->need_gc_lock, &deadline);
+    } else {
+      pthread_cond_wait(this->need_gc, this->need_gc_lock);
+    }
     pthread_mutex_unlock(this->need_gc_lock);
     if (death_sensei) return -1;
-    this->select_log_zone(&log_zone_num);
   }
 
   return log_zone_num;
@@ -131,7 +228,7 @@ void Calliope::get_blocks_group(
   }
 }
 
-void Calliope::merge_old_zone(ZNSLogZone *reapable, uint64_t base_addr,
+bool Calliope::merge_old_zone(ZNSLogZone *reapable, uint64_t base_addr,
                               std::vector<ZNSBlock *> &log_blocks) {
   // try to merge the old zone.
   // append until can not append, after can't append:
@@ -140,29 +237,39 @@ void Calliope::merge_old_zone(ZNSLogZone *reapable, uint64_t base_addr,
   this->ftl->get_pba_by_base(base_addr, &addr);
   uint16_t zone_num = addr.zone_num;
   ZNSDataZone *data_zone = &this->ftl->zones_data[zone_num];
-  ZNSDataZone *new_data_zone = this->ftl->get_free_data_zone(this->ftl->zcap);
-  if (new_data_zone == nullptr) {
-    printf("failed!\n");
-  }
-  // std::cout << "Reap!" << std::endl;
-  // if (new_data_zone == nullptr) {
-  // use the reserved zone.
-  //  new_data_zone = &this->ftl->zones_reserved[0];
-  //}
+  bool hot = this->ftl->is_hot_region(base_addr, reapable->stream);
+  // If every data zone is in use this is a reserved zone. The old zone
+  // takes its place in the pool once it has been reset.
+  ZNSDataZone *new_data_zone = this->ftl->get_gc_zone(hot);
+  if (new_data_zone == nullptr) return false;
+  this->ftl->note_region_merge(base_addr);
+  new_data_zone->hot = hot;
 
   uint32_t block_index;
   ZNSBlock *block;
   block = log_blocks.front();
   block_index = (block->logical_address / ftl->lba_size) % ftl->zcap;
+  std::vector<ZNSBlock *> merged;
+  // The copies keep the BlockMeta of the original.
+  std::vector<char> meta(std::max(this->ftl->meta_size, (uint16_t)1));
   // std::vector<physaddr_t> zone_addrs = data_zone->get_nonfree_blocks();
   for (uint32_t index = 0; index < data_zone->block_map.size(); index++) {
     char buffer[this->ftl->lba_size];
     uint32_t read_size;
     if (block_index == index) {
-      reapable->read(block->address, &buffer, ftl->lba_size, &read_size);
-      new_data_zone->write_until(&buffer, ftl->lba_size, index);
+      ScopedTrace trace(TRACE_GC_COPY, new_data_zone->zone_id,
+                        block->logical_address, ftl->lba_size);
+      this->pace(ftl->lba_size);
+      this->preempt_point();
+      reapable->read(block->address, &buffer, ftl->lba_size, &read_size,
+                     meta.data());
+      uint64_t wp = new_data_zone->get_wp();
+      new_data_zone->write_until(&buffer, ftl->lba_size, index, meta.data());
+      this->count_copy(new_data_zone, wp, &this->ftl->stats.dev_bytes_gc_merge);
+      new_data_zone->checksums.carry(index, reapable->checksums,
+                                     block->address - reapable->base);
       log_blocks.erase(log_blocks.begin());
-      ftl->delete_logmap(block->logical_address);
+      merged.push_back(block);
       if (log_blocks.size() > 0) {
         block = log_blocks.front();
         block_index = (block->logical_address / ftl->lba_size) % ftl->zcap;
@@ -170,40 +277,130 @@ void Calliope::merge_old_zone(ZNSLogZone *reapable, uint64_t base_addr,
         // new_data_zone->zone_id <<  std::endl;
       }
     } else if (data_zone->block_map[index]) {
+      ScopedTrace trace(TRACE_GC_COPY, new_data_zone->zone_id,
+                        (base_addr + index) * ftl->lba_size, ftl->lba_size);
+      this->pace(ftl->lba_size);
+      this->preempt_point();
       data_zone->read(data_zone->base + index, &buffer, ftl->lba_size,
-                      &read_size);
-      new_data_zone->write_until(&buffer, ftl->lba_size, index);
+                      &read_size, meta.data());
+      uint64_t wp = new_data_zone->get_wp();
+      new_data_zone->write_until(&buffer, ftl->lba_size, index, meta.data());
+      this->count_copy(new_data_zone, wp, &this->ftl->stats.dev_bytes_gc_merge);
+      new_data_zone->checksums.carry(index, data_zone->checksums, index);
     }
   }
 
-  this->ftl->insert_datamap(base_addr, data_zone->base,
+  // Switching the mapping is the commit point of the merge, until then
+  // reads are served by the log and the old zone, which are intact.
+  this->ftl->insert_datamap(base_addr, new_data_zone->base,
                             new_data_zone->zone_id - ftl->log_zones);
+  for (ZNSBlock *block : merged) {
+    this->ftl->delete_logmap(block->logical_address, block->address,
+                             reapable->zone_id);
+  }
   // ftl->data_map.map.count(base_addr));
-  data_zone->reset();
+  this->ftl->reset_data_zone(data_zone);
+  return true;
 }
 
-void Calliope::insert_new_zone(ZNSLogZone *reapable, uint64_t base_addr,
+bool Calliope::insert_new_zone(ZNSLogZone *reapable, uint64_t base_addr,
                                std::vector<ZNSBlock *> &log_blocks) {
   // get a new data zone and insert.
   // new, no need to invalidate the block, just append to the new zone.
-  ZNSDataZone *data_zone = this->ftl->get_free_data_zone(this->ftl->zcap);
+  bool hot = this->ftl->is_hot_region(base_addr, reapable->stream);
+  ZNSDataZone *data_zone = this->ftl->get_gc_zone(hot);
+  if (data_zone == nullptr) return false;
+  data_zone->hot = hot;
+  std::vector<char> meta(std::max(this->ftl->meta_size, (uint16_t)1));
   for (uint16_t i = 0; i < log_blocks.size(); i++) {
     ZNSBlock *block = log_blocks[i];
     // printf("Block addresses: %d\n", block->logical_address);
     uint64_t block_lba = block->logical_address / ftl->lba_size;
     uint16_t index = block_lba % this->ftl->zcap;
+    ScopedTrace trace(TRACE_GC_COPY, data_zone->zone_id, block->logical_address,
+                      this->ftl->lba_size);
     char buffer[this->ftl->lba_size];
     uint32_t read_size;
-    reapable->read(block->address, &buffer, this->ftl->lba_size, &read_size);
-    data_zone->write_until(buffer, read_size, index);
-    this->ftl->delete_logmap(block->logical_address);
+    this->pace(this->ftl->lba_size);
+    this->preempt_point();
+    reapable->read(block->address, &buffer, this->ftl->lba_size, &read_size,
+                   meta.data());
+    uint64_t wp = data_zone->get_wp();
+    data_zone->write_until(buffer, read_size, index, meta.data());
+    this->count_copy(data_zone, wp, &this->ftl->stats.dev_bytes_gc_insert);
+    data_zone->checksums.carry(index, reapable->checksums,
+                               block->address - reapable->base);
     // printf("Address written to data map %d\n", block->logical_address);
   }
   this->ftl->insert_datamap(base_addr, data_zone->base,
                             data_zone->zone_id - ftl->log_zones);
+  for (ZNSBlock *block : log_blocks) {
+    this->ftl->delete_logmap(block->logical_address, block->address,
+                             reapable->zone_id);
+  }
+  return true;
+}
+
+void Calliope::count_copy(ZNSDataZone *zone, uint64_t wp,
+                          std::atomic<uint64_t> *bytes) {
+  uint64_t blocks = zone->get_wp() - wp;
+  this->cycle.blocks_read++;
+  if (blocks == 0) return;
+  *bytes += this->ftl->lba_size;
+  this->ftl->stats.dev_bytes_padding += (blocks - 1) * this->ftl->lba_size;
+  this->cycle.blocks_written++;
+  this->cycle.blocks_padded += blocks - 1;
+}
+
+void Calliope::level_wear() {
+  if (this->is_urgent()) return;
+
+  // Regions that are not merged any more keep their data zone forever,
+  // so a young zone holding cold data never gets to age. Find the
+  // youngest such zone and swap its data to the most worn free zone.
+  // Only the GC changes the data map, so the regions stay put.
+  ZNSDataZone *young = nullptr;
+  uint64_t young_base = 0;
+  for (ZNSDataZone &zone : this->ftl->zones_data) {
+    if (zone.region == UINT64_MAX) continue;
+    if (this->ftl->is_hot_region(zone.region, LOG_STREAM_COLD)) continue;
+    if (young == nullptr || zone.reset_count < young->reset_count) {
+      young = &zone;
+      young_base = zone.region;
+    }
+  }
+  ZNSDataZone *worn = this->ftl->get_free_data_zone(this->ftl->zcap, false);
+  if (young == nullptr || worn == nullptr ||
+      worn->reset_count < young->reset_count + WEAR_LEVEL_THRESHOLD) {
+    return;
+  }
+
+  std::vector<char> meta(std::max(this->ftl->meta_size, (uint16_t)1));
+  for (uint32_t index = 0; index < young->block_map.size(); index++) {
+    if (!young->block_map[index]) continue;
+    ScopedTrace trace(TRACE_GC_COPY, worn->zone_id,
+                      (young_base + index) * this->ftl->lba_size,
+                      this->ftl->lba_size);
+    char buffer[this->ftl->lba_size];
+    uint32_t read_size;
+    this->pace(this->ftl->lba_size);
+    this->preempt_point();
+    young->read(young->base + index, &buffer, this->ftl->lba_size, &read_size,
+                meta.data());
+    uint64_t wp = worn->get_wp();
+    worn->write_until(&buffer, this->ftl->lba_size, index, meta.data());
+    this->count_copy(worn, wp, &this->ftl->stats.dev_bytes_wear_level);
+    worn->checksums.carry(index, young->checksums, index);
+  }
+  this->ftl->insert_datamap(young_base, worn->base,
+                            worn->zone_id - this->ftl->log_zones);
+  this->ftl->reset_data_zone(young);
 }
 
 void Calliope::reap() {
+  // Picking a victim needs the block maps of all the log zones.
+  this->ftl->finish_restore();
+  trace_thread_name("gc");
   while (true) {
     uint16_t log_zone_num = this->wait_for_mutex();
 
@@ -216,28 +413,83 @@ void Calliope::reap() {
     // Get the zone with the highest win of free blocks, if none is
     // found we just wait until the next loop. This can happen if no
     // data is overwritten
+    uint64_t cycle_start = clock_ticks();
+    if (this->ftl->heat != nullptr) this->ftl->heat->sweep();
+    bool paced = this->ftl->gc_mode == ZNS_GC_BACKGROUND && !this->is_urgent();
     ZNSLogZone *reapable = &this->ftl->zones_log[log_zone_num];
+    this->cycle = {};
+    this->cycle.cycle = this->ftl->stats.gc_cycles;
+    this->cycle.start_us = monotonic_microseconds();
+    this->cycle.victim_zone = reapable->zone_id;
+    this->cycle.victim_capacity = reapable->capacity;
+    this->cycle.victim_valid = reapable->get_alive_capacity();
+    this->cycle.select_ns = ticks_to_ns(this->select_ticks);
+    this->cycle.paced = paced;
+    this->ftl->retry_data_zone_resets();
     std::unordered_map<uint64_t, std::vector<ZNSBlock *>> blocks_group =
         std::unordered_map<uint64_t, std::vector<ZNSBlock *>>();
     this->get_blocks_group(reapable, blocks_group);
+    this->cycle.groups = blocks_group.size();
+    uint64_t scratch_bytes = hash_map_bytes(blocks_group);
+    for (auto &group : blocks_group) {
+      scratch_bytes += vector_bytes(group.second);
+    }
+    MemScope scratch(&this->ftl->gc_scratch, scratch_bytes);
+    uint64_t phase_start = clock_ticks();
+    this->cycle.group_ns = ticks_to_ns(phase_start - cycle_start);
+    STOSYS_PROBE3(gc_victim, reapable->zone_id, this->cycle.victim_valid,
+                  reapable->capacity);
 
     // find the data zone firstly, if find the correct one, try to append, if
     // failed, partial merge. if it doesn't find a data zone, write a new one.
+    bool moved_all = true;
     for (auto &group : blocks_group) {
       uint64_t base_addr = group.first;
       std::vector<ZNSBlock *> log_blocks = group.second;
 
-      if (this->ftl->pba_exist(base_addr)) {
-        this->merge_old_zone(reapable, base_addr, log_blocks);
+      bool merge = this->ftl->pba_exist(base_addr);
+      STOSYS_PROBE4(gc_merge, reapable->zone_id, base_addr, log_blocks.size(),
+                    merge);
+      if (merge && this->merge_old_zone(reapable, base_addr, log_blocks)) {
+        this->cycle.merges++;
+      } else if (!merge &&
+                 this->insert_new_zone(reapable, base_addr, log_blocks)) {
+        this->cycle.inserts++;
       } else {
-        this->insert_new_zone(reapable, base_addr, log_blocks);
+        // The blocks stay in the log zone until a data zone frees up.
+        moved_all = false;
       }
+      uint64_t phase_end = clock_ticks();
+      uint64_t &phase_ns = merge ? this->cycle.merge_ns : this->cycle.insert_ns;
+      phase_ns += ticks_to_ns(phase_end - phase_start);
+      phase_start = phase_end;
     }
+    this->ftl->refill_reserved_zones();
 
-    reapable->reset();
-    pthread_rwlock_wrlock(&this->ftl->zones_lock);
-    this->ftl->free_log_zones.push_back(reapable);
-    pthread_rwlock_unlock(&this->ftl->zones_lock);
+    // A zone that could not be reset stays full, so the next cycle picks
+    // it again, as it does when blocks were left behind.
+    this->starved = !moved_all;
+    if (moved_all && this->ftl->reset_log_zone(reapable)) {
+      profiled_wrlock(&this->ftl->zones_lock, LOCK_ZONES);
+      this->ftl->free_log_zones.push_back(reapable);
+      profiled_unlock(&this->ftl->zones_lock, LOCK_ZONES);
+    }
+    uint64_t cycle_ticks = clock_ticks() - cycle_start;
+    this->ftl->latency[ZNS_LAT_GC_CYCLE].record(cycle_ticks);
+    if (tracing()) {
+      trace_record(TRACE_GC_CYCLE, reapable->zone_id, reapable->base, 0,
+                   cycle_start, cycle_start + cycle_ticks);
+    }
+    this->update_reclaim_rate(reapable->capacity * this->ftl->lba_size,
+                              ticks_to_ns(cycle_ticks) / 1000, paced);
+    this->ftl->stats.gc_cycles++;
+    this->cycle.reset_ns = ticks_to_ns(clock_ticks() - phase_start);
+    phase_start = clock_ticks();
+    this->level_wear();
+    uint64_t cycle_end = clock_ticks();
+    this->cycle.wear_level_ns = ticks_to_ns(cycle_end - phase_start);
+    this->cycle.total_ns = ticks_to_ns(cycle_end - cycle_start);
+    this->ftl->gc_history.add(this->cycle);
   }
 }
 
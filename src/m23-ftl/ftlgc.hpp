@@ -32,6 +32,38 @@ SOFTWARE.
 #include "znsblock.hpp"
 #include "zone.hpp"
 
+/** Time without host I/O after which the background GC considers the
+ * device to be idle and starts reclaiming full log zones. */
+#define GC_IDLE_US 50000
+
+/** Interval at which a sleeping background GC checks for idleness. */
+#define GC_POLL_MS 10
+
+/** Longest the GC waits for a data zone to free up after a cycle that
+ * could not move all of its victim, before it tries again. */
+#define GC_STARVED_MS 100
+
+/** Default bandwidth budget of the idle reclamation in MiB/s. */
+#define GC_DEFAULT_RATE_MBPS 64
+
+/** How much faster than the GC the writers may go at the soft
+ * watermark, see FTL::throttle_write. */
+#define GC_THROTTLE_SLACK 3.0
+
+/** Number of blocks the GC copies before checking for host reads. */
+#define GC_CHUNK_BLOCKS 16
+
+/** Sleep between checks while the GC waits for host reads to drain. */
+#define GC_YIELD_US 20
+
+/** Longest time the GC backs off per chunk, so that a steady stream of
+ * reads cannot starve it. */
+#define GC_MAX_YIELD_US 2000
+
+/** Difference in resets between the most worn free data zone and the
+ * youngest zone holding cold data at which the GC migrates the data. */
+#define WEAR_LEVEL_THRESHOLD 8
+
 extern bool death_sensei;
 
 class Calliope {
@@ -63,9 +95,42 @@ class Calliope {
 
  private:
   uint16_t wait_for_mutex();
-  void insert_new_zone(ZNSLogZone *reapable, uint64_t base_addr,
+
+  /** Wait on need_gc until a data zone is free again, or for at most
+   * GC_STARVED_MS, after a cycle that ran out of data zones. */
+  void back_off();
+
+  /** Whether the GC should reclaim a zone right now. Always true for
+   * the on-demand GC, the background GC waits for pressure or idleness. */
+  bool should_reap();
+
+  /** True if writers are (about to be) blocked on the GC. */
+  bool is_urgent();
+
+  /** Rate limit the copies done while reclaiming in the background. */
+  void pace(uint32_t bytes);
+
+  /** Called for every copied block, at the end of each chunk of
+   * GC_CHUNK_BLOCKS the GC backs off while host reads are queued. */
+  void preempt_point();
+
+  /** Fold the duration of a finished cycle into ftl->gc_reclaim_rate */
+  void update_reclaim_rate(uint64_t bytes, uint64_t duration_us, bool paced);
+
+  /** Account a block that write_until copied to zone, which was at wp
+   * before, along with the padding written in front of it. Also counts
+   * towards the blocks of the current cycle. */
+  void count_copy(ZNSDataZone *zone, uint64_t wp,
+                  std::atomic<uint64_t> *bytes);
+
+  /** Static wear leveling, moves cold data off young data zones. */
+  void level_wear();
+  /** Move the blocks of a region out of the log zone, into a new data
+   * zone or merged with its current one. Returns false, without changing
+   * anything, if there was no data zone to copy to. */
+  bool insert_new_zone(ZNSLogZone *reapable, uint64_t base_addr,
                        std::vector<ZNSBlock *> &log_blocks);
-  void merge_old_zone(ZNSLogZone *reapable, uint64_t base_addr,
+  bool merge_old_zone(ZNSLogZone *reapable, uint64_t base_addr,
                       std::vector<ZNSBlock *> &log_blocks);
 
   void get_blocks_group(
@@ -78,6 +143,18 @@ class Calliope {
   // replaced using a NULL value.
   bool can_reap;
 
+  // Blocks copied since the last preemption point.
+  uint32_t chunk_blocks;
+
+  // Profile of the running cycle, added to ftl->gc_history at its end.
+  struct zns_gc_record cycle;
+
+  // Time the last select_log_zone took.
+  uint64_t select_ticks;
+
+  // The last cycle left blocks behind for want of a data zone.
+  bool starved;
+
   pthread_cond_t *clean_cond;
   pthread_mutex_t *clean_lock;
 };
@@ -0,0 +1,48 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "gchistory.hpp"
+
+#include <algorithm>
+
+GcHistory::GcHistory() {
+  this->lock = PTHREAD_MUTEX_INITIALIZER;
+  this->records.resize(GC_HISTORY_CYCLES);
+  this->added = 0;
+}
+
+void GcHistory::add(const struct zns_gc_record &record) {
+  pthread_mutex_lock(&this->lock);
+  this->records[this->added % this->records.size()] = record;
+  this->added++;
+  pthread_mutex_unlock(&this->lock);
+}
+
+uint32_t GcHistory::get(struct zns_gc_record *out, uint32_t max) {
+  pthread_mutex_lock(&this->lock);
+  uint64_t kept = std::min<uint64_t>(this->added, this->records.size());
+  uint32_t count = std::min<uint64_t>(kept, max);
+  for (uint64_t i = this->added - count; i < this->added; i++) {
+    *out++ = this->records[i % this->records.size()];
+  }
+  pthread_mutex_unlock(&this->lock);
+  return count;
+}
@@ -0,0 +1,58 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_GC_HISTORY_H
+#define STOSYS_PROJECT_GC_HISTORY_H
+#pragma once
+
+#include <pthread.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "zns_device.h"
+
+/** Number of GC cycles kept for zns_udevice_get_gc_history */
+#define GC_HISTORY_CYCLES 1024
+
+/** Ring buffer of the last GC_HISTORY_CYCLES cycles of the GC. The GC
+ * adds a record per cycle, so a mutex is cheap enough. */
+class GcHistory {
+ public:
+  GcHistory();
+
+  ~GcHistory() { pthread_mutex_destroy(&this->lock); }
+
+  /** Keep record, dropping the oldest one if the history is full. */
+  void add(const struct zns_gc_record &record);
+
+  /** Copy the last up to max records to out, oldest first. Returns the
+   * number of records copied. */
+  uint32_t get(struct zns_gc_record *out, uint32_t max);
+
+ private:
+  pthread_mutex_t lock;
+  std::vector<struct zns_gc_record> records;
+  /** Records added so far, the next one goes to added % size */
+  uint64_t added;
+};
+
+#endif
@@ -0,0 +1,100 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "heat.hpp"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "../common/memstat.h"
+
+HeatTracker::HeatTracker(uint64_t decay_writes) {
+  this->lock = PTHREAD_MUTEX_INITIALIZER;
+  this->decay_writes = decay_writes ? decay_writes : 1;
+  this->writes = 0;
+  this->epoch = 0;
+  this->swept = 0;
+}
+
+uint32_t HeatTracker::decay(Heat *heat) const {
+  uint32_t age = this->epoch - heat->epoch;
+  heat->count = age >= 32 ? 0 : heat->count >> age;
+  heat->epoch = this->epoch;
+  return heat->count;
+}
+
+bool HeatTracker::record(uint64_t block) {
+  pthread_mutex_lock(&this->lock);
+  if (++this->writes % this->decay_writes == 0) this->epoch++;
+
+  Heat *heat = &this->heat[block / HEAT_CHUNK_BLOCKS];
+  this->decay(heat);
+  heat->count++;
+  bool hot = heat->count > HEAT_CHUNK_BLOCKS;
+  pthread_mutex_unlock(&this->lock);
+  return hot;
+}
+
+uint32_t HeatTracker::temperature(uint64_t block) {
+  pthread_mutex_lock(&this->lock);
+  uint32_t count = 0;
+  auto found = this->heat.find(block / HEAT_CHUNK_BLOCKS);
+  if (found != this->heat.end()) count = this->decay(&found->second);
+  pthread_mutex_unlock(&this->lock);
+  return count;
+}
+
+void HeatTracker::sweep() {
+  pthread_mutex_lock(&this->lock);
+  if (this->swept == this->epoch) {
+    pthread_mutex_unlock(&this->lock);
+    return;
+  }
+  this->swept = this->epoch;
+  std::vector<uint64_t> cold;
+  for (size_t bucket = 0; bucket < this->heat.bucket_count();) {
+    size_t end =
+        std::min(bucket + HEAT_SWEEP_BUCKETS, this->heat.bucket_count());
+    for (; bucket < end; bucket++) {
+      for (auto it = this->heat.begin(bucket); it != this->heat.end(bucket);
+           it++) {
+        if (this->decay(&it->second) == 0) cold.push_back(it->first);
+      }
+    }
+    for (uint64_t chunk : cold) this->heat.erase(chunk);
+    cold.clear();
+    // Writers may rehash the table in between, which at worst makes this
+    // sweep miss a few chunks until the next one.
+    pthread_mutex_unlock(&this->lock);
+    pthread_mutex_lock(&this->lock);
+  }
+  pthread_mutex_unlock(&this->lock);
+}
+
+uint64_t HeatTracker::memory_bytes() {
+  pthread_mutex_lock(&this->lock);
+  uint64_t bytes = hash_map_bytes(this->heat);
+  pthread_mutex_unlock(&this->lock);
+  return bytes;
+}
@@ -0,0 +1,85 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_HEAT_H
+#define STOSYS_PROJECT_HEAT_H
+#pragma once
+
+#include <pthread.h>
+
+#include <cstdint>
+#include <unordered_map>
+
+/** Number of consecutive blocks that share a single temperature. */
+#define HEAT_CHUNK_BLOCKS 16
+
+/** Hash buckets a sweep looks at before it lets writers in again. */
+#define HEAT_SWEEP_BUCKETS 1024
+
+/** Tracks the update frequency of the logical address space with a
+ * decaying counter per chunk of HEAT_CHUNK_BLOCKS blocks. Every
+ * decay_writes block writes the counters are halved, so a chunk is hot
+ * when it has been written more often than it has blocks within the
+ * last few decay periods, i.e. when it is being overwritten. Counters
+ * decay lazily when they are touched, cold chunks are only dropped by
+ * sweep. */
+class HeatTracker {
+ public:
+  explicit HeatTracker(uint64_t decay_writes);
+
+  ~HeatTracker() { pthread_mutex_destroy(&this->lock); }
+
+  /** Account for a write to the given block and return whether the
+   * chunk it belongs to is hot. */
+  bool record(uint64_t block);
+
+  /** Returns the current decayed counter of the chunk of the block. */
+  uint32_t temperature(uint64_t block);
+
+  /** Forget the chunks that cooled down completely, so the table only
+   * holds the recently written part of the address space. Does nothing
+   * if no decay period passed since the last sweep. Meant for a
+   * background thread, the lock is dropped every HEAT_SWEEP_BUCKETS
+   * buckets. */
+  void sweep();
+
+  /** Heap bytes of the counters */
+  uint64_t memory_bytes();
+
+ private:
+  struct Heat {
+    uint32_t count;
+    uint32_t epoch;
+  };
+
+  /** Apply the pending decay to a counter, lock must be held. */
+  uint32_t decay(Heat *heat) const;
+
+  pthread_mutex_t lock;
+  std::unordered_map<uint64_t, Heat> heat;
+  uint64_t decay_writes;
+  uint64_t writes;
+  uint32_t epoch;
+  /** The epoch of the last sweep */
+  uint32_t swept;
+};
+
+#endif
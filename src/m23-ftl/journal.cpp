@@ -0,0 +1,293 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "journal.hpp"
+
+#include <libnvme.h>
+#include <nvme/ioctl.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include "../common/crc32c.h"
+#include "../common/memstat.h"
+#include "../common/nvmewrappers.h"
+#include "../common/trace.h"
+#include "recovery.hpp"
+
+MetaJournal::MetaJournal(int fd, uint32_t nsid, uint16_t lba_size,
+                         uint64_t mdts, uint64_t first_slba, uint64_t zcap,
+                         uint32_t nzones) {
+  this->fd = fd;
+  this->nsid = nsid;
+  this->lba_size = lba_size;
+  this->mdts = mdts;
+  this->zcap = zcap;
+  this->entries_per_block =
+      (lba_size - sizeof(JournalHeader)) / sizeof(JournalEntry);
+  this->lock = PTHREAD_MUTEX_INITIALIZER;
+  this->io_lock = PTHREAD_MUTEX_INITIALIZER;
+  this->next_seq = 1;
+  this->pending_seq = 0;
+  this->bytes_written = 0;
+  this->current = 0;
+  for (uint32_t i = 0; i < nzones; i++) {
+    uint64_t slba = first_slba + i * zcap;
+    this->ring.push_back(RingZone{.slba = slba, .wp = slba, .max_seq = 0});
+  }
+}
+
+MetaJournal::~MetaJournal() {
+  pthread_mutex_destroy(&this->lock);
+  pthread_mutex_destroy(&this->io_lock);
+}
+
+void MetaJournal::log(uint32_t type, uint32_t zone, uint64_t lba,
+                      uint64_t pa) {
+  pthread_mutex_lock(&this->lock);
+  this->staged.push_back(
+      JournalEntry{.type = type, .zone = zone, .lba = lba, .pa = pa});
+  this->next_seq++;
+  pthread_mutex_unlock(&this->lock);
+}
+
+uint64_t MetaJournal::last_seq() {
+  pthread_mutex_lock(&this->lock);
+  uint64_t ret = this->next_seq - 1;
+  pthread_mutex_unlock(&this->lock);
+  return ret;
+}
+
+uint64_t MetaJournal::memory_bytes() {
+  pthread_mutex_lock(&this->lock);
+  uint64_t bytes = vector_bytes(this->staged);
+  pthread_mutex_unlock(&this->lock);
+  pthread_mutex_lock(&this->io_lock);
+  bytes += vector_bytes(this->pending) + vector_bytes(this->ring);
+  pthread_mutex_unlock(&this->io_lock);
+  return bytes;
+}
+
+bool MetaJournal::flush(bool partial) {
+  pthread_mutex_lock(&this->io_lock);
+  pthread_mutex_lock(&this->lock);
+  size_t take = this->staged.size();
+  if (!partial) take -= take % this->entries_per_block;
+  if (take != 0) {
+    if (this->pending.empty()) {
+      this->pending_seq = this->next_seq - this->staged.size();
+    }
+    this->pending.insert(this->pending.end(), this->staged.begin(),
+                         this->staged.begin() + take);
+    this->staged.erase(this->staged.begin(), this->staged.begin() + take);
+  }
+  pthread_mutex_unlock(&this->lock);
+
+  size_t count = this->pending.size();
+  if (!partial) count -= count % this->entries_per_block;
+  bool ret = true;
+  if (count != 0) {
+    ScopedTrace trace(TRACE_JOURNAL_COMMIT, 0, this->pending_seq, count);
+    std::vector<JournalEntry> entries(this->pending.begin(),
+                                      this->pending.begin() + count);
+    ret = this->write_blocks(entries, this->pending_seq);
+    if (ret) {
+      this->pending.erase(this->pending.begin(),
+                          this->pending.begin() + count);
+      this->pending_seq += count;
+    }
+  }
+  pthread_mutex_unlock(&this->io_lock);
+  return ret;
+}
+
+bool MetaJournal::write_blocks(const std::vector<JournalEntry> &entries,
+                               uint64_t seq) {
+  const uint32_t max_blocks = std::max(this->mdts / this->lba_size, 1UL);
+  size_t done = 0;
+  while (done < entries.size()) {
+    RingZone *zone = &this->ring[this->current];
+    if (zone->wp >= zone->slba + this->zcap) {
+      // Move on to the next zone, unless it still holds entries that
+      // are not part of a checkpoint.
+      uint32_t next = (this->current + 1) % this->ring.size();
+      if (this->ring[next].wp != this->ring[next].slba) return false;
+      this->current = next;
+      continue;
+    }
+
+    size_t left = entries.size() - done;
+    uint64_t nblocks = (left + this->entries_per_block - 1) /
+                       this->entries_per_block;
+    nblocks = std::min(nblocks, (uint64_t)max_blocks);
+    nblocks = std::min(nblocks, zone->slba + this->zcap - zone->wp);
+
+    uint32_t size = nblocks * this->lba_size;
+    std::vector<char> buffer(size, 0);
+    for (uint64_t i = 0; i < nblocks; i++) {
+      char *block = buffer.data() + i * this->lba_size;
+      uint32_t count =
+          std::min((size_t)this->entries_per_block, entries.size() - done);
+      JournalHeader header = {.magic = JOURNAL_MAGIC,
+                              .crc = 0,
+                              .seq = seq + done,
+                              .count = count,
+                              .reserved = 0};
+      memcpy(block, &header, sizeof(header));
+      memcpy(block + sizeof(header), &entries[done],
+             count * sizeof(JournalEntry));
+      header.crc = crc32c(0, block, this->lba_size);
+      memcpy(block, &header, sizeof(header));
+      done += count;
+    }
+
+    int ret = ss_nvme_write(this->fd, this->nsid, zone->wp, nblocks - 1, 0, 0,
+                            0, 0, 0, 0, size, buffer.data(), 0, nullptr);
+    if (ret != 0) return false;
+    this->bytes_written += size;
+    zone->wp += nblocks;
+    zone->max_seq = seq + done - 1;
+  }
+  return true;
+}
+
+bool MetaJournal::needs_checkpoint() {
+  pthread_mutex_lock(&this->io_lock);
+  uint32_t next = (this->current + 1) % this->ring.size();
+  bool ret = this->ring[next].wp != this->ring[next].slba;
+  pthread_mutex_unlock(&this->io_lock);
+  return ret;
+}
+
+void MetaJournal::checkpointed(uint64_t seq) {
+  pthread_mutex_lock(&this->io_lock);
+  for (uint32_t i = 0; i < this->ring.size(); i++) {
+    RingZone *zone = &this->ring[i];
+    if (i == this->current || zone->wp == zone->slba) continue;
+    if (zone->max_seq > seq) continue;
+    ss_device_zone_reset(this->fd, this->nsid, zone->slba);
+    zone->wp = zone->slba;
+    zone->max_seq = 0;
+  }
+  pthread_mutex_unlock(&this->io_lock);
+}
+
+uint64_t MetaJournal::replay(
+    uint64_t after_seq,
+    const std::function<void(const JournalEntry &)> &apply) {
+  struct Block {
+    uint64_t seq;
+    std::vector<JournalEntry> entries;
+  };
+  std::vector<std::vector<Block>> zone_blocks(this->ring.size());
+  const uint32_t max_blocks = std::max(this->mdts / this->lba_size, 1UL);
+
+  pthread_mutex_lock(&this->io_lock);
+  // The ring zones are independent, scan them all at once.
+  parallel_for(this->ring.size(), [&](uint64_t i) {
+    RingZone *zone = &this->ring[i];
+    zone->wp =
+        zone_write_pointer(this->fd, this->nsid, zone->slba, this->zcap);
+    zone->max_seq = 0;
+
+    // Read until the write pointer, a torn or foreign block ends the zone.
+    bool valid = true;
+    for (uint64_t lba = zone->slba; valid && lba < zone->wp;) {
+      uint64_t nblocks = std::min((uint64_t)max_blocks, zone->wp - lba);
+      std::vector<char> buffer(nblocks * this->lba_size);
+      if (ss_nvme_read(this->fd, this->nsid, lba, nblocks - 1, 0, 0, 0, 0, 0,
+                       buffer.size(), buffer.data(), 0, nullptr) != 0) {
+        break;
+      }
+      for (uint64_t j = 0; j < nblocks; j++) {
+        char *block = buffer.data() + j * this->lba_size;
+        JournalHeader header;
+        memcpy(&header, block, sizeof(header));
+        uint32_t crc = header.crc;
+        memset(block + offsetof(JournalHeader, crc), 0, sizeof(uint32_t));
+        if (header.magic != JOURNAL_MAGIC ||
+            header.count > this->entries_per_block ||
+            crc32c(0, block, this->lba_size) != crc) {
+          valid = false;
+          break;
+        }
+        JournalEntry *first = (JournalEntry *)(block + sizeof(header));
+        zone_blocks[i].push_back(
+            Block{.seq = header.seq,
+                  .entries = std::vector<JournalEntry>(first,
+                                                       first + header.count)});
+        zone->max_seq =
+            std::max(zone->max_seq, header.seq + header.count - 1);
+      }
+      lba += nblocks;
+    }
+  });
+
+  uint64_t max_seq = after_seq;
+  this->current = 0;
+  std::vector<Block> blocks;
+  for (uint32_t i = 0; i < this->ring.size(); i++) {
+    if (this->ring[i].max_seq > this->ring[this->current].max_seq) {
+      this->current = i;
+    }
+    max_seq = std::max(max_seq, this->ring[i].max_seq);
+    std::move(zone_blocks[i].begin(), zone_blocks[i].end(),
+              std::back_inserter(blocks));
+  }
+  pthread_mutex_unlock(&this->io_lock);
+
+  std::sort(blocks.begin(), blocks.end(),
+            [](const Block &a, const Block &b) { return a.seq < b.seq; });
+  uint64_t applied = 0;
+  for (Block &block : blocks) {
+    for (uint32_t i = 0; i < block.entries.size(); i++) {
+      if (block.seq + i <= after_seq) continue;
+      apply(block.entries[i]);
+      applied++;
+    }
+  }
+
+  pthread_mutex_lock(&this->lock);
+  this->next_seq = max_seq + 1;
+  pthread_mutex_unlock(&this->lock);
+  return applied;
+}
+
+void MetaJournal::clear() {
+  pthread_mutex_lock(&this->io_lock);
+  for (RingZone &zone : this->ring) {
+    zone.wp = zone.slba;
+    zone.max_seq = 0;
+  }
+  this->current = 0;
+  this->pending.clear();
+  pthread_mutex_unlock(&this->io_lock);
+
+  pthread_mutex_lock(&this->lock);
+  this->staged.clear();
+  this->next_seq = 1;
+  pthread_mutex_unlock(&this->lock);
+}
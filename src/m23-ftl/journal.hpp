@@ -0,0 +1,147 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_JOURNAL_H
+#define STOSYS_PROJECT_JOURNAL_H
+#pragma once
+
+#include <pthread.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/** Identifies a valid journal block */
+#define JOURNAL_MAGIC 0x4c4e524a
+
+/** Types of the changes recorded in the journal */
+enum JournalType {
+  /** lba is mapped to pa in log zone zone */
+  JOURNAL_LOG_INSERT = 1,
+  /** lba is no longer mapped to pa in log zone zone */
+  JOURNAL_LOG_DELETE = 2,
+  /** Region lba is mapped to data zone zone at pa */
+  JOURNAL_DATA_INSERT = 3,
+  /** Blocks [lba, lba + pa) of data zone zone are valid */
+  JOURNAL_DATA_RANGE = 4,
+  /** Zone with zone_id zone has been reset, pa is its reset count after
+   * the reset so that replaying the entry twice does not count it twice */
+  JOURNAL_ZONE_RESET = 5,
+  /** Blocks may carry sequence numbers up to, not including, pa */
+  JOURNAL_SEQ_RESERVE = 6,
+};
+
+struct JournalEntry {
+  uint32_t type;
+  uint32_t zone;
+  uint64_t lba;
+  uint64_t pa;
+};
+
+/** Header of every journal block, followed by count entries. The crc is
+ * calculated over the whole block with the crc field set to zero. */
+struct JournalHeader {
+  uint32_t magic;
+  uint32_t crc;
+  /** Sequence number of the first entry in the block */
+  uint64_t seq;
+  uint32_t count;
+  uint32_t reserved;
+};
+
+/** Write-ahead log of the FTL mapping changes, stored in a ring of
+ * metadata zones. Changes are staged in memory and written in batches
+ * of whole blocks, every entry gets a sequence number so that replay
+ * can skip whatever is already part of the last checkpoint. */
+class MetaJournal {
+ public:
+  MetaJournal(int fd, uint32_t nsid, uint16_t lba_size, uint64_t mdts,
+              uint64_t first_slba, uint64_t zcap, uint32_t nzones);
+
+  ~MetaJournal();
+
+  /** Stage a change, cheap enough to call with the map locks held. */
+  void log(uint32_t type, uint32_t zone, uint64_t lba, uint64_t pa);
+
+  /** Write the staged entries that fill a whole block, or everything if
+   * partial is set. Returns false if the ring is out of space. */
+  bool flush(bool partial);
+
+  /** True once the ring is about to run out of space. */
+  bool needs_checkpoint();
+
+  /** Sequence number of the last staged entry */
+  uint64_t last_seq();
+
+  /** A checkpoint containing everything up to seq has been written, so
+   * the zones with only older entries can be reused. */
+  void checkpointed(uint64_t seq);
+
+  /** Read the journal and pass every entry newer than after_seq to apply,
+   * in order. Also positions the journal after the last valid block.
+   * Returns the number of entries applied. */
+  uint64_t replay(uint64_t after_seq,
+              const std::function<void(const JournalEntry &)> &apply);
+
+  /** Forget about everything on the device, the zones must be empty. */
+  void clear();
+
+  /** Heap bytes of the entries waiting to be written */
+  uint64_t memory_bytes();
+
+  /** Bytes of journal blocks written to the device */
+  std::atomic<uint64_t> bytes_written;
+
+ private:
+  struct RingZone {
+    uint64_t slba;
+    uint64_t wp;
+    /** Highest sequence number written to the zone */
+    uint64_t max_seq;
+  };
+
+  /** Write the entries to the ring starting at seq, io_lock must be held */
+  bool write_blocks(const std::vector<JournalEntry> &entries, uint64_t seq);
+
+  int fd;
+  uint32_t nsid;
+  uint16_t lba_size;
+  uint64_t mdts;
+  uint64_t zcap;
+  uint32_t entries_per_block;
+
+  /** Protects the staged entries */
+  pthread_mutex_t lock;
+  std::vector<JournalEntry> staged;
+  uint64_t next_seq;
+
+  /** Serializes the writes and protects everything below */
+  pthread_mutex_t io_lock;
+  std::vector<RingZone> ring;
+  uint32_t current;
+
+  /** Entries taken from staged that did not fit in the ring yet */
+  std::vector<JournalEntry> pending;
+  uint64_t pending_seq;
+};
+
+#endif
@@ -30,8 +30,12 @@ SOFTWARE.
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
+#include "../common/lockstat.h"
+#include "../common/log.h"
 #include "../common/nvmewrappers.h"
+#include "../common/utils.h"
 #include "znsblock.hpp"
 
 ZNSLogZone::ZNSLogZone(const int zns_fd, const uint32_t nsid,
@@ -52,6 +56,10 @@ ZNSLogZone::ZNSLogZone(const int zns_fd, const uint32_t nsid,
   this->slba = slba;
   this->lba_size = lba_size;
   this->mdts_size = mdts_size;
+  this->stream = 0;
+  this->reset_count = 0;
+  this->last_write = 0;
+  this->meta_size = 0;
 
   this->block_map =
       ZoneMap{.lock = PTHREAD_RWLOCK_INITIALIZER, .map = BlockMap()};
@@ -86,8 +94,13 @@ int ZNSLogZone::reset() {
   int ret = ss_device_zone_reset(this->zns_fd, this->nsid, this->base);
 
   // Remove all blocks from the memory of this zone
+  profiled_wrlock(&this->block_map.lock, LOCK_BLOCK_MAP);
   this->block_map.map.clear();
+  profiled_unlock(&this->block_map.lock, LOCK_BLOCK_MAP);
+  this->checksums.clear();
   this->position = this->base;
+  this->last_write = 0;
+  this->reset_count++;
   return ret;
 }
 
@@ -126,6 +139,8 @@ int ZNSLogZone::finish_zone(void) const {
 int ZNSLogZone::reset_zone(void) {
   int ret = send_management_command(NVME_ZNS_ZSA_RESET);
   this->position = this->slba;
+  this->reset_count++;
+  this->checksums.clear();
   return ret;
 }
 
@@ -148,28 +163,33 @@ std::ostream &operator<<(std::ostream &os, ZNSLogZone const &tc) {
 
 int ZNSLogZone::ss_sequential_write(const void *buffer,
                                     const uint16_t max_nlb_per_round,
-                                    const uint16_t total_nlb) {
+                                    const uint16_t total_nlb, char *meta) {
   uint64_t i;
   uint64_t data_len = max_nlb_per_round * this->lba_size;
+  uint32_t meta_len = meta ? max_nlb_per_round * this->meta_size : 0;
   void *buffer_ptr;
-  for (i = 0; i < total_nlb; i += max_nlb_per_round) {
+  // Whole rounds first, only as many as fit in total_nlb.
+  for (i = 0; i + max_nlb_per_round <= total_nlb; i += max_nlb_per_round) {
     buffer_ptr = (void *)((uint64_t)buffer + i * this->lba_size);
+    char *meta_ptr = meta ? meta + i * this->meta_size : nullptr;
     int ret = ss_nvme_write(this->zns_fd, this->nsid, this->position,
                             max_nlb_per_round - 1, 0, 0, 0, 0, 0, 0, data_len,
-                            buffer_ptr, 0, nullptr);
+                            buffer_ptr, meta_len, meta_ptr);
     if (ret != 0) {
       return ret;
     }
     this->position += max_nlb_per_round;
   }
-  if (i > total_nlb) {
+  if (i < total_nlb) {
     // write remaining blocks.
-    uint64_t ream_blocks = (total_nlb - (i - max_nlb_per_round));
+    uint64_t ream_blocks = total_nlb - i;
     buffer_ptr = (void *)((uint64_t)buffer + i * this->lba_size);
     data_len = ream_blocks * this->lba_size;
-    int ret =
-        ss_nvme_write(this->zns_fd, this->nsid, this->position, ream_blocks - 1,
-                      0, 0, 0, 0, 0, 0, data_len, buffer_ptr, 0, nullptr);
+    char *meta_ptr = meta ? meta + i * this->meta_size : nullptr;
+    meta_len = meta ? ream_blocks * this->meta_size : 0;
+    int ret = ss_nvme_write(this->zns_fd, this->nsid, this->position,
+                            ream_blocks - 1, 0, 0, 0, 0, 0, 0, data_len,
+                            buffer_ptr, meta_len, meta_ptr);
     if (ret != 0) {
       return ret;
     }
@@ -182,11 +202,16 @@ int ZNSLogZone::ss_sequential_write(const void *buffer,
 // TODO(someone): this is copying the entire block map every time
 uint64_t ZNSLogZone::get_alive_capacity() const {
   BlockMap *map = (BlockMap *)&this->block_map.map;
+  // Writers may be adding to the map of an open zone, and a rehash under
+  // the iterator would leave it dangling.
+  pthread_rwlock_t *lock = (pthread_rwlock_t *)&this->block_map.lock;
 
   uint64_t alive_count = 0;
+  profiled_rdlock(lock, LOCK_BLOCK_MAP);
   for (BlockMap::iterator it = map->begin(); it != map->end(); ++it) {
     if (it->second.valid) alive_count++;
   }
+  profiled_unlock(lock, LOCK_BLOCK_MAP);
 
   return alive_count;
 }
@@ -195,14 +220,18 @@ int ZNSLogZone::invalidate_block(const uint64_t pa) {
   // See if the physical adress exists, else print an error and move on.
   // This can happen if the cache at the FTL is invalid or if it has
   // done a multiple region write.
-  if (this->block_map.map.count(pa) != 1) {
+  profiled_wrlock(&this->block_map.lock, LOCK_BLOCK_MAP);
+  auto found = this->block_map.map.find(pa);
+  if (found == this->block_map.map.end()) {
+    profiled_unlock(&this->block_map.lock, LOCK_BLOCK_MAP);
     std::cerr << "Error: Block " << pa << " does not exist in " << this->zone_id
               << std::endl;
     return -1;
   }
 
   // Store the invalid zone in the system
-  this->block_map.map[pa].valid = false;
+  found->second.valid = false;
+  profiled_unlock(&this->block_map.lock, LOCK_BLOCK_MAP);
 
   return 0;
 }
@@ -211,7 +240,7 @@ int ZNSLogZone::invalidate_block(const uint64_t pa) {
 return the size of the inserted buffer.
 */
 uint32_t ZNSLogZone::write(void *buffer, uint32_t size, uint32_t *write_size,
-                           uint64_t lba) {
+                           uint64_t lba, uint64_t seq) {
   uint32_t max_writes = this->get_current_capacity() * this->lba_size;
   *write_size = (size > max_writes) ? max_writes : size;
 
@@ -223,33 +252,51 @@ uint32_t ZNSLogZone::write(void *buffer, uint32_t size, uint32_t *write_size,
   uint16_t max_nlb_per_round = this->mdts_size / this->lba_size;
   uint64_t write_base = this->position;
 
+  // Tell every block which LBA it holds, so the maps can be rebuilt from
+  // the media.
+  std::vector<char> meta(total_nlb * this->meta_size, 0);
+  for (uint16_t i = 0; this->meta_size && i < total_nlb; i++) {
+    BlockMeta block_meta = {.lba = lba + i * this->lba_size, .seq = seq + i};
+    memcpy(meta.data() + i * this->meta_size, &block_meta, sizeof(block_meta));
+  }
+  char *meta_ptr = this->meta_size ? meta.data() : nullptr;
+  if (size >= this->lba_size) {
+    this->checksums.store(buffer, write_base - this->base, total_nlb, meta_ptr);
+  } else {
+    this->checksums.forget(write_base - this->base);
+  }
+
   if (size <= this->mdts_size) {
     // This values cause bad things to happen
     int ret = ss_nvme_write(this->zns_fd, this->nsid, this->position,
                             total_nlb - 1, 0, 0, 0, 0, 0, 0, *write_size,
-                            (void *)buffer, 0, nullptr);
+                            (void *)buffer, meta.size(), meta_ptr);
     if (ret != 0) {
       return ret;
     }
     this->position += total_nlb;
   } else {
-    std::cout << "sequential" << std::endl;
-    int ret = ss_sequential_write(buffer, max_nlb_per_round, total_nlb);
+    ss_debug(DBG_FTL_LOG, "sequential write of %u blocks\n", total_nlb);
+    int ret =
+        ss_sequential_write(buffer, max_nlb_per_round, total_nlb, meta_ptr);
     if (ret != 0) return ret;
   }
 
+  profiled_wrlock(&this->block_map.lock, LOCK_BLOCK_MAP);
   for (uint64_t i = 0, address = write_base; i < total_nlb; i++) {
     uint64_t pa = address + i;
     uint64_t local_lba = lba + i * this->lba_size;
     this->block_map.map[pa] = {
         .address = pa, .logical_address = local_lba, .valid = true};
   }
+  profiled_unlock(&this->block_map.lock, LOCK_BLOCK_MAP);
+  this->last_write = monotonic_microseconds();
 
   return 0;
 }
 
 uint32_t ZNSLogZone::read(const uint64_t pa, const void *buffer, uint32_t size,
-                          uint32_t *read_size) {
+                          uint32_t *read_size, void *meta, bool verify) {
   if (pa + size / this->lba_size > this->base + this->capacity) {
     // cross boundary read.
     size = (this->base + this->capacity - pa) * this->lba_size;
@@ -260,13 +307,28 @@ uint32_t ZNSLogZone::read(const uint64_t pa, const void *buffer, uint32_t size,
   }
   *read_size = size;
 
-  int read_ret =
-      ss_nvme_read(this->zns_fd, this->nsid, pa, nlb - 1, 0, 0, 0, 0, 0,
-                   nlb * this->lba_size, (void *)buffer, 0, nullptr);
+  if (this->meta_size == 0) meta = nullptr;
+  verify &= this->checksums.enabled() && size >= this->lba_size;
+  std::vector<char> own_meta;
+  if (verify && meta == nullptr && this->checksums.in_meta) {
+    own_meta.resize(nlb * this->meta_size);
+    meta = own_meta.data();
+  }
+  int read_ret = ss_nvme_read(this->zns_fd, this->nsid, pa, nlb - 1, 0, 0, 0,
+                              0, 0, nlb * this->lba_size, (void *)buffer,
+                              meta ? nlb * this->meta_size : 0, meta);
   if (read_ret != 0) {
     return read_ret;
   }
 
+  if (verify) {
+    uint64_t bad = this->checksums.verify(buffer, pa - this->base, nlb, meta);
+    if (bad != nlb) {
+      std::cerr << "Error: checksum mismatch at block " << pa + bad
+                << " of zone " << this->zone_id << std::endl;
+      return -EIO;
+    }
+  }
   return 0;
 }
 
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include "checksum.hpp"
 #include "zone.hpp"
 
 class ZNSLogZone {
@@ -42,11 +43,16 @@ class ZNSLogZone {
    * space. */
   uint64_t backup(uint64_t addr);
 
-  /** Gets a block from the zone based on the block id. */
+  /** Gets a block from the zone based on the block id. With verify,
+   * returns -EIO if the data does not match its checksum. */
   uint32_t read(const uint64_t lba, const void *buffer, uint32_t size,
-                uint32_t *read_size);
+                uint32_t *read_size, void *meta = nullptr,
+                bool verify = false);
+
+  /** Append the buffer for lba, the blocks get the sequence numbers
+   * starting at seq in their metadata. */
   uint32_t write(void *buffer, uint32_t size, uint32_t *write_size,
-                 uint64_t lba);
+                 uint64_t lba, uint64_t seq = 0);
 
   /** Reset the write pointer to the start. */
   int reset_zone(void);
@@ -86,6 +92,15 @@ class ZNSLogZone {
   /** Write pointer */
   uint64_t position;
 
+  /** Log stream that opened this zone, see LogStream */
+  int stream;
+
+  /** monotonic_microseconds of the last write, 0 if empty */
+  uint64_t last_write;
+
+  /** Number of times the zone has been reset, persisted by FTL::backup */
+  uint32_t reset_count;
+
   /** Zone Logical Block Address or the lowest addressable point */
   uint64_t base;
 
@@ -95,6 +110,12 @@ class ZNSLogZone {
   /** Maximum transfer size */
   uint64_t mdts_size;
 
+  /** Bytes of metadata per block, 0 if we do not store BlockMeta */
+  uint16_t meta_size;
+
+  /** Checksums of the blocks, only used in checksum mode */
+  BlockChecksums checksums;
+
   /** Map of the physical addresses to the buffer and state */
   ZoneMap block_map;
 
@@ -116,7 +137,7 @@ class ZNSLogZone {
 
   /** Write to the device in a sequential manner */
   int ss_sequential_write(const void *buffer, const uint16_t max_nlb_per_round,
-                          const uint16_t total_nlb);
+                          const uint16_t total_nlb, char *meta);
 
   inline int send_management_command(
       const enum nvme_zns_send_action action) const;
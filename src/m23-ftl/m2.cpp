@@ -137,7 +137,7 @@ int main(int argc, char **argv) {
        *str1 = nullptr;
 
   struct user_zns_device *my_dev = nullptr;
-  struct zdev_init_params params;
+  struct zdev_init_params params = {};
   params.force_reset = true;
   params.log_zones = 3;
   params.gc_wmark = 1;
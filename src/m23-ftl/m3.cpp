@@ -234,6 +234,16 @@ static int show_help() {
       "-w : watermark threshold, the number of free zones when to trigger the "
       "gc (default, minimum = 1). \n");
   printf("-o : overwrite so [int] times  (default, 10,000). \n");
+  printf("-b : run the GC in the background instead of on-demand. \n");
+  printf(
+      "-g : bandwidth budget of the background GC in MiB/s (default, 64). "
+      "\n");
+  printf("-t : separate hot and cold data in different log zones. \n");
+  printf("-s : with -r, rebuild the FTL from the per-block metadata. \n");
+  printf("-z : with -r, admit I/O before the whole map is restored. \n");
+  printf("-c : checksum every block and verify it when it is read. \n");
+  printf("-e : trace the run and write the events to [file]. \n");
+  printf("-p : write a CSV profile of every GC cycle to [file]. \n");
   printf("-h : shows help, and exits with success. No argument needed\n");
   return 0;
 }
@@ -247,8 +257,10 @@ int main(int argc, char **argv) {
   struct user_zns_device *my_dev = nullptr;
   uint64_t *seq_addresses = nullptr, *random_addresses = nullptr;
   uint32_t to_hammer_lba = 10000;
+  const char *trace_file = nullptr;
+  const char *gc_file = nullptr;
 
-  struct zdev_init_params params;
+  struct zdev_init_params params = {};
   params.force_reset = true;
   params.log_zones = 3;
   params.gc_wmark = 1;
@@ -266,7 +278,7 @@ int main(int argc, char **argv) {
   printf(
       "========================================================================"
       "============= \n");
-  while ((c = getopt(argc, argv, "o:m:l:d:w:hr")) != -1) {
+  while ((c = getopt(argc, argv, "o:m:l:d:w:g:e:p:hrbtszc")) != -1) {
     switch (c) {
       case 'h':
         show_help();
@@ -274,6 +286,30 @@ int main(int argc, char **argv) {
       case 'r':
         params.force_reset = false;
         break;
+      case 'b':
+        params.gc_mode = ZNS_GC_BACKGROUND;
+        break;
+      case 'g':
+        params.gc_rate_mbps = atoi(optarg);
+        break;
+      case 't':
+        params.hot_cold = true;
+        break;
+      case 's':
+        params.media_scan = true;
+        break;
+      case 'z':
+        params.lazy_restore = true;
+        break;
+      case 'c':
+        params.checksums = true;
+        break;
+      case 'e':
+        trace_file = optarg;
+        break;
+      case 'p':
+        gc_file = optarg;
+        break;
       case 'o':
         to_hammer_lba = atoi(optarg);
         break;
@@ -325,6 +361,7 @@ int main(int argc, char **argv) {
       params.name, params.log_zones, params.gc_wmark,
       params.force_reset == 1 ? "yes" : "no", to_hammer_lba);
 
+  if (trace_file != nullptr) zns_trace_enable(true);
   ret = init_ss_zns_device(&params, &my_dev);
   assert(ret == 0);
   assert(my_dev->lba_size_bytes != 0);
@@ -354,6 +391,52 @@ int main(int argc, char **argv) {
   int t3 = wr_full_device_verify(my_dev, random_addresses, max_lba_entries,
                                  to_hammer_lba);
   printf("\n");
+  if (trace_file != nullptr) {
+    zns_trace_enable(false);
+    if (zns_trace_dump(trace_file) != 0) {
+      printf("could not write the trace to %s \n", trace_file);
+    }
+  }
+  if (gc_file != nullptr) {
+    FILE *out = fopen(gc_file, "w");
+    if (out == nullptr ||
+        zns_udevice_dump_gc_history(my_dev, out, ZNS_ZONES_CSV) != 0) {
+      printf("could not write the GC cycles to %s \n", gc_file);
+    }
+    if (out != nullptr) fclose(out);
+  }
+  struct zns_stats stats = {};
+  zns_udevice_get_stats(my_dev, &stats);
+  printf(
+      "host written %lu bytes, device written %lu (host) %lu (gc) %lu "
+      "(padding) %lu (metadata), write amplification %.2f \n",
+      stats.host_bytes_written, stats.dev_bytes_host,
+      stats.dev_bytes_gc_merge + stats.dev_bytes_gc_insert +
+          stats.dev_bytes_wear_level,
+      stats.dev_bytes_padding,
+      stats.dev_bytes_journal + stats.dev_bytes_checkpoint,
+      stats.write_amplification);
+  struct zns_mem_stats mem = {};
+  zns_udevice_get_memory(my_dev, &mem);
+  printf(
+      "memory %lu bytes: log map %lu data map %lu block maps %lu checksums "
+      "%lu gc peak %lu \n",
+      mem.total_bytes, mem.log_map_bytes, mem.data_map_bytes,
+      mem.block_map_bytes, mem.checksum_bytes, mem.gc_scratch_peak_bytes);
+  const char *latency_names[] = {"read",       "write", "write stall",
+                                 "gc cycle",   "reset", "nvme"};
+  for (int op = 0; op < ZNS_LAT_OPS; op++) {
+    struct zns_latency latency = {};
+    zns_udevice_get_latency(my_dev, (enum zns_latency_op)op, &latency, false);
+    if (latency.count == 0) continue;
+    printf("%-12s n %lu p50 %lu us p99 %lu us p99.9 %lu us max %lu us \n",
+           latency_names[op], latency.count, latency.p50_ns / 1000,
+           latency.p99_ns / 1000, latency.p999_ns / 1000,
+           latency.max_ns / 1000);
+  }
+#ifdef STOSYS_LOCKSTAT
+  zns_lockstat_dump(stdout);
+#endif
   // clean up
   ret = deinit_ss_zns_device(my_dev, false);
   // free all
@@ -0,0 +1,71 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "ratelimit.hpp"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+
+#include "../common/utils.h"
+
+TokenBucket::TokenBucket(uint64_t rate, uint64_t burst) {
+  this->lock = PTHREAD_MUTEX_INITIALIZER;
+  this->rate = rate;
+  this->burst = burst;
+  this->tokens = burst;
+  this->last_refill = monotonic_microseconds();
+}
+
+void TokenBucket::refill(uint64_t now) {
+  if (now <= this->last_refill) return;
+  double gained = (now - this->last_refill) * (this->rate / 1000000.0);
+  this->tokens = std::min(this->tokens + gained, (double)this->burst);
+  this->last_refill = now;
+}
+
+void TokenBucket::set_rate(uint64_t rate) {
+  pthread_mutex_lock(&this->lock);
+  this->refill(monotonic_microseconds());
+  this->rate = rate;
+  pthread_mutex_unlock(&this->lock);
+}
+
+void TokenBucket::consume(uint64_t bytes) {
+  pthread_mutex_lock(&this->lock);
+  if (this->rate == 0) {
+    pthread_mutex_unlock(&this->lock);
+    return;
+  }
+  this->refill(monotonic_microseconds());
+  this->tokens -= bytes;
+  // Sleep off our debt outside of the lock so that the other
+  // consumers can queue up behind us.
+  uint64_t wait_us = 0;
+  if (this->tokens < 0) {
+    wait_us = (uint64_t)(-this->tokens * 1000000.0 / this->rate);
+  }
+  pthread_mutex_unlock(&this->lock);
+
+  if (wait_us > 0) usleep(wait_us);
+}
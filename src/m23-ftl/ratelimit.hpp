@@ -0,0 +1,61 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_RATELIMIT_H
+#define STOSYS_PROJECT_RATELIMIT_H
+#pragma once
+
+#include <pthread.h>
+
+#include <cstdint>
+
+/** Token bucket used to pace the background GC and the throttled
+ * writers. Consumers are allowed to go into debt, and sleep until the
+ * debt has been paid off, which spreads the delay evenly over all the
+ * requests instead of stalling a single one. */
+class TokenBucket {
+ public:
+  /** rate is in bytes per second, a rate of zero disables the bucket. */
+  TokenBucket(uint64_t rate, uint64_t burst);
+
+  ~TokenBucket() { pthread_mutex_destroy(&this->lock); }
+
+  /** Change the refill rate, the tokens collected so far are kept. */
+  void set_rate(uint64_t rate);
+
+  uint64_t get_rate() const { return this->rate; }
+
+  /** Take bytes from the bucket, sleeping if we ran out of tokens. */
+  void consume(uint64_t bytes);
+
+ private:
+  /** Top up the bucket based on the time passed since the last refill.
+   * Must be called with the lock held. */
+  void refill(uint64_t now);
+
+  pthread_mutex_t lock;
+  uint64_t rate;
+  uint64_t burst;
+  double tokens;
+  uint64_t last_refill;
+};
+
+#endif
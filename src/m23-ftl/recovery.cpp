@@ -0,0 +1,87 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "recovery.hpp"
+
+#include <libnvme.h>
+#include <nvme/ioctl.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "../common/nvmewrappers.h"
+
+uint32_t recovery_threads() {
+  uint32_t cores = std::thread::hardware_concurrency();
+  return std::min(std::max(cores, 1U), (uint32_t)RECOVERY_MAX_THREADS);
+}
+
+void parallel_for(uint64_t n, const std::function<void(uint64_t)> &fn) {
+  uint32_t nthreads = std::min((uint64_t)recovery_threads(), n);
+  if (nthreads <= 1) {
+    for (uint64_t i = 0; i < n; i++) fn(i);
+    return;
+  }
+
+  std::atomic<uint64_t> next(0);
+  auto worker = [&]() {
+    for (uint64_t i = next++; i < n; i = next++) fn(i);
+  };
+  std::vector<std::thread> threads;
+  for (uint32_t i = 1; i < nthreads; i++) threads.emplace_back(worker);
+  worker();
+  for (std::thread &thread : threads) thread.join();
+}
+
+int parallel_read(int fd, uint32_t nsid, uint64_t slba, uint64_t nblocks,
+                  uint16_t lba_size, uint64_t mdts, void *buffer) {
+  const uint64_t chunk = std::max(mdts / lba_size, (uint64_t)1);
+  const uint64_t nchunks = (nblocks + chunk - 1) / chunk;
+  std::atomic<int> error(0);
+  parallel_for(nchunks, [&](uint64_t i) {
+    uint64_t start = i * chunk;
+    uint64_t count = std::min(chunk, nblocks - start);
+    char *dest = (char *)buffer + start * lba_size;
+    int ret = ss_nvme_read(fd, nsid, slba + start, count - 1, 0, 0, 0, 0, 0,
+                           count * lba_size, dest, 0, nullptr);
+    if (ret != 0) {
+      int expected = 0;
+      error.compare_exchange_strong(expected, ret);
+    }
+  });
+  return error;
+}
+
+uint64_t zone_write_pointer(int fd, uint32_t nsid, uint64_t slba,
+                            uint64_t zcap) {
+  char buffer[0x1000];
+  struct nvme_zone_report *report = (struct nvme_zone_report *)buffer;
+  int ret = nvme_zns_mgmt_recv(fd, nsid, slba, NVME_ZNS_ZRA_REPORT_ZONES,
+                               NVME_ZNS_ZRAS_REPORT_ALL, 0, 0x1000, report);
+  if (ret != 0 || le64_to_cpu(report->nr_zones) == 0) return slba + zcap;
+  uint64_t wp = le64_to_cpu(report->entries[0].wp);
+  if (wp < slba || wp > slba + zcap) wp = slba + zcap;
+  return wp;
+}
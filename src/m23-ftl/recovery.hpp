@@ -0,0 +1,50 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_RECOVERY_H
+#define STOSYS_PROJECT_RECOVERY_H
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+/** Upper bound on the number of threads used to restore the FTL */
+#define RECOVERY_MAX_THREADS 16
+
+/** Number of threads used to restore the FTL, based on the core count. */
+uint32_t recovery_threads();
+
+/** Call fn for every index in [0, n), spread over the recovery threads.
+ * Each thread takes the next index as soon as it is done with one. */
+void parallel_for(uint64_t n, const std::function<void(uint64_t)> &fn);
+
+/** Read nblocks starting at slba into buffer. The read is split into MDTS
+ * sized commands that are issued from all recovery threads at once, to
+ * keep the device queues full. Returns the first error, or 0. */
+int parallel_read(int fd, uint32_t nsid, uint64_t slba, uint64_t nblocks,
+                  uint16_t lba_size, uint64_t mdts, void *buffer);
+
+/** Ask the device for the write pointer of the zone at slba. A zone we
+ * know nothing about is reported as full, so nobody writes to it. */
+uint64_t zone_write_pointer(int fd, uint32_t nsid, uint64_t slba,
+                            uint64_t zcap);
+
+#endif
@@ -0,0 +1,49 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_STATS_H
+#define STOSYS_PROJECT_STATS_H
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/** Counters of an FTL since it was created, see zns_udevice_get_stats.
+ * Updated without locks, so a snapshot is not necessarily consistent
+ * across counters. */
+struct FtlStats {
+  std::atomic<uint64_t> host_bytes_read{0};
+  std::atomic<uint64_t> host_bytes_written{0};
+
+  /** Bytes written to the device, by what caused them */
+  std::atomic<uint64_t> dev_bytes_host{0};
+  std::atomic<uint64_t> dev_bytes_gc_merge{0};
+  std::atomic<uint64_t> dev_bytes_gc_insert{0};
+  std::atomic<uint64_t> dev_bytes_wear_level{0};
+  std::atomic<uint64_t> dev_bytes_padding{0};
+  std::atomic<uint64_t> dev_bytes_checkpoint{0};
+
+  /** Log and data zones reset after the GC moved their data out */
+  std::atomic<uint64_t> zone_resets{0};
+  std::atomic<uint64_t> gc_cycles{0};
+};
+
+#endif
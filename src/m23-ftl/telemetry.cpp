@@ -0,0 +1,195 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#include "telemetry.hpp"
+
+#include <errno.h>
+#include <inttypes.h>
+
+static const char *type_name(enum zns_zone_type type) {
+  return type == ZNS_ZONE_LOG ? "log" : "data";
+}
+
+static const char *state_name(enum zns_zone_state state) {
+  switch (state) {
+    case ZNS_ZONE_EMPTY:
+      return "empty";
+    case ZNS_ZONE_OPEN:
+      return "open";
+    default:
+      return "full";
+  }
+}
+
+static void write_json(FILE *out, const struct zns_zone_info *zones,
+                       uint32_t count) {
+  fprintf(out, "[");
+  for (uint32_t i = 0; i < count; i++) {
+    const struct zns_zone_info &zone = zones[i];
+    fprintf(out,
+            "%s\n{\"zone\":%u,\"type\":\"%s\",\"state\":\"%s\","
+            "\"stream\":%d,\"active\":%s,\"hot\":%s,\"slba\":%" PRIu64
+            ",\"wp\":%" PRIu64 ",\"capacity\":%" PRIu64
+            ",\"valid\":%" PRIu64 ",\"resets\":%u,",
+            i ? "," : "", zone.zone_id, type_name(zone.type),
+            state_name(zone.state), zone.stream,
+            zone.active ? "true" : "false", zone.hot ? "true" : "false",
+            zone.slba, zone.write_pointer, zone.capacity, zone.valid_blocks,
+            zone.reset_count);
+    // Missing values are null rather than the UINT64_MAX of the API.
+    if (zone.region == UINT64_MAX) {
+      fprintf(out, "\"region\":null,");
+    } else {
+      fprintf(out, "\"region\":%" PRIu64 ",", zone.region);
+    }
+    if (zone.idle_us == UINT64_MAX) {
+      fprintf(out, "\"idle_us\":null}");
+    } else {
+      fprintf(out, "\"idle_us\":%" PRIu64 "}", zone.idle_us);
+    }
+  }
+  fprintf(out, "\n]\n");
+}
+
+static void write_csv(FILE *out, const struct zns_zone_info *zones,
+                      uint32_t count) {
+  fprintf(out,
+          "zone,type,state,stream,active,hot,slba,wp,capacity,valid,resets,"
+          "region,idle_us\n");
+  for (uint32_t i = 0; i < count; i++) {
+    const struct zns_zone_info &zone = zones[i];
+    fprintf(out,
+            "%u,%s,%s,%d,%d,%d,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+            ",%u,",
+            zone.zone_id, type_name(zone.type), state_name(zone.state),
+            zone.stream, zone.active, zone.hot, zone.slba, zone.write_pointer,
+            zone.capacity, zone.valid_blocks, zone.reset_count);
+    if (zone.region != UINT64_MAX) fprintf(out, "%" PRIu64, zone.region);
+    fprintf(out, ",");
+    if (zone.idle_us != UINT64_MAX) fprintf(out, "%" PRIu64, zone.idle_us);
+    fprintf(out, "\n");
+  }
+}
+
+static void write_heatmap(FILE *out, const struct zns_zone_info *zones,
+                          uint32_t count) {
+  // Written zones go from '.' to '@' as more of their blocks are valid.
+  static const char shades[] = ".:-=+*#%@";
+  const uint64_t levels = sizeof(shades) - 1;
+  fprintf(out, "valid blocks per zone: '.' few ... '@' all, ' ' empty\n");
+  uint32_t column = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const struct zns_zone_info &zone = zones[i];
+    if (i == 0 || zones[i - 1].type != zone.type) {
+      if (i != 0) fprintf(out, "\n");
+      fprintf(out, "%s zones\n", type_name(zone.type));
+      column = 0;
+    } else if (column == HEATMAP_WIDTH) {
+      fprintf(out, "\n");
+      column = 0;
+    }
+    if (column == 0) fprintf(out, "%6u |", zone.zone_id);
+    char shade = ' ';
+    if (zone.state != ZNS_ZONE_EMPTY && zone.capacity != 0) {
+      uint64_t level = zone.valid_blocks * levels / zone.capacity;
+      shade = shades[level < levels ? level : levels - 1];
+    }
+    fputc(shade, out);
+    column++;
+  }
+  if (count != 0) fprintf(out, "\n");
+}
+
+int write_zones(FILE *out, const struct zns_zone_info *zones, uint32_t count,
+                enum zns_zone_format format) {
+  switch (format) {
+    case ZNS_ZONES_JSON:
+      write_json(out, zones, count);
+      return 0;
+    case ZNS_ZONES_CSV:
+      write_csv(out, zones, count);
+      return 0;
+    case ZNS_ZONES_HEATMAP:
+      write_heatmap(out, zones, count);
+      return 0;
+    default:
+      return -EINVAL;
+  }
+}
+
+// Columns of the GC records, in the order of the values in
+// write_gc_record.
+static const char *gc_fields[] = {
+    "cycle",         "start_us",       "victim_zone",   "victim_capacity",
+    "victim_valid",  "groups",         "merges",        "inserts",
+    "blocks_read",   "blocks_written", "blocks_padded", "select_ns",
+    "group_ns",      "merge_ns",       "insert_ns",     "reset_ns",
+    "wear_level_ns", "total_ns",       "paced"};
+
+static void write_gc_record(FILE *out, const struct zns_gc_record &record,
+                            bool json) {
+  const uint64_t values[] = {
+      record.cycle, record.start_us, record.victim_zone,
+      record.victim_capacity, record.victim_valid, record.groups,
+      record.merges, record.inserts, record.blocks_read,
+      record.blocks_written, record.blocks_padded, record.select_ns,
+      record.group_ns, record.merge_ns, record.insert_ns,
+      record.reset_ns, record.wear_level_ns, record.total_ns,
+      record.paced};
+  static_assert(sizeof(values) / sizeof(values[0]) ==
+                    sizeof(gc_fields) / sizeof(gc_fields[0]),
+                "every field of a GC record needs a column");
+  const size_t count = sizeof(values) / sizeof(values[0]);
+  if (json) fprintf(out, "{");
+  for (size_t i = 0; i < count; i++) {
+    if (i != 0) fprintf(out, ",");
+    if (json) fprintf(out, "\"%s\":", gc_fields[i]);
+    fprintf(out, "%" PRIu64, values[i]);
+  }
+  // The share of valid blocks is what the victim policy is judged by.
+  double ratio = record.victim_capacity
+                     ? (double)record.victim_valid / record.victim_capacity
+                     : 0;
+  fprintf(out, json ? ",\"valid_ratio\":%.4f}" : ",%.4f\n", ratio);
+}
+
+int write_gc_records(FILE *out, const struct zns_gc_record *records,
+                     uint32_t count, enum zns_zone_format format) {
+  switch (format) {
+    case ZNS_ZONES_JSON:
+      fprintf(out, "[");
+      for (uint32_t i = 0; i < count; i++) {
+        fprintf(out, "%s\n", i ? "," : "");
+        write_gc_record(out, records[i], true);
+      }
+      fprintf(out, "\n]\n");
+      return 0;
+    case ZNS_ZONES_CSV:
+      for (const char *field : gc_fields) fprintf(out, "%s,", field);
+      fprintf(out, "valid_ratio\n");
+      for (uint32_t i = 0; i < count; i++) {
+        write_gc_record(out, records[i], false);
+      }
+      return 0;
+    default:
+      return -EINVAL;
+  }
+}
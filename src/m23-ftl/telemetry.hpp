@@ -0,0 +1,46 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef STOSYS_PROJECT_TELEMETRY_H
+#define STOSYS_PROJECT_TELEMETRY_H
+#pragma once
+
+#include <stdio.h>
+
+#include <cstdint>
+
+#include "zns_device.h"
+
+/** Zones per row of the heatmap */
+#define HEATMAP_WIDTH 64
+
+/** Write count zone descriptions from FTL::get_zones to out, as a JSON
+ * array, as CSV with a header, or as a heatmap of the valid blocks.
+ * Returns -EINVAL for an unknown format. */
+int write_zones(FILE *out, const struct zns_zone_info *zones, uint32_t count,
+                enum zns_zone_format format);
+
+/** Write count GC cycles to out, as a JSON array or as CSV with a
+ * header. There is no heatmap of them, which gives -EINVAL. */
+int write_gc_records(FILE *out, const struct zns_gc_record *records,
+                     uint32_t count, enum zns_zone_format format);
+
+#endif
@@ -0,0 +1,687 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+// Runs an fio style workload on the FTL and reports the IOPS, bandwidth,
+// latency percentiles and write amplification of every interval. Unlike
+// m2 and m3 it does not check the data, and a run with the same seed
+// issues the same addresses, so the numbers of FTL versions and GC
+// policies can be compared.
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../common/histogram.h"
+#include "../common/utils.h"
+#include "zns_device.h"
+
+#define ZBENCH_READ 0
+#define ZBENCH_WRITE 1
+
+/** Largest write used to fill the span before workloads that read */
+#define ZBENCH_PREFILL_BYTES (1024 * 1024)
+
+enum Distribution {
+  DIST_UNIFORM = 0,
+  DIST_ZIPF,
+  DIST_HOTSPOT,
+};
+
+struct Workload {
+  const char *name;
+  bool random;
+  /* 100 for reads only, 0 for writes only */
+  uint32_t read_percent;
+  uint32_t block_size;
+  uint32_t threads;
+  enum Distribution dist;
+  double zipf_theta;
+  /* Share of the span that is hot, and of the accesses that go there */
+  double hot_space;
+  double hot_access;
+  uint64_t span_blocks;
+  uint32_t runtime_s;
+  uint64_t ops_per_thread;
+  uint32_t interval_s;
+  uint64_t seed;
+};
+
+// Zipfian ranks as in YCSB, after Gray et al., "Quickly generating
+// billion-record synthetic databases". Rank 0 is the most popular one.
+class ZipfGenerator {
+ public:
+  ZipfGenerator(uint64_t n, double theta) : n(n), theta(theta) {
+    this->zetan = zeta(n, theta);
+    this->alpha = 1.0 / (1.0 - theta);
+    this->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) /
+                (1.0 - zeta(2, theta) / this->zetan);
+  }
+
+  uint64_t next(double u) const {
+    double uz = u * this->zetan;
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + pow(0.5, this->theta)) return 1;
+    uint64_t rank =
+        this->n * pow(this->eta * u - this->eta + 1.0, this->alpha);
+    return rank < this->n ? rank : this->n - 1;
+  }
+
+ private:
+  static double zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++) sum += 1.0 / pow(i, theta);
+    return sum;
+  }
+
+  uint64_t n;
+  double theta;
+  double zetan;
+  double alpha;
+  double eta;
+};
+
+struct alignas(64) WorkerCounters {
+  std::atomic<uint64_t> ops[2];
+  std::atomic<uint64_t> bytes[2];
+  std::atomic<uint64_t> errors;
+};
+
+struct LatencySummary {
+  uint64_t count;
+  uint64_t mean_ns;
+  uint64_t p50_ns;
+  uint64_t p99_ns;
+  uint64_t p999_ns;
+  uint64_t max_ns;
+};
+
+struct Interval {
+  double end_s;
+  double iops[2];
+  double mib_s[2];
+  LatencySummary latency[2];
+  /* Time writers waited for the GC to free a log zone */
+  LatencySummary stall;
+  uint64_t host_bytes_written;
+  uint64_t dev_bytes_written;
+  uint32_t free_log_zones;
+};
+
+static struct user_zns_device *dev;
+static struct Workload work;
+static const ZipfGenerator *zipf = nullptr;
+// The multiplier that scatters the zipfian ranks over the span, so that
+// the popular blocks do not all end up in the first region.
+static uint64_t zipf_stride;
+static std::atomic<bool> stop(false);
+static std::atomic<uint32_t> running(0);
+static LatencyHistogram latency[2];
+
+static uint64_t device_bytes(const struct zns_stats &stats) {
+  return stats.dev_bytes_host + stats.dev_bytes_gc_merge +
+         stats.dev_bytes_gc_insert + stats.dev_bytes_wear_level +
+         stats.dev_bytes_padding + stats.dev_bytes_journal +
+         stats.dev_bytes_checkpoint;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+  while (b != 0) {
+    uint64_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+static uint64_t next_block(std::mt19937_64 *rng, uint64_t *cursor,
+                           uint64_t first, uint64_t count) {
+  if (!work.random) {
+    uint64_t block = first + *cursor;
+    *cursor = (*cursor + 1) % count;
+    return block;
+  }
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  switch (work.dist) {
+    case DIST_ZIPF: {
+      unsigned __int128 rank = zipf->next(unit(*rng));
+      return (uint64_t)((rank * zipf_stride) % work.span_blocks);
+    }
+    case DIST_HOTSPOT: {
+      uint64_t hot = work.span_blocks * work.hot_space;
+      if (hot == 0) hot = 1;
+      if (hot == work.span_blocks || unit(*rng) < work.hot_access) {
+        return std::uniform_int_distribution<uint64_t>(0, hot - 1)(*rng);
+      }
+      return std::uniform_int_distribution<uint64_t>(
+          hot, work.span_blocks - 1)(*rng);
+    }
+    default:
+      return std::uniform_int_distribution<uint64_t>(
+          0, work.span_blocks - 1)(*rng);
+  }
+}
+
+static void worker(uint32_t id, WorkerCounters *counters) {
+  // Every thread draws from its own seeded generator, and sequential
+  // threads each stream through their own slice of the span.
+  std::mt19937_64 rng(work.seed + id);
+  std::uniform_int_distribution<uint32_t> percent(0, 99);
+  const uint64_t count = work.span_blocks / work.threads;
+  const uint64_t first = id * count;
+  uint64_t cursor = 0;
+  char *buffer = (char *)malloc(work.block_size);
+  memset(buffer, 'a' + id % 26, work.block_size);
+  for (uint64_t i = 0; !stop.load(std::memory_order_relaxed) &&
+                       (work.ops_per_thread == 0 || i < work.ops_per_thread);
+       i++) {
+    const int op =
+        percent(rng) < work.read_percent ? ZBENCH_READ : ZBENCH_WRITE;
+    uint64_t address = next_block(&rng, &cursor, first, count) *
+                       work.block_size;
+    uint64_t start = clock_ticks();
+    int ret = op == ZBENCH_READ
+                  ? zns_udevice_read(dev, address, buffer, work.block_size)
+                  : zns_udevice_write(dev, address, buffer, work.block_size);
+    latency[op].record(clock_ticks() - start);
+    if (ret != 0) {
+      fprintf(stderr, "zbench: %s at 0x%lx failed with %d \n",
+              op == ZBENCH_READ ? "read" : "write", address, ret);
+      counters->errors++;
+      break;
+    }
+    counters->ops[op].fetch_add(1, std::memory_order_relaxed);
+    counters->bytes[op].fetch_add(work.block_size, std::memory_order_relaxed);
+  }
+  free(buffer);
+  running--;
+}
+
+static int prefill() {
+  const uint64_t span = work.span_blocks * work.block_size;
+  uint64_t chunk = ZBENCH_PREFILL_BYTES - ZBENCH_PREFILL_BYTES %
+                                             work.block_size;
+  if (chunk == 0) chunk = work.block_size;
+  char *buffer = (char *)malloc(chunk);
+  memset(buffer, 'p', chunk);
+  int ret = 0;
+  for (uint64_t address = 0; address < span && ret == 0; address += chunk) {
+    uint64_t size = span - address < chunk ? span - address : chunk;
+    ret = zns_udevice_write(dev, address, buffer, size);
+  }
+  free(buffer);
+  return ret;
+}
+
+static struct LatencySummary summarize(const HistogramSnapshot &snapshot) {
+  struct LatencySummary out = {};
+  out.count = snapshot.count;
+  if (snapshot.count == 0) return out;
+  out.mean_ns = ticks_to_ns(snapshot.sum / snapshot.count);
+  out.p50_ns = ticks_to_ns(snapshot.percentile(0.5));
+  out.p99_ns = ticks_to_ns(snapshot.percentile(0.99));
+  out.p999_ns = ticks_to_ns(snapshot.percentile(0.999));
+  out.max_ns = ticks_to_ns(snapshot.max());
+  return out;
+}
+
+static struct LatencySummary summarize(const struct zns_latency &latency) {
+  struct LatencySummary out = {latency.count,  latency.mean_ns,
+                               latency.p50_ns, latency.p99_ns,
+                               latency.p999_ns, latency.max_ns};
+  return out;
+}
+
+static void merge(HistogramSnapshot *total, const HistogramSnapshot &part) {
+  for (uint32_t i = 0; i < part.counts.size(); i++) {
+    total->counts[i] += part.counts[i];
+  }
+  total->count += part.count;
+  total->sum += part.sum;
+}
+
+static double write_amplification(uint64_t host, uint64_t device) {
+  return host ? (double)device / host : 0;
+}
+
+static void print_interval(const Interval &interval) {
+  printf("[%6.1fs]", interval.end_s);
+  static const char *names[2] = {"read", "write"};
+  for (int op = ZBENCH_READ; op <= ZBENCH_WRITE; op++) {
+    if (interval.latency[op].count == 0) continue;
+    printf(" %s %.0f iops %.1f MiB/s p50 %.1f p99 %.1f us |", names[op],
+           interval.iops[op], interval.mib_s[op],
+           interval.latency[op].p50_ns / 1000.0,
+           interval.latency[op].p99_ns / 1000.0);
+  }
+  printf(" stalls %lu, wa %.2f, free log zones %u \n",
+         interval.stall.count,
+         write_amplification(interval.host_bytes_written,
+                             interval.dev_bytes_written),
+         interval.free_log_zones);
+}
+
+static void json_latency(FILE *out, const char *name,
+                         const LatencySummary &latency) {
+  fprintf(out,
+          "\"%s\":{\"count\":%lu,\"mean_ns\":%lu,\"p50_ns\":%lu,"
+          "\"p99_ns\":%lu,\"p999_ns\":%lu,\"max_ns\":%lu}",
+          name, latency.count, latency.mean_ns, latency.p50_ns,
+          latency.p99_ns, latency.p999_ns, latency.max_ns);
+}
+
+static void json_interval(FILE *out, const Interval &interval) {
+  fprintf(out,
+          "{\"end_s\":%.3f,\"read_iops\":%.1f,\"read_mib_s\":%.3f,"
+          "\"write_iops\":%.1f,\"write_mib_s\":%.3f,",
+          interval.end_s, interval.iops[ZBENCH_READ],
+          interval.mib_s[ZBENCH_READ], interval.iops[ZBENCH_WRITE],
+          interval.mib_s[ZBENCH_WRITE]);
+  json_latency(out, "read_latency", interval.latency[ZBENCH_READ]);
+  fprintf(out, ",");
+  json_latency(out, "write_latency", interval.latency[ZBENCH_WRITE]);
+  fprintf(out, ",");
+  json_latency(out, "write_stall", interval.stall);
+  fprintf(out,
+          ",\"host_bytes_written\":%lu,\"dev_bytes_written\":%lu,"
+          "\"write_amplification\":%.4f,\"free_log_zones\":%u}",
+          interval.host_bytes_written, interval.dev_bytes_written,
+          write_amplification(interval.host_bytes_written,
+                              interval.dev_bytes_written),
+          interval.free_log_zones);
+}
+
+static int write_json(const char *path, const std::vector<Interval> &intervals,
+                      const Interval &total) {
+  FILE *out = fopen(path, "w");
+  if (out == nullptr) return -errno;
+  static const char *dists[] = {"uniform", "zipf", "hotspot"};
+  fprintf(out,
+          "{\"config\":{\"workload\":\"%s\",\"read_percent\":%u,"
+          "\"block_size\":%u,\"threads\":%u,\"distribution\":\"%s\","
+          "\"zipf_theta\":%.3f,\"hot_space\":%.3f,\"hot_access\":%.3f,"
+          "\"span_bytes\":%lu,\"runtime_s\":%u,\"ops_per_thread\":%lu,"
+          "\"seed\":%lu,\"lba_size\":%u,\"capacity_bytes\":%lu},"
+          "\n\"intervals\":[",
+          work.name, work.read_percent, work.block_size, work.threads,
+          dists[work.dist], work.zipf_theta, work.hot_space, work.hot_access,
+          work.span_blocks * work.block_size, work.runtime_s,
+          work.ops_per_thread, work.seed, dev->lba_size_bytes,
+          dev->capacity_bytes);
+  for (uint32_t i = 0; i < intervals.size(); i++) {
+    fprintf(out, "%s\n", i == 0 ? "" : ",");
+    json_interval(out, intervals[i]);
+  }
+  fprintf(out, "\n],\n\"total\":");
+  json_interval(out, total);
+  fprintf(out, "}\n");
+  return fclose(out) == 0 ? 0 : -errno;
+}
+
+static int parse_workload(const char *name) {
+  static const struct {
+    const char *name;
+    bool random;
+    uint32_t read_percent;
+  } workloads[] = {
+      {"read", false, 100},    {"write", false, 0}, {"randread", true, 100},
+      {"randwrite", true, 0},  {"rw", false, 50},   {"randrw", true, 50},
+  };
+  for (const auto &workload : workloads) {
+    if (strcmp(name, workload.name) == 0) {
+      work.name = workload.name;
+      work.random = workload.random;
+      work.read_percent = workload.read_percent;
+      return 0;
+    }
+  }
+  return -EINVAL;
+}
+
+static int parse_distribution(const char *arg) {
+  if (strcmp(arg, "uniform") == 0) {
+    work.dist = DIST_UNIFORM;
+  } else if (strncmp(arg, "zipf", 4) == 0) {
+    work.dist = DIST_ZIPF;
+    if (arg[4] == ':') work.zipf_theta = atof(arg + 5);
+    if (work.zipf_theta <= 0 || work.zipf_theta >= 1) return -EINVAL;
+  } else if (strncmp(arg, "hotspot", 7) == 0) {
+    work.dist = DIST_HOTSPOT;
+    uint32_t space, access;
+    if (arg[7] == ':') {
+      if (sscanf(arg + 8, "%u:%u", &space, &access) != 2 || space == 0 ||
+          space > 100 || access > 100) {
+        return -EINVAL;
+      }
+      work.hot_space = space / 100.0;
+      work.hot_access = access / 100.0;
+    }
+  } else {
+    return -EINVAL;
+  }
+  return 0;
+}
+
+static int show_help() {
+  printf("Usage: zbench -d device_name [options] \n");
+  printf("-d : nvmeXpY or /dev/nvmeXpY, the device to run on, it is reset. \n");
+  printf("-l : the number of log zones (default, 3). \n");
+  printf("-w : the GC watermark in free log zones (default, 1). \n");
+  printf("-b : run the GC in the background instead of on-demand. \n");
+  printf("-g : bandwidth budget of the background GC in MiB/s. \n");
+  printf("-t : separate hot and cold data in different log zones. \n");
+  printf("-c : checksum every block and verify it when it is read. \n");
+  printf(
+      "-k : read, write, randread, randwrite, rw or randrw (default, "
+      "randwrite). \n");
+  printf("-m : the share of reads in percent for rw and randrw (50). \n");
+  printf("-s : the block size in bytes, a multiple of the LBA size. \n");
+  printf("-j : the number of threads (default, 1). \n");
+  printf(
+      "-D : uniform, zipf[:theta] or hotspot[:space:access] for random "
+      "workloads (default, uniform). zipf defaults to a theta of 0.99, "
+      "hotspot to 80%% of the accesses to the first 20%% of the span. \n");
+  printf("-S : the span of the addresses in MiB (default, the capacity). \n");
+  printf("-R : the runtime in seconds (default, 10). \n");
+  printf("-n : stop each thread after [int] operations (default, none). \n");
+  printf("-i : the report interval in seconds (default, 1). \n");
+  printf("-e : the seed of the addresses (default, 1). \n");
+  printf("-o : write the intervals and the totals as JSON to [file]. \n");
+  printf(
+      "-N : do not write the span before a workload that reads, unwritten "
+      "blocks are read without touching the device. \n");
+  printf("-h : shows help, and exits with success. \n");
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  struct zdev_init_params params = {};
+  params.log_zones = 3;
+  params.gc_wmark = 1;
+  params.force_reset = true;
+  parse_workload("randwrite");
+  work.threads = 1;
+  work.dist = DIST_UNIFORM;
+  work.zipf_theta = 0.99;
+  work.hot_space = 0.2;
+  work.hot_access = 0.8;
+  work.runtime_s = 10;
+  work.interval_s = 1;
+  work.seed = 1;
+  const char *device = nullptr;
+  const char *json_file = nullptr;
+  uint64_t span_mib = 0;
+  int read_percent = -1;
+  bool skip_prefill = false;
+  int c;
+  while ((c = getopt(argc, argv, "d:l:w:g:k:m:s:j:D:S:R:n:i:e:o:btcNh")) !=
+         -1) {
+    switch (c) {
+      case 'h':
+        show_help();
+        exit(0);
+      case 'd':
+        // The FTL wants the name without /dev/.
+        device = strrchr(optarg, '/') ? strrchr(optarg, '/') + 1 : optarg;
+        break;
+      case 'l':
+        params.log_zones = atoi(optarg);
+        break;
+      case 'w':
+        params.gc_wmark = atoi(optarg);
+        break;
+      case 'b':
+        params.gc_mode = ZNS_GC_BACKGROUND;
+        break;
+      case 'g':
+        params.gc_rate_mbps = atoi(optarg);
+        break;
+      case 't':
+        params.hot_cold = true;
+        break;
+      case 'c':
+        params.checksums = true;
+        break;
+      case 'k':
+        if (parse_workload(optarg) != 0) {
+          fprintf(stderr, "zbench: unknown workload %s \n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'm':
+        read_percent = atoi(optarg);
+        break;
+      case 's':
+        work.block_size = atoi(optarg);
+        break;
+      case 'j':
+        work.threads = atoi(optarg);
+        break;
+      case 'D':
+        if (parse_distribution(optarg) != 0) {
+          fprintf(stderr, "zbench: bad distribution %s \n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'S':
+        span_mib = strtoull(optarg, nullptr, 10);
+        break;
+      case 'R':
+        work.runtime_s = atoi(optarg);
+        break;
+      case 'n':
+        work.ops_per_thread = strtoull(optarg, nullptr, 10);
+        break;
+      case 'i':
+        work.interval_s = atoi(optarg);
+        break;
+      case 'e':
+        work.seed = strtoull(optarg, nullptr, 10);
+        break;
+      case 'o':
+        json_file = optarg;
+        break;
+      case 'N':
+        skip_prefill = true;
+        break;
+      default:
+        show_help();
+        return EXIT_FAILURE;
+    }
+  }
+  if (device == nullptr || params.log_zones < 3 || params.gc_wmark < 1 ||
+      work.threads == 0 || work.interval_s == 0 || read_percent > 100) {
+    show_help();
+    return EXIT_FAILURE;
+  }
+  if (read_percent >= 0 && work.read_percent != 0 &&
+      work.read_percent != 100) {
+    work.read_percent = read_percent;
+  }
+  params.name = strdup(device);
+  int ret = init_ss_zns_device(&params, &dev);
+  if (ret != 0) {
+    fprintf(stderr, "zbench: cannot open %s: %d \n", params.name, ret);
+    return EXIT_FAILURE;
+  }
+  if (work.block_size == 0) work.block_size = dev->lba_size_bytes;
+  uint64_t span = dev->capacity_bytes;
+  if (span_mib != 0 && span_mib * 1024 * 1024 < span) {
+    span = span_mib * 1024 * 1024;
+  }
+  work.span_blocks = span / work.block_size;
+  if (work.block_size % dev->lba_size_bytes != 0 ||
+      work.span_blocks < work.threads) {
+    fprintf(stderr,
+            "zbench: the block size must be a multiple of %u and the span "
+            "must have a block per thread \n",
+            dev->lba_size_bytes);
+    deinit_ss_zns_device(dev, false);
+    return EXIT_FAILURE;
+  }
+  if (work.random && work.dist == DIST_ZIPF) {
+    zipf = new ZipfGenerator(work.span_blocks, work.zipf_theta);
+    zipf_stride = 0x9e3779b97f4a7c15ULL % work.span_blocks;
+    while (zipf_stride == 0 || gcd(zipf_stride, work.span_blocks) != 1) {
+      zipf_stride = (zipf_stride + 1) % work.span_blocks;
+    }
+  }
+  printf(
+      "%s of %u bytes by %u threads over %lu MiB, %u%% reads, seed %lu \n",
+      work.name, work.block_size, work.threads,
+      work.span_blocks * work.block_size / (1024 * 1024), work.read_percent,
+      work.seed);
+  if (work.read_percent != 0 && !skip_prefill) {
+    printf("writing the span before reading it \n");
+    ret = prefill();
+    if (ret != 0) {
+      fprintf(stderr, "zbench: writing the span failed with %d \n", ret);
+      deinit_ss_zns_device(dev, false);
+      return EXIT_FAILURE;
+    }
+  }
+
+  struct zns_stats first = {}, last = {};
+  struct zns_latency stall = {};
+  zns_udevice_get_stats(dev, &first);
+  zns_udevice_get_latency(dev, ZNS_LAT_WRITE_STALL, &stall, true);
+  last = first;
+  std::vector<WorkerCounters> counters(work.threads);
+  for (WorkerCounters &counter : counters) {
+    for (int op = ZBENCH_READ; op <= ZBENCH_WRITE; op++) {
+      counter.ops[op] = 0;
+      counter.bytes[op] = 0;
+    }
+    counter.errors = 0;
+  }
+  std::vector<std::thread> threads;
+  running = work.threads;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < work.threads; i++) {
+    threads.emplace_back(worker, i, &counters[i]);
+  }
+
+  std::vector<Interval> intervals;
+  HistogramSnapshot totals[2];
+  for (HistogramSnapshot &total : totals) {
+    total.counts.assign(HISTOGRAM_BUCKETS, 0);
+    total.count = 0;
+    total.sum = 0;
+  }
+  uint64_t ops[2] = {}, bytes[2] = {};
+  double previous_s = 0;
+  bool done = false;
+  while (!done) {
+    // Sleep until the next report, or until the threads are done.
+    const auto deadline =
+        start + std::chrono::seconds(work.interval_s * (intervals.size() + 1));
+    while (running != 0 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    const double now_s = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    if (running == 0 || now_s >= work.runtime_s) {
+      stop = true;
+      for (std::thread &thread : threads) thread.join();
+      done = true;
+    }
+    Interval interval = {};
+    interval.end_s = now_s;
+    const double seconds = now_s - previous_s;
+    for (int op = ZBENCH_READ; op <= ZBENCH_WRITE; op++) {
+      uint64_t op_count = 0, op_bytes = 0;
+      for (WorkerCounters &counter : counters) {
+        op_count += counter.ops[op];
+        op_bytes += counter.bytes[op];
+      }
+      interval.iops[op] = (op_count - ops[op]) / seconds;
+      interval.mib_s[op] = (op_bytes - bytes[op]) / seconds / (1024 * 1024);
+      ops[op] = op_count;
+      bytes[op] = op_bytes;
+      HistogramSnapshot snapshot;
+      latency[op].snapshot(&snapshot, true);
+      interval.latency[op] = summarize(snapshot);
+      merge(&totals[op], snapshot);
+    }
+    zns_udevice_get_latency(dev, ZNS_LAT_WRITE_STALL, &stall, true);
+    interval.stall = summarize(stall);
+    struct zns_stats stats = {};
+    zns_udevice_get_stats(dev, &stats);
+    interval.host_bytes_written =
+        stats.host_bytes_written - last.host_bytes_written;
+    interval.dev_bytes_written = device_bytes(stats) - device_bytes(last);
+    interval.free_log_zones = stats.free_log_zones;
+    last = stats;
+    previous_s = now_s;
+    print_interval(interval);
+    intervals.push_back(interval);
+  }
+
+  Interval total = {};
+  total.end_s = previous_s;
+  uint64_t errors = 0;
+  for (WorkerCounters &counter : counters) errors += counter.errors;
+  for (int op = ZBENCH_READ; op <= ZBENCH_WRITE; op++) {
+    total.iops[op] = ops[op] / previous_s;
+    total.mib_s[op] = bytes[op] / previous_s / (1024 * 1024);
+    total.latency[op] = summarize(totals[op]);
+  }
+  // The stalls are only kept per interval, so the total has their count
+  // and the longest one.
+  for (const Interval &interval : intervals) {
+    total.stall.count += interval.stall.count;
+    total.stall.max_ns = std::max(total.stall.max_ns, interval.stall.max_ns);
+  }
+  total.host_bytes_written =
+      last.host_bytes_written - first.host_bytes_written;
+  total.dev_bytes_written = device_bytes(last) - device_bytes(first);
+  total.free_log_zones = last.free_log_zones;
+  printf("total: \n");
+  print_interval(total);
+  static const char *names[2] = {"read", "write"};
+  for (int op = ZBENCH_READ; op <= ZBENCH_WRITE; op++) {
+    if (total.latency[op].count == 0) continue;
+    printf(
+        "%s latency (us): mean %.1f p50 %.1f p99 %.1f p99.9 %.1f max %.1f \n",
+        names[op], total.latency[op].mean_ns / 1000.0,
+        total.latency[op].p50_ns / 1000.0, total.latency[op].p99_ns / 1000.0,
+        total.latency[op].p999_ns / 1000.0, total.latency[op].max_ns / 1000.0);
+  }
+  if (json_file != nullptr) {
+    ret = write_json(json_file, intervals, total);
+    if (ret != 0) {
+      fprintf(stderr, "zbench: cannot write %s: %d \n", json_file, ret);
+    }
+  }
+  deinit_ss_zns_device(dev, false);
+  delete zipf;
+  free(params.name);
+  return errors == 0 && ret == 0 ? 0 : EXIT_FAILURE;
+}
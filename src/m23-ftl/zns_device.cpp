@@ -41,11 +41,14 @@ SOFTWARE.
 #include <variant>
 #include <vector>
 
+#include "../common/lockstat.h"
 #include "../common/nvmewrappers.h"
+#include "../common/trace.h"
 #include "../common/unused.h"
 #include "../common/utils.h"
 #include "ftl.hpp"
 #include "ftlgc.hpp"
+#include "telemetry.hpp"
 #include "zone.hpp"
 
 extern "C" {
@@ -111,6 +114,10 @@ int init_ss_zns_device(struct zdev_init_params *params,
     return ret;
   }
   uint32_t lba_size_in_use = 1 << ns.lbaf[(ns.flbas & 0xf)].ds;
+  // We can only keep our BlockMeta in a separate metadata buffer, with
+  // extended LBAs the metadata would be part of the data.
+  uint16_t meta_size = le16_to_cpu(ns.lbaf[(ns.flbas & 0xf)].ms);
+  if ((ns.flbas & 0x10) || meta_size < sizeof(struct BlockMeta)) meta_size = 0;
 
   // Calculate MDTS_size for later use.
   // Copy the name of the target partition and strip the last numbers so
@@ -153,10 +160,17 @@ int init_ss_zns_device(struct zdev_init_params *params,
   uint64_t MDTS = (uint64_t)ctrl.mdts - 1;
   uint64_t MDTS_SIZE = (1 << MDTS) * MPSMIN;
 
-  FTL *ftl = new FTL(fd, MDTS_SIZE, nsid, lba_size_in_use, params->gc_wmark,
-                     params->log_zones, params->force_reset);
+  FTL *ftl =
+      new FTL(fd, MDTS_SIZE, nsid, lba_size_in_use, meta_size, params);
   free(path);
   close(sysfd);
+  if (ftl->open_error != 0) {
+    ret = ftl->open_error;
+    delete ftl;
+    munmap(regs, getpagesize());
+    close(fd);
+    return ret;
+  }
 
   struct zns_device_testing_params tparams {
     .zns_lba_size = lba_size_in_use,
@@ -168,8 +182,9 @@ int init_ss_zns_device(struct zdev_init_params *params,
       (user_zns_device *)malloc(sizeof(struct user_zns_device));
   device->lba_size_bytes = lba_size_in_use,
   device->capacity_bytes =
-      (ns.ncap - (ftl->log_zones + 1) * ftl->zcap) *
-      lba_size_in_use,  // ZNS capacity - log zones (includes metadata).
+      (ns.ncap - (ftl->log_zones + FTL_RESERVED_ZONES + FTL_META_ZONES) *
+                     ftl->zcap) *
+      lba_size_in_use,  // ZNS capacity - log, reserved and metadata zones.
       device->tparams = tparams;
   device->_private = ftl;
   *my_dev = device;
@@ -197,4 +212,80 @@ int zns_udevice_write(struct user_zns_device *my_dev, uint64_t address,
   uint32_t ret_size = flt->write(address, buffer, size);
   return ret_size;
 }
+
+int zns_udevice_write_hint(struct user_zns_device *my_dev, uint64_t address,
+                           void *buffer, uint32_t size,
+                           enum zns_write_hint hint) {
+  // cppcheck-suppress cstyleCast
+  FTL *flt = (FTL *)my_dev->_private;
+  return flt->write(address, buffer, size, hint);
+}
+
+int zns_udevice_flush(struct user_zns_device *my_dev) {
+  // cppcheck-suppress cstyleCast
+  FTL *flt = (FTL *)my_dev->_private;
+  return flt->flush();
+}
+
+int zns_udevice_get_stats(struct user_zns_device *my_dev,
+                          struct zns_stats *stats) {
+  // cppcheck-suppress cstyleCast
+  FTL *flt = (FTL *)my_dev->_private;
+  flt->get_stats(stats);
+  return 0;
+}
+
+int zns_udevice_get_memory(struct user_zns_device *my_dev,
+                           struct zns_mem_stats *mem) {
+  // cppcheck-suppress cstyleCast
+  FTL *flt = (FTL *)my_dev->_private;
+  flt->get_memory(mem);
+  return 0;
+}
+
+int zns_udevice_get_latency(struct user_zns_device *my_dev,
+                            enum zns_latency_op op, struct zns_latency *out,
+                            bool reset) {
+  // cppcheck-suppress cstyleCast
+  FTL *flt = (FTL *)my_dev->_private;
+  return flt->get_latency(op, out, reset);
+}
+
+int zns_udevice_get_zones(struct user_zns_device *my_dev,
+                          struct zns_zone_info *zones, uint32_t max) {
+  // cppcheck-suppress cstyleCast
+  FTL *flt = (FTL *)my_dev->_private;
+  return flt->get_zones(zones, max);
+}
+
+int zns_udevice_dump_zones(struct user_zns_device *my_dev, FILE *out,
+                           enum zns_zone_format format) {
+  // cppcheck-suppress cstyleCast
+  FTL *flt = (FTL *)my_dev->_private;
+  std::vector<zns_zone_info> zones(flt->get_zones(nullptr, 0));
+  flt->get_zones(zones.data(), zones.size());
+  return write_zones(out, zones.data(), zones.size(), format);
+}
+
+int zns_udevice_get_gc_history(struct user_zns_device *my_dev,
+                               struct zns_gc_record *records, uint32_t max) {
+  // cppcheck-suppress cstyleCast
+  FTL *flt = (FTL *)my_dev->_private;
+  return flt->gc_history.get(records, max);
+}
+
+int zns_udevice_dump_gc_history(struct user_zns_device *my_dev, FILE *out,
+                                enum zns_zone_format format) {
+  // cppcheck-suppress cstyleCast
+  FTL *flt = (FTL *)my_dev->_private;
+  std::vector<zns_gc_record> records(GC_HISTORY_CYCLES);
+  uint32_t count = flt->gc_history.get(records.data(), records.size());
+  return write_gc_records(out, records.data(), count, format);
+}
+
+void zns_trace_enable(bool on) { trace_enable(on); }
+
+int zns_trace_dump(const char *path) { return trace_dump(path); }
+
+void zns_lockstat_dump(FILE *out) { lockstat_dump(out); }
 }
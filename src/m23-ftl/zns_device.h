@@ -25,6 +25,7 @@ SOFTWARE.
 
 #include <libnvme.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include "../common/nvmewrappers.h"
 
@@ -90,12 +91,217 @@ struct user_zns_device {
  *
  * The data zone size would be the capacity exposed to the user for read/write.
  * The log space is used internally by your FTL. With the default values:
+ *
+ * gc_mode: ZNS_GC_ONDEMAND (the default, 0) only wakes the GC once the
+ * writers drop to gc_wmark free log zones. ZNS_GC_BACKGROUND also reclaims
+ * full log zones while the host is idle, and throttles the writers in
+ * proportion to the free-space pressure before they run into gc_wmark.
+ *
+ * gc_rate_mbps: bandwidth budget in MiB/s for the idle reclamation of the
+ * background GC. Zero picks GC_DEFAULT_RATE_MBPS. GC triggered by space
+ * pressure is never rate limited.
+ *
+ * hot_cold: track how often each part of the address space is
+ * overwritten, and append hot and cold writes to separate log zones so
+ * that the GC mostly finds dead blocks in the zones holding hot data.
+ *
+ * media_scan: when not resetting, rebuild the maps from the LBA and
+ * sequence number stored in the metadata of every block instead of from
+ * the checkpoint and journal. Needs a format with at least 16 bytes of
+ * separate metadata per LBA, and is also done if there is no checkpoint.
+ *
+ * lazy_restore: when restoring from the checkpoint, only load its index
+ * and admit I/O right away. Each region of the log map is loaded on its
+ * first access, while a background thread loads the rest. The GC waits
+ * for the whole map. Ignored with media_scan.
+ *
+ * checksums: keep a CRC32C of every block and check it on every read,
+ * which then fails with -EIO on a mismatch. The checksums are stored in
+ * the metadata of the blocks if the format has 8 bytes to spare after
+ * the BlockMeta, otherwise only blocks written since start-up are checked.
  */
+#define ZNS_GC_ONDEMAND 0
+#define ZNS_GC_BACKGROUND 1
+
+/* Lifetime hints for zns_udevice_write_hint. They mirror RocksDB's
+ * Env::WriteLifeTimeHint so that file systems can pass them through
+ * as-is. Writes that share a hint are appended to the same log zones,
+ * so data that dies together is placed together. */
+enum zns_write_hint {
+  ZNS_WLTH_NOT_SET = 0,
+  ZNS_WLTH_NONE,
+  ZNS_WLTH_SHORT,
+  ZNS_WLTH_MEDIUM,
+  ZNS_WLTH_LONG,
+  ZNS_WLTH_EXTREME,
+};
+
+/* Counters of a device since it was opened. The bytes written to the
+ * device are split by what caused them, host writes are rounded up to
+ * whole blocks. */
+struct zns_stats {
+  uint64_t host_bytes_read;
+  uint64_t host_bytes_written;
+  uint64_t dev_bytes_host;
+  /* GC copies into a new zone for a region that had a data zone */
+  uint64_t dev_bytes_gc_merge;
+  /* GC copies for a region that had no data zone yet */
+  uint64_t dev_bytes_gc_insert;
+  /* Cold data moved to a more worn zone */
+  uint64_t dev_bytes_wear_level;
+  /* Zeroes written to skip unused blocks in data zones */
+  uint64_t dev_bytes_padding;
+  uint64_t dev_bytes_journal;
+  uint64_t dev_bytes_checkpoint;
+  /* Log and data zones reset by the GC */
+  uint64_t zone_resets;
+  uint64_t gc_cycles;
+  uint64_t log_map_entries;
+  uint64_t data_map_entries;
+  uint32_t free_log_zones;
+  uint32_t free_data_zones;
+  /* All bytes written to the device over host_bytes_written, 0 until
+   * the host wrote something */
+  double write_amplification;
+};
+
+/* Heap bytes used by the FTL, by the structure they are used for. The
+ * maps are estimated from their size, so malloc overhead is missing. */
+struct zns_mem_stats {
+  uint64_t log_map_bytes;
+  uint64_t data_map_bytes;
+  /* Which blocks of each log and data zone are valid */
+  uint64_t block_map_bytes;
+  /* Checksums that do not fit in the metadata of the blocks */
+  uint64_t checksum_bytes;
+  /* Journal entries waiting to be written */
+  uint64_t journal_bytes;
+  /* Write counters for the hot and cold separation */
+  uint64_t heat_bytes;
+  /* Lists of blocks the GC is moving, now and at most */
+  uint64_t gc_scratch_bytes;
+  uint64_t gc_scratch_peak_bytes;
+  /* Everything above but the peak */
+  uint64_t total_bytes;
+};
+
+/* Operations with a latency histogram, see zns_udevice_get_latency */
+enum zns_latency_op {
+  ZNS_LAT_READ = 0,
+  ZNS_LAT_WRITE,
+  /* Time writers spent blocked until the GC freed a log zone */
+  ZNS_LAT_WRITE_STALL,
+  ZNS_LAT_GC_CYCLE,
+  ZNS_LAT_ZONE_RESET,
+  /* Every NVMe command, for all devices in the process */
+  ZNS_LAT_NVME,
+  ZNS_LAT_OPS,
+};
+
+/* Latency percentiles of an operation. They are accurate to about 3%,
+ * and rounded up. */
+struct zns_latency {
+  uint64_t count;
+  uint64_t mean_ns;
+  uint64_t p50_ns;
+  uint64_t p99_ns;
+  uint64_t p999_ns;
+  uint64_t max_ns;
+};
+
+enum zns_zone_type {
+  ZNS_ZONE_LOG = 0,
+  ZNS_ZONE_DATA,
+};
+
+/* Where the write pointer of a zone is, open zones are partly written */
+enum zns_zone_state {
+  ZNS_ZONE_EMPTY = 0,
+  ZNS_ZONE_OPEN,
+  ZNS_ZONE_FULL,
+};
+
+/* A zone in the snapshot of zns_udevice_get_zones. Zone positions are
+ * device LBAs and counts are in blocks, while region is a byte address
+ * like the ones passed to zns_udevice_read. */
+struct zns_zone_info {
+  uint32_t zone_id;
+  enum zns_zone_type type;
+  enum zns_zone_state state;
+  /* Log stream that opened a log zone, -1 for data zones */
+  int32_t stream;
+  /* A stream is appending to the log zone right now */
+  bool active;
+  /* Holds hot data, by its stream or for data zones by how the GC
+   * placed the region */
+  bool hot;
+  uint64_t slba;
+  uint64_t write_pointer;
+  uint64_t capacity;
+  uint64_t valid_blocks;
+  uint32_t reset_count;
+  /* Start of the region a data zone is mapped to, UINT64_MAX if none */
+  uint64_t region;
+  /* Microseconds since the last write to the zone, UINT64_MAX if it was
+   * not written since it was opened or reset */
+  uint64_t idle_us;
+};
+
+/* One cycle of the GC, see zns_udevice_get_gc_history. A cycle collects
+ * the victim log zone, and then moves cold data for wear leveling. */
+struct zns_gc_record {
+  /* Number of the cycle since the device was opened */
+  uint64_t cycle;
+  /* Start of the cycle on the monotonic clock, in microseconds */
+  uint64_t start_us;
+  uint32_t victim_zone;
+  uint32_t victim_capacity;
+  /* Valid blocks of the victim when it was picked */
+  uint32_t victim_valid;
+  /* Regions the valid blocks belonged to */
+  uint32_t groups;
+  /* Regions merged with their data zone, and regions that got one */
+  uint32_t merges;
+  uint32_t inserts;
+  /* Blocks copied, including the ones moved for wear leveling */
+  uint64_t blocks_read;
+  uint64_t blocks_written;
+  /* Blocks of zeroes written to skip unused blocks in data zones */
+  uint64_t blocks_padded;
+  /* Time spent in each phase of the cycle */
+  uint64_t select_ns;
+  uint64_t group_ns;
+  uint64_t merge_ns;
+  uint64_t insert_ns;
+  uint64_t reset_ns;
+  uint64_t wear_level_ns;
+  uint64_t total_ns;
+  /* Run in the background and rate limited, rather than for writers */
+  bool paced;
+};
+
+/* Output formats of zns_udevice_dump_zones. The heatmap has a character
+ * per zone that gets denser with the share of valid blocks. */
+enum zns_zone_format {
+  ZNS_ZONES_JSON = 0,
+  ZNS_ZONES_CSV,
+  ZNS_ZONES_HEATMAP,
+};
+
 struct zdev_init_params {
   char *name;
   int log_zones;
   int gc_wmark;
   bool force_reset;
+  int gc_mode;
+  uint32_t gc_rate_mbps;
+  bool hot_cold;
+  bool media_scan;
+  bool lazy_restore;
+  bool checksums;
+  /* Only inspect the device: nothing is written, no GC or checkpoints
+   * run and writes fail with -EROFS. */
+  bool read_only;
 };
 
 int init_ss_zns_device(struct zdev_init_params *,
@@ -104,6 +310,51 @@ int zns_udevice_read(struct user_zns_device *my_dev, uint64_t address,
                      void *buffer, uint32_t size);
 int zns_udevice_write(struct user_zns_device *my_dev, uint64_t address,
                       void *buffer, uint32_t size);
+int zns_udevice_write_hint(struct user_zns_device *my_dev, uint64_t address,
+                           void *buffer, uint32_t size,
+                           enum zns_write_hint hint);
+/* Make every write that has completed durable. Concurrent callers are
+ * coalesced into a single device flush, and a call with nothing new to
+ * flush returns right away. Fails with -EIO if the mappings could not
+ * be made durable, a later call tries again. */
+int zns_udevice_flush(struct user_zns_device *my_dev);
+/* Get a snapshot of the counters of the device. */
+int zns_udevice_get_stats(struct user_zns_device *my_dev,
+                          struct zns_stats *stats);
+/* Get the memory used by the FTL, the log map usually dominates as it
+ * grows with the data in the log zones. */
+int zns_udevice_get_memory(struct user_zns_device *my_dev,
+                           struct zns_mem_stats *mem);
+/* Summarize the latencies of op since the device was opened or since
+ * the last call with reset set. */
+int zns_udevice_get_latency(struct user_zns_device *my_dev,
+                            enum zns_latency_op op, struct zns_latency *out,
+                            bool reset);
+/* Fill zones with up to max zones, log zones first, and return how many
+ * the device has. The snapshot is taken while I/O goes on, so the valid
+ * counts of zones being written or collected may be a bit off. */
+int zns_udevice_get_zones(struct user_zns_device *my_dev,
+                          struct zns_zone_info *zones, uint32_t max);
+/* Write a snapshot of all zones to out in the given format. */
+int zns_udevice_dump_zones(struct user_zns_device *my_dev, FILE *out,
+                           enum zns_zone_format format);
+/* Copy the last up to max GC cycles to records, oldest first, and return
+ * how many were copied. Only the last 1024 cycles are kept. */
+int zns_udevice_get_gc_history(struct user_zns_device *my_dev,
+                               struct zns_gc_record *records, uint32_t max);
+/* Write the kept GC cycles to out as JSON or CSV, with the valid ratio
+ * of each victim. */
+int zns_udevice_dump_gc_history(struct user_zns_device *my_dev, FILE *out,
+                                enum zns_zone_format format);
+/* Turn event tracing on or off for the whole process, and write the
+ * events recorded so far to path. ztrace converts the file to a trace
+ * that Perfetto or chrome://tracing can show. */
+void zns_trace_enable(bool on);
+int zns_trace_dump(const char *path);
+/* Write how often each of the FTL and file system locks was taken and
+ * contended, and for how long it was waited for and held. Only builds
+ * with STOSYS_LOCKSTAT profile the locks. */
+void zns_lockstat_dump(FILE *out);
 int deinit_ss_zns_device(struct user_zns_device *my_dev, const bool rese);
 void disable_gc(struct user_zns_device *my_dev);
 void enable_gc();
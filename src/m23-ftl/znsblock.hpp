@@ -31,4 +31,14 @@ struct ZNSBlock {
   bool valid;
 };
 
+/** Stored in the per-LBA metadata of every block the FTL writes, if the
+ * format has separate metadata of at least this size. A seq of zero
+ * marks padding. */
+struct BlockMeta {
+  /** Logical address, in bytes, the block belongs to */
+  uint64_t lba;
+  /** Write order, copies made by the GC keep the seq of the original */
+  uint64_t seq;
+};
+
 #endif
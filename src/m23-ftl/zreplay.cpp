@@ -0,0 +1,637 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+// Replays a block I/O trace against the FTL API and reports the latencies
+// and the write amplification. It reads blkparse text output, the CSV
+// traces of MSR Cambridge and its own binary format, which -C converts
+// the other two to so that large traces load quickly. Flushes and FUA
+// writes in blkparse traces are replayed with zns_udevice_flush.
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../common/histogram.h"
+#include "../common/utils.h"
+#include "zns_device.h"
+
+#define REPLAY_MAGIC 0x3159414c5045525aULL  // "ZREPLAY1"
+#define REPLAY_VERSION 2
+
+#define REPLAY_READ 0
+#define REPLAY_WRITE 1
+/** A cache flush, it has no offset or size */
+#define REPLAY_FLUSH 2
+#define REPLAY_OPS 3
+
+/** blkparse addresses are in sectors of this size */
+#define REPLAY_SECTOR_SIZE 512
+
+/** Header of the binary format, followed by count ReplayRecords sorted by
+ * time. */
+struct ReplayFileHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t count;
+};
+
+struct ReplayRecord {
+  /* Since the first request of the trace */
+  uint64_t time_ns;
+  uint64_t offset;
+  uint32_t size;
+  uint32_t op;
+};
+
+enum TraceFormat {
+  FORMAT_BLKPARSE = 0,
+  FORMAT_MSR,
+  FORMAT_BINARY,
+};
+
+enum Timing {
+  /* Issue the next request as soon as a thread is free */
+  TIMING_AFAP = 0,
+  /* Issue every request at its time in the trace, scaled by speedup */
+  TIMING_TRACE,
+};
+
+enum Remap {
+  /* Addresses past the capacity wrap around */
+  REMAP_WRAP = 0,
+  /* The highest address of the trace is scaled to the capacity */
+  REMAP_SCALE,
+};
+
+struct alignas(64) WorkerCounters {
+  std::atomic<uint64_t> ops[REPLAY_OPS];
+  std::atomic<uint64_t> bytes[REPLAY_OPS];
+  std::atomic<uint64_t> errors;
+};
+
+static struct user_zns_device *dev;
+static std::vector<ReplayRecord> records;
+static std::atomic<uint64_t> next_record(0);
+static enum Timing timing = TIMING_AFAP;
+static double speedup = 1.0;
+static std::chrono::steady_clock::time_point start;
+static LatencyHistogram latency[REPLAY_OPS];
+// How late requests were issued compared to the trace, in microseconds
+static LatencyHistogram lateness;
+
+static int parse_blkparse(FILE *in) {
+  char line[512];
+  bool first = true;
+  double origin = 0;
+  while (fgets(line, sizeof(line), in) != nullptr) {
+    // Only the queue events, so that every request is replayed once.
+    double time;
+    char action[16], rwbs[16];
+    uint64_t sector;
+    uint32_t sectors;
+    if (sscanf(line, "%*s %*u %*u %lf %*u %15s %15s %lu + %u", &time, action,
+               rwbs, &sector, &sectors) != 5 ||
+        strcmp(action, "Q") != 0) {
+      continue;
+    }
+    // Discards are not part of the FTL API. An F in front is a flush
+    // before the data, anywhere else it is FUA, which is replayed as a
+    // flush after the data.
+    bool write = strchr(rwbs, 'W') != nullptr;
+    bool data = sectors != 0 && (write || strchr(rwbs, 'R') != nullptr);
+    bool preflush = rwbs[0] == 'F';
+    bool fua = strchr(rwbs + 1, 'F') != nullptr;
+    if (strchr(rwbs, 'D') != nullptr || (!data && !preflush && !fua)) {
+      continue;
+    }
+    if (first) origin = time;
+    first = false;
+    ReplayRecord record;
+    record.time_ns = time > origin ? (time - origin) * 1e9 : 0;
+    record.offset = 0;
+    record.size = 0;
+    record.op = REPLAY_FLUSH;
+    if (preflush) records.push_back(record);
+    if (data) {
+      record.offset = sector * REPLAY_SECTOR_SIZE;
+      record.size = sectors * REPLAY_SECTOR_SIZE;
+      record.op = write ? REPLAY_WRITE : REPLAY_READ;
+      records.push_back(record);
+    }
+    if (fua && (data || !preflush)) {
+      record.offset = 0;
+      record.size = 0;
+      record.op = REPLAY_FLUSH;
+      records.push_back(record);
+    }
+  }
+  return 0;
+}
+
+static int parse_msr(FILE *in) {
+  char line[512];
+  bool first = true;
+  uint64_t origin = 0;
+  while (fgets(line, sizeof(line), in) != nullptr) {
+    // Timestamp,Hostname,DiskNumber,Type,Offset,Size,ResponseTime, with
+    // the timestamp in 100 ns units.
+    uint64_t stamp, offset;
+    uint32_t size;
+    char type[16];
+    if (sscanf(line, "%lu,%*[^,],%*u,%15[^,],%lu,%u", &stamp, type, &offset,
+               &size) != 4 ||
+        size == 0) {
+      continue;
+    }
+    if (first) origin = stamp;
+    first = false;
+    ReplayRecord record;
+    record.time_ns = stamp > origin ? (stamp - origin) * 100 : 0;
+    record.offset = offset;
+    record.size = size;
+    record.op = strcasecmp(type, "Write") == 0 ? REPLAY_WRITE : REPLAY_READ;
+    records.push_back(record);
+  }
+  return 0;
+}
+
+static int parse_binary(FILE *in) {
+  struct ReplayFileHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      header.magic != REPLAY_MAGIC || header.version != REPLAY_VERSION ||
+      header.record_size != sizeof(ReplayRecord)) {
+    return -EINVAL;
+  }
+  // The count comes from the file, a truncated or corrupt one must not
+  // make us allocate more than the file can hold.
+  long start = ftell(in);
+  if (start < 0 || fseek(in, 0, SEEK_END) != 0) return -errno;
+  long end = ftell(in);
+  if (end < 0 || fseek(in, start, SEEK_SET) != 0) return -errno;
+  if (header.count > (uint64_t)(end - start) / header.record_size) {
+    return -EINVAL;
+  }
+  records.resize(header.count);
+  if (fread(records.data(), sizeof(ReplayRecord), header.count, in) !=
+      header.count) {
+    return -EINVAL;
+  }
+  for (const ReplayRecord &record : records) {
+    if (record.op >= REPLAY_OPS) return -EINVAL;
+  }
+  return 0;
+}
+
+static int load_trace(const char *path, enum TraceFormat format) {
+  FILE *in = fopen(path, format == FORMAT_BINARY ? "rb" : "r");
+  if (in == nullptr) return -errno;
+  int ret;
+  switch (format) {
+    case FORMAT_MSR:
+      ret = parse_msr(in);
+      break;
+    case FORMAT_BINARY:
+      ret = parse_binary(in);
+      break;
+    default:
+      ret = parse_blkparse(in);
+      break;
+  }
+  fclose(in);
+  // blkparse merges the events of all CPUs, which are not quite in order.
+  std::stable_sort(records.begin(), records.end(),
+                   [](const ReplayRecord &a, const ReplayRecord &b) {
+                     return a.time_ns < b.time_ns;
+                   });
+  return ret;
+}
+
+static int write_binary(const char *path) {
+  FILE *out = fopen(path, "wb");
+  if (out == nullptr) return -errno;
+  struct ReplayFileHeader header = {REPLAY_MAGIC, REPLAY_VERSION,
+                                    sizeof(ReplayRecord), records.size()};
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+            fwrite(records.data(), sizeof(ReplayRecord), records.size(),
+                   out) == records.size();
+  if (fclose(out) != 0) ok = false;
+  return ok ? 0 : -EIO;
+}
+
+// Moves every request onto the device, aligned to whole LBAs. Requests
+// that would run past the capacity are moved back to end at it.
+static void remap(enum Remap mode) {
+  const uint64_t lba = dev->lba_size_bytes;
+  const uint64_t capacity = dev->capacity_bytes;
+  uint64_t highest = 0;
+  for (const ReplayRecord &record : records) {
+    highest = std::max(highest, record.offset + record.size);
+  }
+  for (ReplayRecord &record : records) {
+    if (record.op == REPLAY_FLUSH) continue;
+    uint64_t offset = record.offset;
+    if (mode == REMAP_SCALE && highest > capacity) {
+      offset = (unsigned __int128)offset * capacity / highest;
+    }
+    uint64_t address = offset / lba * lba;
+    uint64_t size = (offset - address + record.size + lba - 1) / lba * lba;
+    if (size > capacity) size = capacity;
+    address %= capacity;
+    if (address + size > capacity) address = capacity - size;
+    record.offset = address;
+    record.size = size;
+  }
+}
+
+static void worker(WorkerCounters *counters, uint32_t buffer_size) {
+  char *buffer = (char *)malloc(buffer_size);
+  memset(buffer, 'r', buffer_size);
+  for (;;) {
+    uint64_t i = next_record.fetch_add(1, std::memory_order_relaxed);
+    if (i >= records.size()) break;
+    const ReplayRecord &record = records[i];
+    if (timing == TIMING_TRACE) {
+      auto due = start + std::chrono::nanoseconds(
+                             (uint64_t)(record.time_ns / speedup));
+      auto now = std::chrono::steady_clock::now();
+      if (now < due) {
+        std::this_thread::sleep_until(due);
+      } else if (now > due) {
+        lateness.record(
+            std::chrono::duration_cast<std::chrono::microseconds>(now - due)
+                .count());
+      }
+    }
+    uint64_t begin = clock_ticks();
+    int ret;
+    switch (record.op) {
+      case REPLAY_READ:
+        ret = zns_udevice_read(dev, record.offset, buffer, record.size);
+        break;
+      case REPLAY_WRITE:
+        ret = zns_udevice_write(dev, record.offset, buffer, record.size);
+        break;
+      default:
+        ret = zns_udevice_flush(dev);
+        break;
+    }
+    latency[record.op].record(clock_ticks() - begin);
+    if (ret != 0) {
+      fprintf(stderr, "zreplay: request %lu at 0x%lx failed with %d \n", i,
+              record.offset, ret);
+      counters->errors++;
+      continue;
+    }
+    counters->ops[record.op].fetch_add(1, std::memory_order_relaxed);
+    counters->bytes[record.op].fetch_add(record.size,
+                                         std::memory_order_relaxed);
+  }
+  free(buffer);
+}
+
+static uint64_t device_bytes(const struct zns_stats &stats) {
+  return stats.dev_bytes_host + stats.dev_bytes_gc_merge +
+         stats.dev_bytes_gc_insert + stats.dev_bytes_wear_level +
+         stats.dev_bytes_padding + stats.dev_bytes_journal +
+         stats.dev_bytes_checkpoint;
+}
+
+static int fill_device() {
+  const uint64_t chunk = dev->lba_size_bytes * 256;
+  char *buffer = (char *)malloc(chunk);
+  memset(buffer, 'f', chunk);
+  int ret = 0;
+  for (uint64_t address = 0; address < dev->capacity_bytes && ret == 0;
+       address += chunk) {
+    uint64_t size = std::min(chunk, dev->capacity_bytes - address);
+    ret = zns_udevice_write(dev, address, buffer, size);
+  }
+  free(buffer);
+  return ret;
+}
+
+static int show_help() {
+  printf("Usage: zreplay -d device_name [options] trace_file \n");
+  printf("-d : nvmeXpY or /dev/nvmeXpY, the device to run on, it is reset. \n");
+  printf("-l : the number of log zones (default, 3). \n");
+  printf("-w : the GC watermark in free log zones (default, 1). \n");
+  printf("-b : run the GC in the background instead of on-demand. \n");
+  printf("-g : bandwidth budget of the background GC in MiB/s. \n");
+  printf("-t : separate hot and cold data in different log zones. \n");
+  printf("-c : checksum every block and verify it when it is read. \n");
+  printf(
+      "-F : blkparse, msr or binary (default, msr for .csv files, binary "
+      "for .zr files and blkparse otherwise). \n");
+  printf(
+      "-T : afap, trace or a speedup like 2.5 to issue the requests at "
+      "their scaled times in the trace (default, afap). \n");
+  printf(
+      "-a : wrap or scale, how to fit the addresses onto the capacity "
+      "(default, wrap). \n");
+  printf("-j : the number of threads issuing requests (default, 1). \n");
+  printf("-n : replay only the first [int] requests. \n");
+  printf(
+      "-f : write the whole device first, unwritten blocks are read "
+      "without touching the device. \n");
+  printf("-o : write the report as JSON to [file]. \n");
+  printf(
+      "-C : convert the trace to the binary format in [file] and exit, no "
+      "device is needed. \n");
+  printf("-h : shows help, and exits with success. \n");
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  struct zdev_init_params params = {};
+  params.log_zones = 3;
+  params.gc_wmark = 1;
+  params.force_reset = true;
+  const char *device = nullptr;
+  const char *json_file = nullptr;
+  const char *convert_file = nullptr;
+  int format = -1;
+  enum Remap remap_mode = REMAP_WRAP;
+  uint32_t nthreads = 1;
+  uint64_t limit = 0;
+  bool fill = false;
+  int c;
+  while ((c = getopt(argc, argv, "d:l:w:g:F:T:a:j:n:o:C:btcfh")) != -1) {
+    switch (c) {
+      case 'h':
+        show_help();
+        exit(0);
+      case 'd':
+        // The FTL wants the name without /dev/.
+        device = strrchr(optarg, '/') ? strrchr(optarg, '/') + 1 : optarg;
+        break;
+      case 'l':
+        params.log_zones = atoi(optarg);
+        break;
+      case 'w':
+        params.gc_wmark = atoi(optarg);
+        break;
+      case 'b':
+        params.gc_mode = ZNS_GC_BACKGROUND;
+        break;
+      case 'g':
+        params.gc_rate_mbps = atoi(optarg);
+        break;
+      case 't':
+        params.hot_cold = true;
+        break;
+      case 'c':
+        params.checksums = true;
+        break;
+      case 'F':
+        if (strcmp(optarg, "blkparse") == 0) {
+          format = FORMAT_BLKPARSE;
+        } else if (strcmp(optarg, "msr") == 0) {
+          format = FORMAT_MSR;
+        } else if (strcmp(optarg, "binary") == 0) {
+          format = FORMAT_BINARY;
+        } else {
+          fprintf(stderr, "zreplay: unknown format %s \n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'T':
+        if (strcmp(optarg, "afap") == 0) {
+          timing = TIMING_AFAP;
+        } else if (strcmp(optarg, "trace") == 0) {
+          timing = TIMING_TRACE;
+          speedup = 1.0;
+        } else {
+          timing = TIMING_TRACE;
+          speedup = atof(optarg);
+          if (speedup <= 0) {
+            fprintf(stderr, "zreplay: bad timing %s \n", optarg);
+            return EXIT_FAILURE;
+          }
+        }
+        break;
+      case 'a':
+        if (strcmp(optarg, "wrap") == 0) {
+          remap_mode = REMAP_WRAP;
+        } else if (strcmp(optarg, "scale") == 0) {
+          remap_mode = REMAP_SCALE;
+        } else {
+          fprintf(stderr, "zreplay: unknown remapping %s \n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'j':
+        nthreads = atoi(optarg);
+        break;
+      case 'n':
+        limit = strtoull(optarg, nullptr, 10);
+        break;
+      case 'o':
+        json_file = optarg;
+        break;
+      case 'C':
+        convert_file = optarg;
+        break;
+      case 'f':
+        fill = true;
+        break;
+      default:
+        show_help();
+        return EXIT_FAILURE;
+    }
+  }
+  if (optind != argc - 1 || nthreads == 0 ||
+      (convert_file == nullptr &&
+       (device == nullptr || params.log_zones < 3 || params.gc_wmark < 1))) {
+    show_help();
+    return EXIT_FAILURE;
+  }
+  const char *trace_file = argv[optind];
+  if (format < 0) {
+    const char *dot = strrchr(trace_file, '.');
+    if (dot != nullptr && strcmp(dot, ".csv") == 0) {
+      format = FORMAT_MSR;
+    } else if (dot != nullptr && strcmp(dot, ".zr") == 0) {
+      format = FORMAT_BINARY;
+    } else {
+      format = FORMAT_BLKPARSE;
+    }
+  }
+  int ret = load_trace(trace_file, (enum TraceFormat)format);
+  if (ret != 0) {
+    fprintf(stderr, "zreplay: cannot read the trace %s: %d \n", trace_file,
+            ret);
+    return EXIT_FAILURE;
+  }
+  if (limit != 0 && limit < records.size()) records.resize(limit);
+  if (std::none_of(records.begin(), records.end(),
+                   [](const ReplayRecord &record) {
+                     return record.op != REPLAY_FLUSH;
+                   })) {
+    fprintf(stderr, "zreplay: %s has no reads or writes \n", trace_file);
+    return EXIT_FAILURE;
+  }
+  if (convert_file != nullptr) {
+    ret = write_binary(convert_file);
+    if (ret != 0) {
+      fprintf(stderr, "zreplay: cannot write %s: %d \n", convert_file, ret);
+      return EXIT_FAILURE;
+    }
+    printf("wrote %lu requests to %s \n", records.size(), convert_file);
+    return 0;
+  }
+
+  params.name = strdup(device);
+  ret = init_ss_zns_device(&params, &dev);
+  if (ret != 0) {
+    fprintf(stderr, "zreplay: cannot open %s: %d \n", params.name, ret);
+    return EXIT_FAILURE;
+  }
+  remap(remap_mode);
+  uint32_t buffer_size = 0;
+  for (const ReplayRecord &record : records) {
+    buffer_size = std::max(buffer_size, record.size);
+  }
+  const double trace_s = records.back().time_ns / 1e9;
+  printf(
+      "replaying %lu requests over %.1f s of trace with %u threads, %s \n",
+      records.size(), trace_s, nthreads,
+      timing == TIMING_AFAP ? "as fast as possible" : "at trace timing");
+  if (fill) {
+    printf("writing the whole device first \n");
+    ret = fill_device();
+    if (ret != 0) {
+      fprintf(stderr, "zreplay: filling the device failed with %d \n", ret);
+      deinit_ss_zns_device(dev, false);
+      return EXIT_FAILURE;
+    }
+  }
+
+  struct zns_stats first = {}, last = {};
+  struct zns_latency stall = {};
+  zns_udevice_get_stats(dev, &first);
+  zns_udevice_get_latency(dev, ZNS_LAT_WRITE_STALL, &stall, true);
+  std::vector<WorkerCounters> counters(nthreads);
+  for (WorkerCounters &counter : counters) {
+    for (int op = REPLAY_READ; op < REPLAY_OPS; op++) {
+      counter.ops[op] = 0;
+      counter.bytes[op] = 0;
+    }
+    counter.errors = 0;
+  }
+  std::vector<std::thread> threads;
+  start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < nthreads; i++) {
+    threads.emplace_back(worker, &counters[i], buffer_size);
+  }
+  for (std::thread &thread : threads) thread.join();
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  zns_udevice_get_stats(dev, &last);
+  zns_udevice_get_latency(dev, ZNS_LAT_WRITE_STALL, &stall, false);
+
+  uint64_t ops[REPLAY_OPS] = {}, bytes[REPLAY_OPS] = {}, errors = 0;
+  for (WorkerCounters &counter : counters) {
+    for (int op = REPLAY_READ; op < REPLAY_OPS; op++) {
+      ops[op] += counter.ops[op];
+      bytes[op] += counter.bytes[op];
+    }
+    errors += counter.errors;
+  }
+  const uint64_t host = last.host_bytes_written - first.host_bytes_written;
+  const uint64_t device_written = device_bytes(last) - device_bytes(first);
+  const double wa = host ? (double)device_written / host : 0;
+  HistogramSnapshot snapshots[REPLAY_OPS], late;
+  lateness.snapshot(&late, false);
+  printf("replayed in %.1f s, %lu errors \n", seconds, errors);
+  static const char *names[REPLAY_OPS] = {"read", "write", "flush"};
+  for (int op = REPLAY_READ; op < REPLAY_OPS; op++) {
+    latency[op].snapshot(&snapshots[op], false);
+    if (snapshots[op].count == 0) continue;
+    const HistogramSnapshot &s = snapshots[op];
+    printf(
+        "%s: %lu requests, %.0f iops, %.1f MiB/s, latency (us) mean %.1f "
+        "p50 %.1f p99 %.1f p99.9 %.1f max %.1f \n",
+        names[op], ops[op], ops[op] / seconds,
+        bytes[op] / seconds / (1024 * 1024),
+        ticks_to_ns(s.sum / s.count) / 1000.0,
+        ticks_to_ns(s.percentile(0.5)) / 1000.0,
+        ticks_to_ns(s.percentile(0.99)) / 1000.0,
+        ticks_to_ns(s.percentile(0.999)) / 1000.0,
+        ticks_to_ns(s.max()) / 1000.0);
+  }
+  printf(
+      "host written %lu bytes, device written %lu, write amplification "
+      "%.2f, %lu GC cycles, %lu write stalls (p99 %.1f us) \n",
+      host, device_written, wa, last.gc_cycles - first.gc_cycles, stall.count,
+      stall.p99_ns / 1000.0);
+  if (timing == TIMING_TRACE) {
+    printf("%lu requests issued late, p99 %lu us, max %lu us \n", late.count,
+           late.percentile(0.99), late.max());
+  }
+
+  if (json_file != nullptr) {
+    FILE *out = fopen(json_file, "w");
+    if (out == nullptr) {
+      ret = -errno;
+      fprintf(stderr, "zreplay: cannot write %s: %d \n", json_file, ret);
+    } else {
+      fprintf(out,
+              "{\"trace\":\"%s\",\"requests\":%lu,\"trace_s\":%.3f,"
+              "\"speedup\":%.3f,\"threads\":%u,\"seconds\":%.3f,"
+              "\"errors\":%lu",
+              trace_file, records.size(), trace_s,
+              timing == TIMING_AFAP ? 0.0 : speedup, nthreads, seconds,
+              errors);
+      for (int op = REPLAY_READ; op < REPLAY_OPS; op++) {
+        const HistogramSnapshot &s = snapshots[op];
+        fprintf(out,
+                ",\n\"%s\":{\"count\":%lu,\"bytes\":%lu,\"mean_ns\":%lu,"
+                "\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu,"
+                "\"max_ns\":%lu}",
+                names[op], ops[op], bytes[op],
+                s.count ? ticks_to_ns(s.sum / s.count) : 0,
+                ticks_to_ns(s.percentile(0.5)),
+                ticks_to_ns(s.percentile(0.99)),
+                ticks_to_ns(s.percentile(0.999)), ticks_to_ns(s.max()));
+      }
+      fprintf(out,
+              ",\n\"host_bytes_written\":%lu,\"dev_bytes_written\":%lu,"
+              "\"write_amplification\":%.4f,\"gc_cycles\":%lu,"
+              "\"write_stalls\":%lu,\"write_stall_p99_ns\":%lu,"
+              "\"late_requests\":%lu,\"late_p99_us\":%lu}\n",
+              host, device_written, wa, last.gc_cycles - first.gc_cycles,
+              stall.count, stall.p99_ns, late.count, late.percentile(0.99));
+      fclose(out);
+    }
+  }
+  deinit_ss_zns_device(dev, false);
+  free(params.name);
+  return errors == 0 && ret == 0 ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,98 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+// Opens a device read-only and prints every zone of the FTL, as JSON, as
+// CSV or as a heatmap of the valid blocks. The maps come from the last
+// checkpoint and the journal, no GC runs and nothing is written.
+// Programs that have the device open use zns_udevice_dump_zones instead.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "zns_device.h"
+
+static int show_help() {
+  printf("Usage: zstat -d device_name [-l log_zones] [-f format] \n");
+  printf("-d : nvmeXpY or /dev/nvmeXpY, the device to inspect \n");
+  printf(
+      "-l : the number of log zones the FTL was created with (3), checked "
+      "against the checkpoint. \n");
+  printf("-f : json, csv or heatmap (default, heatmap). \n");
+  printf("-h : shows help, and exits with success. \n");
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  struct zdev_init_params params = {};
+  params.log_zones = 3;
+  params.gc_wmark = 1;
+  params.force_reset = false;
+  params.read_only = true;
+  enum zns_zone_format format = ZNS_ZONES_HEATMAP;
+  const char *device = nullptr;
+  int c;
+  while ((c = getopt(argc, argv, "d:l:f:h")) != -1) {
+    switch (c) {
+      case 'h':
+        show_help();
+        exit(0);
+      case 'd':
+        // The FTL wants the name without /dev/.
+        device = strrchr(optarg, '/') ? strrchr(optarg, '/') + 1 : optarg;
+        break;
+      case 'l':
+        params.log_zones = atoi(optarg);
+        break;
+      case 'f':
+        if (strcmp(optarg, "json") == 0) {
+          format = ZNS_ZONES_JSON;
+        } else if (strcmp(optarg, "csv") == 0) {
+          format = ZNS_ZONES_CSV;
+        } else if (strcmp(optarg, "heatmap") == 0) {
+          format = ZNS_ZONES_HEATMAP;
+        } else {
+          fprintf(stderr, "zstat: unknown format %s \n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      default:
+        show_help();
+        return EXIT_FAILURE;
+    }
+  }
+  if (device == nullptr || params.log_zones < 3) {
+    show_help();
+    return EXIT_FAILURE;
+  }
+  params.name = strdup(device);
+
+  struct user_zns_device *my_dev = nullptr;
+  int ret = init_ss_zns_device(&params, &my_dev);
+  if (ret != 0) {
+    fprintf(stderr, "zstat: cannot open %s: %d \n", params.name, ret);
+    return EXIT_FAILURE;
+  }
+  ret = zns_udevice_dump_zones(my_dev, stdout, format);
+  deinit_ss_zns_device(my_dev, false);
+  free(params.name);
+  return ret == 0 ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,159 @@
+/* MIT License
+Copyright (c) 2021 - current
+Authors:  Valentijn Dymphnus van de Beek & Zhiyang Wang
+This code is part of the Storage System Course at VU Amsterdam
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+// Converts a trace written by trace_dump to the Chrome trace event JSON
+// format, which chrome://tracing and ui.perfetto.dev can show.
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "../common/trace.h"
+
+static const char *op_name(uint16_t op) {
+  switch (op) {
+    case TRACE_HOST_READ:
+      return "read";
+    case TRACE_HOST_WRITE:
+      return "write";
+    case TRACE_WRITE_STALL:
+      return "write stall";
+    case TRACE_GC_CYCLE:
+      return "gc cycle";
+    case TRACE_GC_COPY:
+      return "gc copy";
+    case TRACE_ZONE_RESET:
+      return "zone reset";
+    case TRACE_JOURNAL_COMMIT:
+      return "journal commit";
+    case TRACE_CHECKPOINT:
+      return "checkpoint";
+    case TRACE_FLUSH:
+      return "flush";
+    case TRACE_NVME_READ:
+      return "nvme read";
+    case TRACE_NVME_WRITE:
+      return "nvme write";
+    default:
+      return "unknown";
+  }
+}
+
+static const char *op_category(uint16_t op) {
+  switch (op) {
+    case TRACE_HOST_READ:
+    case TRACE_HOST_WRITE:
+    case TRACE_WRITE_STALL:
+    case TRACE_FLUSH:
+      return "host";
+    case TRACE_GC_CYCLE:
+    case TRACE_GC_COPY:
+    case TRACE_ZONE_RESET:
+      return "gc";
+    case TRACE_JOURNAL_COMMIT:
+    case TRACE_CHECKPOINT:
+      return "metadata";
+    default:
+      return "nvme";
+  }
+}
+
+struct ThreadTrace {
+  TraceThreadHeader header;
+  std::vector<TraceEvent> events;
+};
+
+static int show_help() {
+  printf("Usage: ztrace trace_file [json_file] \n");
+  printf("Writes the trace to json_file, or to stdout without it. \n");
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    show_help();
+    return EXIT_FAILURE;
+  }
+  FILE *in = fopen(argv[1], "rb");
+  if (in == nullptr) {
+    perror("ztrace: cannot open the trace");
+    return EXIT_FAILURE;
+  }
+  TraceFileHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      header.magic != TRACE_MAGIC || header.version != TRACE_VERSION) {
+    fprintf(stderr, "ztrace: %s is not a trace \n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  std::vector<ThreadTrace> threads(header.nthreads);
+  uint64_t origin = UINT64_MAX;
+  for (ThreadTrace &thread : threads) {
+    if (fread(&thread.header, sizeof(thread.header), 1, in) != 1) {
+      fprintf(stderr, "ztrace: %s is truncated \n", argv[1]);
+      return EXIT_FAILURE;
+    }
+    thread.events.resize(thread.header.count);
+    if (fread(thread.events.data(), sizeof(TraceEvent), thread.header.count,
+              in) != thread.header.count) {
+      fprintf(stderr, "ztrace: %s is truncated \n", argv[1]);
+      return EXIT_FAILURE;
+    }
+    for (const TraceEvent &event : thread.events) {
+      origin = std::min(origin, event.start);
+    }
+  }
+  fclose(in);
+
+  FILE *out = argc == 3 ? fopen(argv[2], "w") : stdout;
+  if (out == nullptr) {
+    perror("ztrace: cannot open the output");
+    return EXIT_FAILURE;
+  }
+  // Timestamps are in microseconds, relative to the first event.
+  const double us_per_tick = header.ns_per_tick / 1000.0;
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  bool first = true;
+  for (const ThreadTrace &thread : threads) {
+    if (thread.header.name[0] != '\0') {
+      fprintf(out,
+              "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+              "\"tid\":%u,\"args\":{\"name\":\"%.16s\"}}",
+              first ? "" : ",", thread.header.tid, thread.header.name);
+      first = false;
+    }
+    for (const TraceEvent &event : thread.events) {
+      fprintf(out,
+              "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+              "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"zone\":%u,"
+              "\"lba\":%lu,\"len\":%u}}",
+              first ? "" : ",", op_name(event.op), op_category(event.op),
+              thread.header.tid, (event.start - origin) * us_per_tick,
+              (event.end - event.start) * us_per_tick, event.zone, event.lba,
+              event.len);
+      first = false;
+    }
+  }
+  fprintf(out, "\n]}\n");
+  if (out != stdout) fclose(out);
+  return 0;
+}
@@ -35,6 +35,9 @@ SOFTWARE.
 #include <string>
 #include <vector>
 
+#include "../common/lockstat.h"
+#include "../common/log.h"
+#include "../common/memstat.h"
 #include "../common/unused.h"
 #include "allocator.hpp"
 #include "directory.hpp"
@@ -66,7 +69,7 @@ S2FileSystem::S2FileSystem(std::string uri_db_path, bool debug) {
   std::string sdelimiter = ":";
   std::string edelimiter = "://";
   this->_uri = uri_db_path;
-  struct zdev_init_params params;
+  struct zdev_init_params params = {};
   std::string device = uri_db_path.substr(
       uri_db_path.find(sdelimiter) + sdelimiter.size(),
       uri_db_path.find(edelimiter) -
@@ -212,6 +215,18 @@ S2FileSystem::~S2FileSystem() {
   bool store = g_init_counter == 0;
   disable_gc(this->_zns_dev);
   std::cout << "Deconstructor" << std::endl;
+  // Whatever is left in the I/O buffers at this point was leaked.
+  S2fsMemStats mem;
+  this->GetMemStats(&mem);
+  ss_info(DBG_FS_1,
+          "memory: inode cache %lu, dir cache %lu, inode map %lu, io buffers "
+          "%lu (peak %lu) bytes\n",
+          mem.inode_cache_bytes, mem.dir_cache_bytes, mem.inode_map_bytes,
+          mem.io_buffer_bytes, mem.io_buffer_peak_bytes);
+  if (mem.io_buffer_bytes != 0) {
+    ss_warn(DBG_FS_1, "leaked %lu bytes of I/O buffers\n",
+            mem.io_buffer_bytes);
+  }
   if (store) this->backup();
 
   deinit_ss_zns_device(this->_zns_dev, store);
@@ -248,9 +263,9 @@ struct ss_inode *callback_missing_file_create(const char *name, StoDir *parent,
   parent->add_entry(inode->inode_number, 12, name);
   printf("inode num is %d\n", inode->inode_number);
   parent->write_to_disk();
-  inode_cache_lock.lock();
+  profiled_lock(&inode_cache_lock, LOCK_FS_INODE_CACHE);
   inode_cache[inode->inode_number] = inode;
-  inode_cache_lock.unlock();
+  profiled_unlock(&inode_cache_lock, LOCK_FS_INODE_CACHE);
 
   return get_inode_by_id(inode->inode_number, allocator);
 }
@@ -480,9 +495,9 @@ struct ss_dnode_record *callback_missing_directory(const char *name,
   directory->write_to_disk();
   parent->add_entry(directory->inode_number, 12, name);
   parent->write_to_disk();
-  dir_cache_lock.lock();
+  profiled_lock(&dir_cache_lock, LOCK_FS_DIR_CACHE);
   dir_cache[directory->inode_number] = directory;
-  dir_cache_lock.unlock();
+  profiled_unlock(&dir_cache_lock, LOCK_FS_DIR_CACHE);
   return parent->find_entry(name);
 }
 
@@ -674,6 +689,24 @@ IOStatus S2FileSystem::DeleteFileWrapper(const std::string &fname) {
   return IOStatus::IOError(__FUNCTION__);
 }
 
+void S2FileSystem::GetMemStats(S2fsMemStats *out) {
+  profiled_lock(&inode_cache_lock, LOCK_FS_INODE_CACHE);
+  out->inode_cache_bytes = hash_map_bytes(inode_cache);
+  for (auto &entry : inode_cache) {
+    out->inode_cache_bytes += sizeof(StoInode) + entry.second->name.capacity();
+  }
+  profiled_unlock(&inode_cache_lock, LOCK_FS_INODE_CACHE);
+  profiled_lock(&dir_cache_lock, LOCK_FS_DIR_CACHE);
+  out->dir_cache_bytes =
+      hash_map_bytes(dir_cache) + dir_cache.size() * sizeof(StoDir);
+  profiled_unlock(&dir_cache_lock, LOCK_FS_DIR_CACHE);
+  profiled_lock(&inode_map_lock, LOCK_FS_INODE_MAP);
+  out->inode_map_bytes = hash_map_bytes(inode_map);
+  profiled_unlock(&inode_map_lock, LOCK_FS_INODE_MAP);
+  out->io_buffer_bytes = g_io_buffer_mem.current;
+  out->io_buffer_peak_bytes = g_io_buffer_mem.peak;
+}
+
 IOStatus S2FileSystem::DeleteFile(const std::string &fname,
                                   const IOOptions &options,
                                   __attribute__((unused)) IODebugContext *dbg) {
@@ -751,7 +784,7 @@ IOStatus S2FileSystem::UnlockFile(FileLock *lock, const IOOptions &options,
   }
 
   StoFileLock *slock = reinterpret_cast<StoFileLock *>(lock);
-  file_lock_lock.lock();
+  profiled_lock(&file_lock_lock, LOCK_FS_FILE_LOCK);
   if (std::find(file_locks.begin(), file_locks.end(), slock->name) ==
       file_locks.end()) {
     std::cout << "Unlock failed";
@@ -760,7 +793,7 @@ IOStatus S2FileSystem::UnlockFile(FileLock *lock, const IOOptions &options,
   file_locks.erase(
       std::remove(file_locks.begin(), file_locks.end(), slock->name),
       file_locks.end());
-  file_lock_lock.unlock();
+  profiled_unlock(&file_lock_lock, LOCK_FS_FILE_LOCK);
   std::cout << slock->inode_num << std::endl;
   if (slock->inode_num == 0) {
     return IOStatus::IOError(__FUNCTION__);
@@ -816,11 +849,11 @@ IOStatus S2FileSystem::LockFile(const std::string &fname,
   std::cerr << "[Lock]" << fname << std::endl;
   struct ss_inode found_inode;
 
-  file_lock_lock.lock();
+  profiled_lock(&file_lock_lock, LOCK_FS_FILE_LOCK);
   if (std::find(file_locks.begin(), file_locks.end(), fname) !=
       file_locks.end())
     return IOStatus::IOError(fname + "  already locked");
-  file_lock_lock.unlock();
+  profiled_unlock(&file_lock_lock, LOCK_FS_FILE_LOCK);
 
   struct find_inode_callbacks cbs = {
       .missing_directory_cb = NULL,
@@ -832,9 +865,9 @@ IOStatus S2FileSystem::LockFile(const std::string &fname,
   std::string cut = fname.substr(1, fname.size() - 1);
   enum DirectoryError error =
       find_inode(root, cut, &found_inode, &cbs, this->allocator);
-  file_lock_lock.lock();
+  profiled_lock(&file_lock_lock, LOCK_FS_FILE_LOCK);
   file_locks.push_back(fname);
-  file_lock_lock.unlock();
+  profiled_unlock(&file_lock_lock, LOCK_FS_FILE_LOCK);
 
   if (error == DirectoryError::Created_inode) {
     *lock = new StoFileLock(found_inode.id, fname);
@@ -36,6 +36,17 @@ SOFTWARE.
 #include "structures.h"
 
 namespace ROCKSDB_NAMESPACE {
+/** Heap bytes of the caches and buffers of the file system. The maps
+ * are estimated from their size, so malloc overhead is missing. */
+struct S2fsMemStats {
+  uint64_t inode_cache_bytes;
+  uint64_t dir_cache_bytes;
+  uint64_t inode_map_bytes;
+  /* Read buffers and held back writes, now and at most */
+  uint64_t io_buffer_bytes;
+  uint64_t io_buffer_peak_bytes;
+};
+
 class S2FileSystem : public FileSystem {
  public:
   // No copying allowed
@@ -157,6 +168,10 @@ class S2FileSystem : public FileSystem {
 
   IOStatus DeleteFileWrapper(const std::string &fname);
 
+  /** Memory used by the file system itself, zns_udevice_get_memory has
+   * the memory of the FTL below it. */
+  void GetMemStats(S2fsMemStats *out);
+
  private:
   void backup();
   struct user_zns_device *_zns_dev;
@@ -8,6 +8,8 @@
 #include <cstring>
 #include <iostream>
 
+#include "../common/lockstat.h"
+#include "../common/probes.h"
 #include "structures.h"
 #define Round_down(n, m) (n - (n % m))
 
@@ -24,7 +26,7 @@ BlockManager::BlockManager(user_zns_device *disk) {
 }
 
 int BlockManager::append(void *buffer, uint32_t size, uint64_t *start_addr,
-                         bool update) {
+                         bool update, enum zns_write_hint hint) {
   // update operation should be atomic.
   /*
   check wheter the wp is on the block boundary.
@@ -35,20 +37,21 @@ int BlockManager::append(void *buffer, uint32_t size, uint64_t *start_addr,
   needs to hold the lock when writing.
   */
   int ret = 0;
-  pthread_rwlock_wrlock(&this->wp.wp_lock);
+  profiled_wrlock(&this->wp.wp_lock, LOCK_FS_WP);
   uint64_t wp = this->get_current_position();
+  STOSYS_PROBE3(block_append, wp, size, hint);
 
   // printf("current wp is %lx, size is %d\n", wp, size);
   uint32_t lba_size = this->disk->lba_size_bytes;
   *start_addr = wp;
   if (wp + size >= disk->capacity_bytes) {
-    pthread_rwlock_unlock(&this->wp.wp_lock);
+    profiled_unlock(&this->wp.wp_lock, LOCK_FS_WP);
     return -1;
   }
 
   if (wp % lba_size == 0) {
     size_t padding_size = Round_up(size, lba_size);
-    ret = zns_udevice_write(this->disk, wp, buffer, padding_size);
+    ret = zns_udevice_write_hint(this->disk, wp, buffer, padding_size, hint);
   } else {
     uint64_t wp_base = Round_down(wp, lba_size);
     uint64_t curr_data_size_in_block = wp - wp_base;
@@ -58,13 +61,14 @@ int BlockManager::append(void *buffer, uint32_t size, uint64_t *start_addr,
     char blocks[padding_size];
     ret = zns_udevice_read(this->disk, wp_base, blocks, lba_size);
     memcpy(blocks + curr_data_size_in_block, buffer, size);
-    ret = zns_udevice_write(this->disk, wp_base, blocks, padding_size);
+    ret = zns_udevice_write_hint(this->disk, wp_base, blocks, padding_size,
+                                 hint);
   }
 
   if (update) {
     this->update_current_position(wp + size);
   }
-  pthread_rwlock_unlock(&this->wp.wp_lock);
+  profiled_unlock(&this->wp.wp_lock, LOCK_FS_WP);
   return ret;
 }
 
@@ -170,6 +174,8 @@ int BlockManager::write(uint64_t lba, void *buffer, uint32_t size) {
   return ret;
 }
 
+int BlockManager::flush() { return zns_udevice_flush(this->disk); }
+
 uint64_t BlockManager::get_current_position() {
   uint64_t ret = this->wp.position;
   return ret;
@@ -15,12 +15,16 @@ class BlockManager {
  public:
   BlockManager(user_zns_device *disk);
 
-  int append(void *buffer, uint32_t size, uint64_t *start_addr, bool update);
+  int append(void *buffer, uint32_t size, uint64_t *start_addr, bool update,
+             enum zns_write_hint hint = ZNS_WLTH_NOT_SET);
 
   int read(uint64_t lba, void *buffer, uint32_t size);
 
   int write(uint64_t lba, void *buffer, uint32_t size);
 
+  // make everything written so far durable.
+  int flush();
+
   // return the write pointer.
   uint64_t get_current_position();
 
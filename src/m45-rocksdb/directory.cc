@@ -3,6 +3,7 @@
 #include <cstring>
 #include <regex>
 
+#include "../common/lockstat.h"
 #include "allocator.hpp"
 #include "inode.hpp"
 #include "structures.h"
@@ -56,9 +57,9 @@ void StoDir::write_to_disk() {
 
     sinode->add_segment(lba, 1);
     sinode->write_to_disk(true);
-    inode_cache_lock.lock();
+    profiled_lock(&inode_cache_lock, LOCK_FS_INODE_CACHE);
     inode_cache[sinode->inode_number] = sinode;
-    inode_cache_lock.unlock();
+    profiled_unlock(&inode_cache_lock, LOCK_FS_INODE_CACHE);
     return;
   }
 
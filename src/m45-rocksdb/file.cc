@@ -30,13 +30,14 @@ StoFile::StoFile(StoInode *inode, BlockManager *allocator) {
 
 StoFile::~StoFile() {}
 
-void StoFile::write(size_t size, void *data) {
+void StoFile::write(size_t size, void *data, enum zns_write_hint hint) {
   // Move the size of our inode up by the number of bytes in our write
   pthread_mutex_lock(&this->inode.lock);
   this->inode.node->size += size;
   uint8_t total_blocks = std::ceil(size / (float)g_lba_size);
   bool overwrite = this->inode.node->inserted;
-  uint64_t slba = store_segment_on_disk(size, data, this->allocator, overwrite);
+  uint64_t slba =
+      store_segment_on_disk(size, data, this->allocator, overwrite, hint);
 
   this->inode.node->add_segment(slba, total_blocks);
   this->inode.node->write_to_disk(false);
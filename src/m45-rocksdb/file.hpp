@@ -18,7 +18,8 @@ class StoFile {
   StoFile(StoInode *inode, BlockManager *allocator);
   ~StoFile();
   void write_to_disk(bool update);
-  void write(size_t size, void *data);
+  void write(size_t size, void *data,
+             enum zns_write_hint hint = ZNS_WLTH_NOT_SET);
   void read(size_t size, void *result);
   struct inode {
     StoInode *node;
@@ -5,6 +5,9 @@
 #include <cassert>
 #include <cstdint>
 
+#include "../common/log.h"
+#include "../common/memstat.h"
+#include "../common/probes.h"
 #include "../common/unused.h"
 #include "allocator.hpp"
 
@@ -12,6 +15,8 @@
 
 namespace ROCKSDB_NAMESPACE {
 
+MemCounter g_io_buffer_mem;
+
 StoDirFS::StoDirFS(char *name, const uint64_t parent_inode,
                    BlockManager *allocator) {
   this->directory = new StoDir(name, parent_inode, allocator);
@@ -44,13 +49,14 @@ StoFileLock::~StoFileLock() { assert(this->inode_num == 0); }
 
 StoRAFile::StoRAFile(struct ss_inode *inode, BlockManager *allocator) {
   this->file = new StoFile(inode, allocator);
+  this->buffer = nullptr;
 }
 
 StoRAFile::~StoRAFile() {
   // something
   delete this->file;
   if (this->clean_slice) {
-    free(this->buffer);
+    counted_free(&g_io_buffer_mem, this->buffer);
   }
 }
 
@@ -60,14 +66,19 @@ IOStatus StoRAFile::Read(uint64_t offset, size_t size, const IOOptions &options,
   UNUSED(scratch);
   UNUSED(dbg);
 
-  std::cout << "RA read" << std::endl;
+  STOSYS_PROBE3(file_read, this->file->name.c_str(), offset, size);
+  ss_debug(DBG_FS_FIO, "RA read %s offset %lu size %zu\n",
+           this->file->name.c_str(), offset, size);
   // Read a total offset + size bytes from the underlying file
   // TODO(valentijn): memory leak?
   pthread_mutex_lock(&this->file->inode.lock);
 
-  char *buffer = (char *)malloc(
+  // The buffers of earlier reads are never freed, as slices of them may
+  // still be in use. g_io_buffer_mem shows how much that adds up to.
+  char *buffer = (char *)counted_malloc(
+      &g_io_buffer_mem,
       Round_up(Min(offset + size, this->file->inode.node->size), g_lba_size) *
-      2);
+          2);
   this->buffer = buffer;
   this->clean_slice = true;
 
@@ -79,8 +90,6 @@ IOStatus StoRAFile::Read(uint64_t offset, size_t size, const IOOptions &options,
 
   // Copy the buffer over to the result slice
   *result = Slice(buffer, Min(this->file->inode.node->size - (size_t)1, size));
-
-  std::cout << "RA read " << result->data() << std::endl;
   return IOStatus::OK();
 }
 
@@ -88,18 +97,20 @@ StoSeqFile::StoSeqFile(struct ss_inode *inode, BlockManager *allocator) {
   this->file = new StoFile(inode, allocator);
   this->offset = 0;
   this->eof = false;
+  this->buffer = nullptr;
 }
 
 StoSeqFile::~StoSeqFile() {
   // something
   delete this->file;
-  free(this->buffer);
+  counted_free(&g_io_buffer_mem, this->buffer);
 }
 
 IOStatus StoSeqFile::Read(size_t size, const IOOptions &options, Slice *result,
                           char *scratch, IODebugContext *dbg) {
+  STOSYS_PROBE3(file_read, this->file->name.c_str(), this->offset, size);
   if (eof) {
-    printf("read value end.\n");
+    ss_debug(DBG_FS_FIO, "read value end.\n");
     *result = Slice();
     return IOStatus::OK();
   }
@@ -108,8 +119,10 @@ IOStatus StoSeqFile::Read(size_t size, const IOOptions &options, Slice *result,
   pthread_mutex_lock(&this->file->inode.lock);
   size_t adjusted = Min(offset + size, this->file->inode.node->size);
 
-  printf("inode file size is %d\n", this->file->inode.node->size);
-  char *buffer = (char *)malloc(Round_up(adjusted, g_lba_size) * 2);
+  ss_debug(DBG_FS_FIO, "inode file size is %u\n",
+           this->file->inode.node->size);
+  char *buffer = (char *)counted_malloc(&g_io_buffer_mem,
+                                       Round_up(adjusted, g_lba_size) * 2);
   pthread_mutex_unlock(&this->file->inode.lock);
   this->file->read(adjusted, (void *)buffer);
   ((char *)buffer)[adjusted - 1] = '\0';
@@ -120,11 +133,6 @@ IOStatus StoSeqFile::Read(size_t size, const IOOptions &options, Slice *result,
   //   as badly as we do atm.
   *result =
       Slice(buffer, std::min(this->file->inode.node->size - offset - 1, size));
-  if (this->file->name == "MANIFEST-000004") {
-    printf("Data %d:\n", result->size());
-    for (int i = 0; i < result->size(); i++) printf("%d ", buffer[i]);
-    printf("\n");
-  }
   this->buffer = buffer;
 
   this->offset = adjusted;
@@ -149,19 +157,23 @@ StoWriteFile::StoWriteFile(struct ss_inode *inode, BlockManager *allocator) {
 StoWriteFile::~StoWriteFile() {
   // Something
   delete this->file;
+  g_io_buffer_mem.sub(vector_bytes(this->cheat_buffer));
 }
 
 // Append data to the end of the file
 IOStatus StoWriteFile::Append(const Slice &data, const IOOptions &options,
                               IODebugContext *dbg) {
+  STOSYS_PROBE2(file_append, this->file->name.c_str(), data.size());
   if (this->file->name.find("MANIFEST") != std::string::npos) {
     char *p = (char *)data.data();
+    uint64_t held = vector_bytes(this->cheat_buffer);
     for (int i = 0; i < data.size(); i++)
       this->cheat_buffer.push_back(data.data()[i]);
+    g_io_buffer_mem.add(vector_bytes(this->cheat_buffer) - held);
     return IOStatus::OK();
   }
 
-  this->file->write(data.size(), (void *)data.data());
+  this->file->write(data.size(), (void *)data.data(), this->write_hint());
   return IOStatus::OK();
 }
 
@@ -176,15 +188,29 @@ IOStatus StoWriteFile::Flush(const IOOptions &options, IODebugContext *dbg) {
 
 // Sync writes the filesystem data to the FTL
 IOStatus StoWriteFile::Sync(const IOOptions &options, IODebugContext *dbg) {
-  std::cout << "[Fsync write]" << std::endl;
+  STOSYS_PROBE1(file_sync, this->file->name.c_str());
+  ss_debug(DBG_FS_FIO, "fsync %s\n", this->file->name.c_str());
   if (this->file->name.find("MANIFEST") != std::string::npos) {
-    this->file->write(cheat_buffer.size(), (void *)cheat_buffer.data());
+    this->file->write(cheat_buffer.size(), (void *)cheat_buffer.data(),
+                      this->write_hint());
     cheat_buffer.clear();
   }
   this->file->write_to_disk(true);
+  if (this->file->allocator->flush() != 0) {
+    return IOStatus::IOError("Sync failed: " + this->file->name);
+  }
   return IOStatus::OK();
 }
 
+static_assert(Env::WLTH_EXTREME == (int)ZNS_WLTH_EXTREME,
+              "zns_write_hint must mirror Env::WriteLifeTimeHint");
+
+// RocksDB tells us how long it expects the data to live, the FTL uses
+// this to keep WAL and SST data of different levels apart.
+enum zns_write_hint StoWriteFile::write_hint() {
+  return static_cast<enum zns_write_hint>(this->GetWriteLifeTimeHint());
+}
+
 // Close our file
 IOStatus StoWriteFile::Close(const IOOptions &options, IODebugContext *dbg) {
   return IOStatus::OK();
@@ -1,3 +1,4 @@
+#include "../common/memstat.h"
 #include "allocator.hpp"
 #include "directory.hpp"
 #include "file.hpp"
@@ -5,6 +6,10 @@
 #include "rocksdb/io_status.h"
 
 namespace ROCKSDB_NAMESPACE {
+/** Buffers the files hand out with the data they read, and the
+ * MANIFEST writes that are held back until a sync */
+extern MemCounter g_io_buffer_mem;
+
 class StoDirFS : public FSDirectory {
  public:
   StoDirFS(char *name, const uint64_t parent_inode, BlockManager *);
@@ -78,6 +83,8 @@ class StoWriteFile : public FSWritableFile {
   virtual IOStatus Close(const IOOptions &options, IODebugContext *dbg);
 
  private:
+  enum zns_write_hint write_hint();
+
   StoFile *file;
   uint64_t offset;
   std::vector<char> cheat_buffer;
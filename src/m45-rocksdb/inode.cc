@@ -10,6 +10,8 @@
 #include <iostream>
 #include <random>
 
+#include "../common/lockstat.h"
+#include "../common/log.h"
 #include "allocator.hpp"
 #include "structures.h"
 uint64_t g_inode_num = 2;
@@ -94,9 +96,9 @@ void StoInode::write_to_disk(bool update) {
 
   inode->inserted = true;
   this->allocator->append((void *)inode, sizeof(struct ss_inode), &lba, true);
-  pthread_mutex_lock(&inode_map_lock);
+  profiled_lock(&inode_map_lock, LOCK_FS_INODE_MAP);
   inode_map[this->inode_number] = lba;
-  pthread_mutex_unlock(&inode_map_lock);
+  profiled_unlock(&inode_map_lock, LOCK_FS_INODE_MAP);
   this->dirty = false;
 }
 
@@ -133,7 +135,7 @@ StoInode::~StoInode() {
 
 struct ss_inode *get_inode_from_disk(const uint64_t lba,
                                      BlockManager *allocator) {
-  printf("get inode from lba %lx\n", lba);
+  ss_debug(DBG_FS_INODE_1, "get inode from lba %lx\n", lba);
   struct ss_inode *buffer = (struct ss_inode *)malloc(sizeof(struct ss_inode));
   int ret = allocator->read(lba, buffer, sizeof(struct ss_inode));
 
@@ -162,15 +164,15 @@ uint64_t add_dnode_to_storage(const uint64_t inum,
                               BlockManager *allocator) {
   uint64_t lba;
   allocator->append((void *)drecord, sizeof(struct ss_dnode), &lba, true);
-  pthread_mutex_lock(&inode_map_lock);
+  profiled_lock(&inode_map_lock, LOCK_FS_INODE_MAP);
   inode_map[inum] = lba;
-  pthread_mutex_unlock(&inode_map_lock);
+  profiled_unlock(&inode_map_lock, LOCK_FS_INODE_MAP);
   return lba;
 }
 
 StoDir *get_directory_by_id(const uint64_t inum, BlockManager *allocator) {
   // moved root construct to the initialization phase.
-  dir_cache_lock.lock();
+  profiled_lock(&dir_cache_lock, LOCK_FS_DIR_CACHE);
 
   auto pos = dir_cache.count(inum);
   if (pos == 0 && inum == 2 && g_inode_num == 2) {
@@ -179,17 +181,16 @@ StoDir *get_directory_by_id(const uint64_t inum, BlockManager *allocator) {
     StoDir *root = new StoDir((char *)"/", 2, allocator);
     root->write_to_disk();
     dir_cache[root->inode_number] = root;
-    dir_cache_lock.unlock();
+    profiled_unlock(&dir_cache_lock, LOCK_FS_DIR_CACHE);
     return root;
   } else if (pos == 1) {
-    dir_cache_lock.unlock();
+    profiled_unlock(&dir_cache_lock, LOCK_FS_DIR_CACHE);
     return dir_cache[inum];
   }
 
   // exit(-1);
-  dir_cache_lock.unlock();
-  std::cout << "new"
-            << " " << inum << std::endl;
+  profiled_unlock(&dir_cache_lock, LOCK_FS_DIR_CACHE);
+  ss_debug(DBG_FS_INODE_1, "directory %lu not cached\n", inum);
   struct ss_inode *inode = get_inode_by_id(inum, allocator);
 
   // Return NULL if the inode does not contain a directory
@@ -204,14 +205,14 @@ StoDir *get_directory_by_id(const uint64_t inum, BlockManager *allocator) {
   void *buffer = malloc(sizeof(struct ss_dnode));
 
   allocator->read(segment->start_lba, buffer, sizeof(struct ss_dnode));
-  printf("read dnode from %lx\n", segment->start_lba);
+  ss_debug(DBG_FS_INODE_1, "read dnode from %lx\n", segment->start_lba);
   struct ss_dnode *dnode = (struct ss_dnode *)buffer;
 
-  dir_cache_lock.lock();
+  profiled_lock(&dir_cache_lock, LOCK_FS_DIR_CACHE);
   dir_cache[inum] = new StoDir(inum, dnode, allocator);
   dir_cache[inum]->dnode = *dnode;
   StoDir *newdir = dir_cache[inum];
-  dir_cache_lock.unlock();
+  profiled_unlock(&dir_cache_lock, LOCK_FS_DIR_CACHE);
   free(buffer);
   return newdir;
 }
@@ -230,30 +231,30 @@ struct ss_inode *get_inode_by_id(const uint64_t inum, BlockManager *allocator) {
 
 static uint16_t count_inodes = 0;
 StoInode *get_stoinode_by_id(const uint64_t inum, BlockManager *allocator) {
-  inode_cache_lock.lock();
+  profiled_lock(&inode_cache_lock, LOCK_FS_INODE_CACHE);
   if (inode_cache.count(inum) == 1) {
     StoInode *inode = inode_cache[inum];
-    inode_cache_lock.unlock();
+    profiled_unlock(&inode_cache_lock, LOCK_FS_INODE_CACHE);
     return inode;
   }
-  inode_cache_lock.unlock();
+  profiled_unlock(&inode_cache_lock, LOCK_FS_INODE_CACHE);
 
-  pthread_mutex_lock(&inode_map_lock);
+  profiled_lock(&inode_map_lock, LOCK_FS_INODE_MAP);
 
-  printf("inum is %d\n", inum);
+  ss_debug(DBG_FS_INODE_1, "inum is %lu\n", inum);
   auto found = inode_map.find(inum);
   if (found == inode_map.end()) {
-    pthread_mutex_unlock(&inode_map_lock);
-    printf("not found\n");
+    profiled_unlock(&inode_map_lock, LOCK_FS_INODE_MAP);
+    ss_debug(DBG_FS_INODE_1, "inode %lu not found\n", inum);
     return nullptr;
   }
 
-  pthread_mutex_unlock(&inode_map_lock);
+  profiled_unlock(&inode_map_lock, LOCK_FS_INODE_MAP);
   struct ss_inode *ret = get_inode_from_disk(found->second, allocator);
-  inode_cache_lock.lock();
+  profiled_lock(&inode_cache_lock, LOCK_FS_INODE_CACHE);
   inode_cache[inum] = new StoInode(ret, allocator);
   StoInode *stonode = inode_cache[inum];
-  inode_cache_lock.unlock();
+  profiled_unlock(&inode_cache_lock, LOCK_FS_INODE_CACHE);
   free(ret);
   return stonode;
 }
@@ -5,22 +5,24 @@
 #include <cassert>
 #include <iostream>
 
+#include "../common/lockstat.h"
 #include "allocator.hpp"
 #include "structures.h"
 #define assertm(exp, msg) assert(((void)msg, exp))
 
 uint64_t store_segment_on_disk(const size_t size, void *data,
-                               BlockManager *allocator, bool overwrite) {
+                               BlockManager *allocator, bool overwrite,
+                               enum zns_write_hint hint) {
   uint64_t lba;
   // printf("segment size is %d\n", size);
   if (overwrite) {
-    pthread_rwlock_wrlock(&allocator->wp.wp_lock);
+    profiled_wrlock(&allocator->wp.wp_lock, LOCK_FS_WP);
     uint64_t inode_addr = allocator->get_current_position();
     allocator->update_current_position(inode_addr - sizeof(struct ss_inode));
     // printf("curr addr is %ld.\n", inode_addr - sizeof(struct ss_inode));
-    pthread_rwlock_unlock(&allocator->wp.wp_lock);
+    profiled_unlock(&allocator->wp.wp_lock, LOCK_FS_WP);
   }
-  int ret = allocator->append(data, size, &lba, true);
+  int ret = allocator->append(data, size, &lba, true, hint);
 
   // ret == 0 => No space for writing.
   assertm(ret == 0, "write failed");
@@ -9,6 +9,7 @@ void get_from_disk(const uint64_t lba, const size_t size, void *data,
                    BlockManager *allocator);
 
 uint64_t store_segment_on_disk(const size_t size, void *data,
-                               BlockManager *allocator, bool overwrite);
+                               BlockManager *allocator, bool overwrite,
+                               enum zns_write_hint hint = ZNS_WLTH_NOT_SET);
 
 #endif